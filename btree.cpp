@@ -22,15 +22,172 @@
 #include "exceptions/end_of_file_exception.h"
 #include "exceptions/file_exists_exception.h"
 #include "exceptions/page_pinned_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "sharedIndex.h"
+#include "btreeProbes.h"
+#include "indexTrace.h"
 
 #include <iostream>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 using namespace std;
 
+#ifdef BTREE_USDT
+#define BTREE_PROBE_SEMAPHORE_DEFINITION(name) \
+  extern "C" { \
+    volatile unsigned short btree_##name##_semaphore \
+      __attribute__((used, section(".probes"))) = 0; \
+  }
+
+BTREE_PROBE_SEMAPHORE_DEFINITION(lookup__begin)
+BTREE_PROBE_SEMAPHORE_DEFINITION(lookup__end)
+BTREE_PROBE_SEMAPHORE_DEFINITION(lookup__batch)
+BTREE_PROBE_SEMAPHORE_DEFINITION(scan__start)
+BTREE_PROBE_SEMAPHORE_DEFINITION(scan__end)
+BTREE_PROBE_SEMAPHORE_DEFINITION(aggregate__scan)
+BTREE_PROBE_SEMAPHORE_DEFINITION(page__read)
+BTREE_PROBE_SEMAPHORE_DEFINITION(leaf__split)
+BTREE_PROBE_SEMAPHORE_DEFINITION(nonleaf__split)
+BTREE_PROBE_SEMAPHORE_DEFINITION(root__split)
+#endif
+
 using std::string;
 
 namespace wiscdb
 {
 
+// -----------------------------------------------------------------------------
+// expiryClock
+// -----------------------------------------------------------------------------
+
+uint32_t expiryClock() {
+  return (uint32_t) time(NULL);
+}
+
+// -----------------------------------------------------------------------------
+// makeSortKey
+// -----------------------------------------------------------------------------
+
+void makeSortKey(const Collation collation, const char* key, char* sortKey) {
+  memset(sortKey, 0, STRINGSIZE);
+  if(collation == BINARY) {
+    strncpy(sortKey, key, STRINGSIZE);
+  }
+  else if(collation == NOCASE) { //fold ASCII letters to lower case
+    for(int i = 0; i < STRINGSIZE && key[i] != '\0'; i++) {
+      char c = key[i];
+      sortKey[i] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    }
+  }
+  else if(collation == INTEGER) { //hex digits of the value, sign bit flipped
+    int value;
+    memcpy(&value, key, sizeof(int));
+    char digits[9];
+    snprintf(digits, sizeof(digits), "%08x", (uint32_t) value ^ 0x80000000u);
+    memcpy(sortKey, digits, 8);
+  }
+  else { //LOCALE: the leading bytes of the strxfrm() transform
+    char source[COLLATION_SOURCE_SIZE + 1];
+    strncpy(source, key, COLLATION_SOURCE_SIZE);
+    source[COLLATION_SOURCE_SIZE] = '\0';
+    std::vector<char> transformed(strxfrm(NULL, source, 0) + 1);
+    strxfrm(&transformed[0], source, transformed.size());
+    strncpy(sortKey, &transformed[0], STRINGSIZE);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// keyBytesPredicate
+// -----------------------------------------------------------------------------
+
+KeyPredicate keyBytesPredicate(const int offset, const char* bytes, const int len) {
+  KeyPredicate predicate;
+  predicate.kind = KEY_MASK;
+  predicate.patternLen = 0;
+  predicate.negate = false;
+  memset(predicate.pattern, 0, STRINGSIZE);
+  memset(predicate.mask, 0, STRINGSIZE);
+  for(int i = std::max(offset, 0); i < offset + len && i < STRINGSIZE; i++) {
+    predicate.pattern[i] = bytes[i - offset];
+    predicate.mask[i] = 0xFF;
+  }
+  return predicate;
+}
+
+// -----------------------------------------------------------------------------
+// keyContainsPredicate
+// -----------------------------------------------------------------------------
+
+KeyPredicate keyContainsPredicate(const char* bytes, const int len) {
+  KeyPredicate predicate;
+  predicate.kind = KEY_CONTAINS;
+  predicate.patternLen = std::max(0, std::min(len, STRINGSIZE));
+  predicate.negate = false;
+  memset(predicate.pattern, 0, STRINGSIZE);
+  memset(predicate.mask, 0, STRINGSIZE);
+  memcpy(predicate.pattern, bytes, predicate.patternLen);
+  return predicate;
+}
+
+// -----------------------------------------------------------------------------
+// Sorted run encoding
+// -----------------------------------------------------------------------------
+
+static void putLittleEndian(unsigned char* dest, uint64_t value, const int bytes) {
+  for(int i = 0; i < bytes; i++, value >>= 8) { dest[i] = (unsigned char) value; }
+}
+
+static uint64_t getLittleEndian(const unsigned char* src, const int bytes) {
+  uint64_t value = 0;
+  for(int i = bytes - 1; i >= 0; i--) { value = (value << 8) | src[i]; }
+  return value;
+}
+
+static void encodeRunHeader(const RunFileHeader& header, unsigned char* dest) {
+  memcpy(dest, header.magic, 8);
+  putLittleEndian(dest + 8, header.version, 4);
+  memcpy(dest + 12, header.relationName, 20);
+  putLittleEndian(dest + 32, (uint32_t) header.attrByteOffset, 4);
+  putLittleEndian(dest + 36, (uint32_t) header.keySize, 4);
+  dest[40] = header.unique;
+  dest[41] = (unsigned char) header.collation;
+  putLittleEndian(dest + 42, header.numRecords, 8);
+}
+
+static void decodeRunHeader(const unsigned char* src, RunFileHeader& header) {
+  memcpy(header.magic, src, 8);
+  header.version = (uint32_t) getLittleEndian(src + 8, 4);
+  memcpy(header.relationName, src + 12, 20);
+  header.attrByteOffset = (int32_t) getLittleEndian(src + 32, 4);
+  header.keySize = (int32_t) getLittleEndian(src + 36, 4);
+  header.unique = src[40] != 0;
+  header.collation = (Collation) src[41];
+  header.numRecords = getLittleEndian(src + 42, 8);
+}
+
+static void encodeRunRecord(const RIDKeyPair& krid, unsigned char* dest) {
+  memcpy(dest, krid.key, STRINGSIZE);
+  putLittleEndian(dest + STRINGSIZE, krid.rid.page_number, 4);
+  putLittleEndian(dest + STRINGSIZE + 4, krid.rid.slot_number, 2);
+  putLittleEndian(dest + STRINGSIZE + 6, krid.expiry, 4);
+}
+
+static void decodeRunRecord(const unsigned char* src, RIDKeyPair& krid) {
+  memcpy(krid.key, src, STRINGSIZE);
+  krid.rid.page_number = (PageId) getLittleEndian(src + STRINGSIZE, 4);
+  krid.rid.slot_number = (SlotId) getLittleEndian(src + STRINGSIZE + 4, 2);
+  krid.expiry = (uint32_t) getLittleEndian(src + STRINGSIZE + 6, 4);
+}
+
 // -----------------------------------------------------------------------------
 // BTreeIndex::BTreeIndex -- Constructor
 // -----------------------------------------------------------------------------
@@ -38,13 +195,35 @@ namespace wiscdb
 BTreeIndex::BTreeIndex(const std::string & relationName,
 		std::string & outIndexName,
 		BufferManager *bufMgrIn,
-		const int attrByteOffset){
+		const int attrByteOffset,
+		const IndexOptions & options){
 
   //Initializing data members
   scanExecuting = false;
+  sharedSegment = NULL;
+  traceFile = NULL;
+  keepHotSet = false;
+  nextHotPage = 0;
+  reservedFrameLimit = 0;
+  numTouchedPages = 0;
+  rangeCacheRids = 0;
+  rangeCacheLimit = 0;
+  cachedScan = NULL;
+  filterScan = false;
+  cachedScanNext = 0;
+  recordingScan = false;
+  rangeCacheHits = 0;
+  rangeCacheMisses = 0;
   this->attrByteOffset = attrByteOffset;
+  unique = options.unique;
+  collation = options.collation;
+  lazyDeletes = options.lazyDeletes;
+  keepHotSet = options.hotSet;
   rootPageNum = Page::INVALID_NUMBER;
   bufferManager = bufMgrIn;
+  if(unique && collation == LOCALE) { //truncated sort keys of distinct keys collide
+    throw BadIndexInfoException("A unique index cannot use the LOCALE collation");
+  }
   
   std::stringstream ss;
   ss << relationName << '.' << attrByteOffset;
@@ -58,25 +237,37 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
     rootPageNum = header->rootPageNo;
 
     //verify info is correct
-    if(strcmp(header->relationName, relationName.c_str())) {
-      delete file;
-      throw BadIndexInfoException("Relation name of existing index file did not match the inputted relation name");
+    const char* mismatch = NULL;
+    if(header->formatVersion != INDEX_FORMAT_VERSION) {
+      mismatch = "Existing index file was written in another format version";
     }
-    if(header->attrByteOffset != attrByteOffset) {
-      delete file;
-      throw BadIndexInfoException("Attribute byte offset of existing index file did not match the inputted attribute byte offset");
+    else if(strcmp(header->relationName, relationName.c_str())) {
+      mismatch = "Relation name of existing index file did not match the inputted relation name";
+    }
+    else if(header->attrByteOffset != attrByteOffset) {
+      mismatch = "Attribute byte offset of existing index file did not match the inputted attribute byte offset";
     }
-    //unpin page
+    else if(header->unique != unique) {
+      mismatch = "Uniqueness of existing index file did not match the inputted index options";
+    }
+    else if(header->collation != collation) {
+      mismatch = "Collation of existing index file did not match the inputted index options";
+    }
+    //unpin page, also when bailing out so the header does not stay pinned
     bufferManager->unPinPage(file, headerPageNum, false);
+    if(mismatch != NULL) {
+      delete file;
+      throw BadIndexInfoException(mismatch);
+    }
+    if(options.warmUpInternal || options.warmUpLeaves > 0 || !options.warmUpPages.empty()) {
+      warmUp(options.warmUpInternal, options.warmUpLeaves, options.warmUpPages);
+    }
+    if(keepHotSet) { readHotSet(); }
   } catch (FileNotFoundException e) {
     file = new RawFile(outIndexName, true);
     //Build a new index
-    Page* headerPage;
-    bufferManager->allocatePage(file, headerPageNum, headerPage); //allocates header page
-    IndexMetaInfo* header = (IndexMetaInfo*) headerPage; //get index metadata
-    strncpy(header->relationName, relationName.c_str(), 20); //sets header->relationName
-    header->attrByteOffset = attrByteOffset; //sets header->attrByteOffset
-    header->rootPageNo = rootPageNum; //sets header->rootPageNo
+    createHeader(relationName);
+    if(keepHotSet) { remove((outIndexName + ".hot").c_str()); } //left by an older index of this name
  
     FileScanner* fscan = new FileScanner(relationName, bufMgrIn);
     try
@@ -94,20 +285,206 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
     } catch(EndOfFileException e){
       delete fscan;
     }
-    //unpin page when done
-    bufferManager->unPinPage(file, headerPageNum, true);
+  }
+  if(options.reservedFrames > 0) { reserveInternalLevels(options.reservedFrames); }
+  if(options.rangeCacheRids > 0) { setRangeCache(options.rangeCacheRids); }
+}
+
+BTreeIndex::BTreeIndex(const std::string & runFileName,
+		std::string & outIndexName,
+		BufferManager *bufMgrIn,
+		const IndexOptions & options){
+
+  //Initializing data members
+  scanExecuting = false;
+  sharedSegment = NULL;
+  traceFile = NULL;
+  keepHotSet = false;
+  nextHotPage = 0;
+  reservedFrameLimit = 0;
+  numTouchedPages = 0;
+  rangeCacheRids = 0;
+  rangeCacheLimit = 0;
+  cachedScan = NULL;
+  filterScan = false;
+  cachedScanNext = 0;
+  recordingScan = false;
+  rangeCacheHits = 0;
+  rangeCacheMisses = 0;
+  lazyDeletes = false;
+  rootPageNum = Page::INVALID_NUMBER;
+  bufferManager = bufMgrIn;
+
+  if(options.leafFillPercent < 1 || options.leafFillPercent > 100) {
+    throw BadIndexInfoException("Leaf fill percentage must be between 1 and 100");
+  }
+  FILE* run = fopen(runFileName.c_str(), "rb");
+  if(run == NULL) {
+    throw FileNotFoundException(runFileName);
+  }
+  RunFileHeader runHeader;
+  unsigned char headerBytes[RUN_HEADER_BYTES];
+  if(fread(headerBytes, RUN_HEADER_BYTES, 1, run) != 1) {
+    fclose(run);
+    throw BadIndexInfoException("File is not a sorted run of this index's key size");
+  }
+  decodeRunHeader(headerBytes, runHeader);
+  if(strncmp(runHeader.magic, RUN_FILE_MAGIC, sizeof(runHeader.magic))
+     || runHeader.version != RUN_FILE_VERSION || runHeader.keySize != STRINGSIZE) {
+    fclose(run);
+    throw BadIndexInfoException("File is not a sorted run of this index's key size");
+  }
+  attrByteOffset = runHeader.attrByteOffset;
+  unique = runHeader.unique;
+  collation = runHeader.collation;
+  std::string relationName(runHeader.relationName,
+                           strnlen(runHeader.relationName, 20));
+
+  std::stringstream ss;
+  ss << relationName << '.' << attrByteOffset;
+  outIndexName = ss.str();
+  if(File::exists(outIndexName)) {
+    fclose(run);
+    throw FileExistsException(outIndexName);
+  }
+  file = new RawFile(outIndexName, true);
+  createHeader(relationName);
+
+  //Pack the run into leaves chunk by chunk, checking that it is sorted and
+  //holds as many records as its header says
+  BulkLoader loader;
+  bulkLoadBegin(loader, options.leafFillPercent);
+  std::vector<unsigned char> chunk((size_t) RUN_CHUNK_ENTRIES * RUN_RECORD_BYTES);
+  RIDKeyPair krid;
+  char prevKey[STRINGSIZE];
+  uint64_t numRecords = 0;
+  bool sorted = true, wholeRecords = true;
+  size_t numBytes;
+  while(sorted && wholeRecords && (numBytes = fread(&chunk[0], 1, chunk.size(), run)) > 0) {
+    wholeRecords = numBytes % RUN_RECORD_BYTES == 0;
+    if(!wholeRecords) { break; }
+    for(size_t i = 0; sorted && i < numBytes; i += RUN_RECORD_BYTES, numRecords++) {
+      decodeRunRecord(&chunk[i], krid);
+      sorted = numRecords == 0 || strncmp(prevKey, krid.key, STRINGSIZE) <= 0;
+      memcpy(prevKey, krid.key, STRINGSIZE);
+      if(sorted) { bulkLoadAppend(loader, krid); }
+    }
+  }
+  bool complete = wholeRecords && feof(run) && numRecords == runHeader.numRecords;
+  fclose(run);
+  bulkLoadFinish(loader);
+  if(!sorted || !complete) { //do not leave a partial index behind
+    bufferManager->flushFile(file);
+    delete file;
+    File::remove(outIndexName);
+    throw BadIndexInfoException(sorted ? "Sorted run " + runFileName + " is truncated or too long"
+                                       : "Sorted run " + runFileName + " is not in key order");
   }
 }
 
 
+BTreeIndex::BTreeIndex(BTreeIndex & first,
+		BTreeIndex & second,
+		const std::string & mergedIndexName,
+		BufferManager *bufMgrIn,
+		const IndexOptions & options){
+
+  //Initializing data members
+  scanExecuting = false;
+  sharedSegment = NULL;
+  traceFile = NULL;
+  keepHotSet = false;
+  nextHotPage = 0;
+  reservedFrameLimit = 0;
+  numTouchedPages = 0;
+  rangeCacheRids = 0;
+  rangeCacheLimit = 0;
+  cachedScan = NULL;
+  filterScan = false;
+  cachedScanNext = 0;
+  recordingScan = false;
+  rangeCacheHits = 0;
+  rangeCacheMisses = 0;
+  lazyDeletes = false;
+  rootPageNum = Page::INVALID_NUMBER;
+  bufferManager = bufMgrIn;
+
+  if(first.attrByteOffset != second.attrByteOffset) {
+    throw BadIndexInfoException("Merged indexes are not on the same attribute byte offset");
+  }
+  if(first.collation != second.collation) {
+    throw BadIndexInfoException("Merged indexes do not use the same collation");
+  }
+  IndexMetaInfo* firstHeader = first.getHeader();
+  std::string relationName(firstHeader->relationName,
+                           strnlen(firstHeader->relationName, 20));
+  first.bufferManager->unPinPage(first.file, first.headerPageNum, false);
+  IndexMetaInfo* secondHeader = second.getHeader();
+  std::string secondRelationName(secondHeader->relationName,
+                                 strnlen(secondHeader->relationName, 20));
+  second.bufferManager->unPinPage(second.file, second.headerPageNum, false);
+  if(relationName != secondRelationName) {
+    throw BadIndexInfoException("Merged indexes are not on the same relation");
+  }
+  if(options.leafFillPercent < 1 || options.leafFillPercent > 100) {
+    throw BadIndexInfoException("Leaf fill percentage must be between 1 and 100");
+  }
+  attrByteOffset = first.attrByteOffset;
+  unique = false;
+  collation = first.collation;
+  if(File::exists(mergedIndexName)) {
+    throw FileExistsException(mergedIndexName);
+  }
+
+  file = new RawFile(mergedIndexName, true);
+  createHeader(relationName);
+
+  //Sorted merge of the two leaf chains into the leaf packer
+  BulkLoader loader;
+  bulkLoadBegin(loader, options.leafFillPercent);
+  LeafCursor firstCursor, secondCursor;
+  first.openLeafCursor(firstCursor);
+  second.openLeafCursor(secondCursor);
+  RIDKeyPair krid;
+  while(firstCursor.pageNum != Page::INVALID_NUMBER
+        || secondCursor.pageNum != Page::INVALID_NUMBER) {
+    bool takeFirst = secondCursor.pageNum == Page::INVALID_NUMBER
+      || (firstCursor.pageNum != Page::INVALID_NUMBER
+          && strncmp(firstCursor.leaf->keyArray[firstCursor.slot],
+                     secondCursor.leaf->keyArray[secondCursor.slot], STRINGSIZE) <= 0);
+    if(takeFirst) {
+      krid.set(firstCursor.leaf->ridArray[firstCursor.slot], firstCursor.leaf->keyArray[firstCursor.slot],
+               firstCursor.leaf->expiryArray[firstCursor.slot]);
+      first.advanceLeafCursor(firstCursor);
+    }
+    else {
+      krid.set(secondCursor.leaf->ridArray[secondCursor.slot], secondCursor.leaf->keyArray[secondCursor.slot],
+               secondCursor.leaf->expiryArray[secondCursor.slot]);
+      second.advanceLeafCursor(secondCursor);
+    }
+    bulkLoadAppend(loader, krid);
+  }
+  bulkLoadFinish(loader);
+}
+
+
 // -----------------------------------------------------------------------------
 // BTreeIndex::~BTreeIndex -- destructor
 // -----------------------------------------------------------------------------
 
 BTreeIndex::~BTreeIndex(){
   if(scanExecuting) {
-    endScan();
+    closeScan();
+  }
+  if(sharedSegment != NULL) {
+    munmap(sharedSegment, sharedSegmentSize(sharedSegment->maxPages));
+    shm_unlink(sharedSegmentName.c_str());
+    sharedSegment = NULL;
+    disposeRetiredPages();
   }
+  stopTrace();
+  saveHotSet();
+  releaseReservedPages(); //flushFile() refuses files with pinned pages
   bufferManager->flushFile(file);
   delete file;
 }
@@ -116,12 +493,52 @@ BTreeIndex::~BTreeIndex(){
 // BTreeIndex::insertEntry
 // -----------------------------------------------------------------------------
 
-const void BTreeIndex::insertEntry(const char*key, const RecordId rid) {
+const void BTreeIndex::insertEntry(const char*key, const RecordId rid, const uint32_t expiresAt) {
+  RecordId existingRid;
+  char sortKey[STRINGSIZE];
+  bool inserted = !insertWithMode(sortKeyFor(key, sortKey), rid, expiresAt,
+                                  unique ? INSERT_IF_ABSENT : INSERT_ANY, existingRid);
+  publishSharedPages();
+  if(traceFile != NULL) { traceEntry(TRACE_INSERT, key, rid, expiresAt, inserted); }
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertUnique
+// -----------------------------------------------------------------------------
+
+bool BTreeIndex::insertUnique(const char* key, const RecordId rid, RecordId& conflictRid,
+                              const uint32_t expiresAt) {
+  char sortKey[STRINGSIZE];
+  bool inserted = !insertWithMode(sortKeyFor(key, sortKey), rid, expiresAt, INSERT_IF_ABSENT, conflictRid);
+  publishSharedPages();
+  if(traceFile != NULL) { traceEntry(TRACE_INSERT_UNIQUE, key, rid, expiresAt, inserted); }
+  return inserted;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::upsert
+// -----------------------------------------------------------------------------
+
+bool BTreeIndex::upsert(const char* key, const RecordId rid, RecordId& oldRid,
+                        const uint32_t expiresAt) {
+  char sortKey[STRINGSIZE];
+  bool replaced = insertWithMode(sortKeyFor(key, sortKey), rid, expiresAt, INSERT_OR_REPLACE, oldRid);
+  publishSharedPages();
+  if(traceFile != NULL) { traceEntry(TRACE_UPSERT, key, rid, expiresAt, replaced); }
+  return replaced;
+}
+
+bool BTreeIndex::insertWithMode(const char* key, const RecordId rid, const uint32_t expiry,
+                                InsertMode mode, RecordId& existingRid) {
+  continueHotSetLoad();
+  existingRid.page_number = Page::INVALID_NUMBER;
+  existingRid.slot_number = Page::INVALID_SLOT;
   if(rootPageNum == Page::INVALID_NUMBER) { //Special case: first insert
     NonLeafNode *rootNode = allocateNonLeafNode(file, rootPageNum);
     rootNode->level = 1;
+    reservePage(rootPageNum, rootNode->level);
     getHeader()->rootPageNo = rootPageNum;
-    bufferManager->unPinPage(file, headerPageNum, true);
+    unPinIndexPage(headerPageNum, true);
     strncpy(rootNode->keyArray[0], key, STRINGSIZE);
     LeafNode *leaf1 = allocateLeafNode(file, rootNode->pageNoArray[0]);
     LeafNode *leaf2 = allocateLeafNode(file, rootNode->pageNoArray[1]);
@@ -129,18 +546,325 @@ const void BTreeIndex::insertEntry(const char*key, const RecordId rid) {
     leaf2->rightSibPageNo = Page::INVALID_NUMBER;
     strncpy(leaf2->keyArray[0], key, STRINGSIZE);
     leaf2->ridArray[0] = rid;
+    leaf2->expiryArray[0] = expiry;
+    rootNode->maxExpiryArray[0] = EMPTY_LEAF_EXPIRY;
+    rootNode->maxExpiryArray[1] = expiry;
     // unpin all pages in use
-    bufferManager->unPinPage(file, rootPageNum, true);
-    bufferManager->unPinPage(file, rootNode->pageNoArray[0], true);
-    bufferManager->unPinPage(file, rootNode->pageNoArray[1], true);
-    return;
+    unPinIndexPage(rootPageNum, true);
+    unPinIndexPage(rootNode->pageNoArray[0], true);
+    unPinIndexPage(rootNode->pageNoArray[1], true);
+    return false;
+  }
+  if(mode != INSERT_ANY) { //a live entry with the key may sit in any leaf of its run
+    PageId pageNum;
+    int slot;
+    LeafNode* leaf = findLiveEntry(key, expiryClock(), pageNum, slot);
+    if(leaf != NULL) {
+      existingRid = leaf->ridArray[slot];
+      if(mode == INSERT_IF_ABSENT) {
+        bufferManager->unPinPage(file, pageNum, false);
+        return true;
+      }
+      //replace: drop the entry and insert the new one, which keeps the
+      //expiry bounds of both leaves right
+      deleteFromLeaf(leaf, slot);
+      unPinIndexPage(pageNum, true);
+    }
   }
   // if insert into filled tree
   RIDKeyPair ridkey; PageKeyPair pagekey;
-  ridkey.set(rid, key);
+  ridkey.set(rid, key, expiry);
   insertInSubtree(ridkey, rootPageNum, pagekey);
+  return existingRid.page_number != Page::INVALID_NUMBER;
 }
       
+// -----------------------------------------------------------------------------
+// BTreeIndex::deleteEntry
+// -----------------------------------------------------------------------------
+
+bool BTreeIndex::deleteEntry(const char* key, const RecordId rid) {
+  continueHotSetLoad();
+  char sortKey[STRINGSIZE];
+  uint32_t expiry;
+  bool removed = removeEntry(sortKeyFor(key, sortKey), rid, expiry);
+  publishSharedPages();
+  if(traceFile != NULL) { traceEntry(TRACE_DELETE, key, rid, NO_EXPIRY, removed); }
+  return removed;
+}
+
+bool BTreeIndex::removeEntry(const char* key, const RecordId rid, uint32_t& expiry) {
+  if(rootPageNum == Page::INVALID_NUMBER) { return false; }
+  PageId pageNum = findLeafPage(key, NULL, true);
+  while(pageNum != Page::INVALID_NUMBER) { //duplicates of the key may run on into right siblings
+    LeafNode* leaf = readLeafNode(file, pageNum);
+    bool compacted = !lazyDeletes && compactLeaf(leaf); //removeFromLeaf shifts entries
+    int numKeys = getLeafLength(leaf);
+    for(int i = 0; i < numKeys; i++) {
+      int cmp = strncmp(leaf->keyArray[i], key, STRINGSIZE);
+      if(cmp > 0) { //past the key without finding the entry
+        unPinIndexPage(pageNum, compacted);
+        return false;
+      }
+      if(cmp == 0 && leaf->ridArray[i].page_number == rid.page_number
+         && leaf->ridArray[i].slot_number == rid.slot_number && !isTombstone(leaf, i)) {
+        expiry = leaf->expiryArray[i];
+        deleteFromLeaf(leaf, i);
+        unPinIndexPage(pageNum, true);
+        return true;
+      }
+    }
+    PageId nextPageNum = leaf->rightSibPageNo;
+    unPinIndexPage(pageNum, compacted);
+    pageNum = nextPageNum;
+  }
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::updateKey
+// -----------------------------------------------------------------------------
+
+bool BTreeIndex::updateKey(const char* oldKey, const char* newKey, const RecordId rid) {
+  bool moved = moveEntry(oldKey, newKey, rid);
+  publishSharedPages();
+  if(traceFile != NULL) { traceUpdateKey(oldKey, newKey, rid, moved); }
+  return moved;
+}
+
+bool BTreeIndex::moveEntry(const char* oldKeyParm, const char* newKeyParm, const RecordId rid) {
+  if(rootPageNum == Page::INVALID_NUMBER) { return false; }
+  char oldSortKey[STRINGSIZE], newSortKey[STRINGSIZE];
+  const char* oldKey = sortKeyFor(oldKeyParm, oldSortKey);
+  const char* newKey = sortKeyFor(newKeyParm, newSortKey);
+  LeafFences fences;
+  PageId pageNum = findLeafPage(oldKey, &fences, true);
+  LeafNode* leaf = readLeafNode(file, pageNum);
+  bool compacted = compactLeaf(leaf); //entries are about to be shifted
+  int numKeys = getLeafLength(leaf);
+  int slot = -1;
+  for(int i = 0; i < numKeys && strncmp(leaf->keyArray[i], oldKey, STRINGSIZE) <= 0; i++) {
+    if(strncmp(leaf->keyArray[i], oldKey, STRINGSIZE) == 0
+       && leaf->ridArray[i].page_number == rid.page_number
+       && leaf->ridArray[i].slot_number == rid.slot_number) {
+      slot = i;
+      break;
+    }
+  }
+  bool sameLeaf = (!fences.hasLow || strncmp(newKey, fences.low, STRINGSIZE) >= 0)
+    && (!fences.hasHigh || strncmp(newKey, fences.high, STRINGSIZE) < 0);
+  if(slot >= 0 && sameLeaf) { //move the entry within the leaf: one descent in total
+    if(unique && strncmp(newKey, oldKey, STRINGSIZE) != 0) { //the new key's run may reach other leaves
+      PageId livePageNum;
+      int liveSlot;
+      if(findLiveEntry(newKey, expiryClock(), livePageNum, liveSlot) != NULL) {
+        bufferManager->unPinPage(file, livePageNum, false);
+        unPinIndexPage(pageNum, compacted);
+        return false;
+      }
+    }
+    RIDKeyPair krid;
+    krid.set(rid, newKey, leaf->expiryArray[slot]); //a moved entry keeps its expiry
+    removeFromLeaf(leaf, slot);
+    insertInRoomyLeaf(leaf, krid);
+    unPinIndexPage(pageNum, true);
+    return true;
+  }
+  if(slot < 0) { //entry is in a later leaf (duplicates run on into right siblings)
+    unPinIndexPage(pageNum, compacted);
+    uint32_t expiry;
+    if(!removeEntry(oldKey, rid, expiry)) { return false; }
+    RecordId existingRid;
+    insertWithMode(newKey, rid, expiry, unique ? INSERT_IF_ABSENT : INSERT_ANY, existingRid);
+    return true;
+  }
+  RecordId existingRid;
+  uint32_t expiry = leaf->expiryArray[slot];
+  if(unique) { //keep the old entry unless the new key can be inserted
+    unPinIndexPage(pageNum, compacted);
+    if(insertWithMode(newKey, rid, expiry, INSERT_IF_ABSENT, existingRid)) { return false; }
+    removeEntry(oldKey, rid, expiry);
+    return true;
+  }
+  //remove under the pin we already hold, then insert with a second descent
+  removeFromLeaf(leaf, slot);
+  unPinIndexPage(pageNum, true);
+  insertWithMode(newKey, rid, expiry, INSERT_ANY, existingRid);
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::collectGarbage
+// -----------------------------------------------------------------------------
+
+int BTreeIndex::collectGarbage() {
+  if(scanExecuting) { closeScan(); }
+  if(rootPageNum == Page::INVALID_NUMBER) { return 0; }
+  int numMerged = collectGarbageInSubtree(rootPageNum);
+  publishSharedPages();
+  return numMerged;
+}
+
+int BTreeIndex::collectGarbageInSubtree(PageId pageNum) {
+  NonLeafNode* node = readNonLeafNode(file, pageNum);
+  int numMerged = 0;
+  if(node->level != 1) {
+    for(int i = 0; i <= getNonLeafLength(node); i++) {
+      numMerged += collectGarbageInSubtree(node->pageNoArray[i]);
+    }
+    bufferManager->unPinPage(file, pageNum, false);
+    return numMerged;
+  }
+  //children are leaves: compact each pair of neighbours and merge the right
+  //one into the left while both fit, then try the merged leaf on the next.
+  //A pair that does not fit fills the left leaf from the right one, so
+  //what is left of the right leaf may fit into its own right neighbour
+  bool dirty = false;
+  int i = 0;
+  do {
+    PageId leftPageNum = node->pageNoArray[i];
+    LeafNode* left = readLeafNode(file, leftPageNum);
+    bool leftDirty = compactLeaf(left);
+    if(i == getNonLeafLength(node)) { //last child, nothing right of it to merge
+      unPinIndexPage(leftPageNum, leftDirty);
+      break;
+    }
+    PageId rightPageNum = node->pageNoArray[i+1];
+    LeafNode* right = readLeafNode(file, rightPageNum);
+    bool rightDirty = compactLeaf(right);
+    int leftLength = getLeafLength(left);
+    int rightLength = getLeafLength(right);
+    //the parent keeps its last separator, so inserts always find one
+    if(getNonLeafLength(node) == 1) {
+      unPinIndexPage(leftPageNum, leftDirty);
+      unPinIndexPage(rightPageNum, rightDirty);
+      break;
+    }
+    if(leftLength + rightLength > LEAF_NUM_KEYS) {
+      int numMoved = LEAF_NUM_KEYS - leftLength;
+      if(numMoved > 0) {
+        for(int j = 0; j < rightLength; j++) {
+          if(j < numMoved) {
+            memcpy(left->keyArray[leftLength + j], right->keyArray[j], STRINGSIZE);
+            left->ridArray[leftLength + j] = right->ridArray[j];
+            left->expiryArray[leftLength + j] = right->expiryArray[j];
+          }
+          else {
+            memcpy(right->keyArray[j - numMoved], right->keyArray[j], STRINGSIZE);
+            right->ridArray[j - numMoved] = right->ridArray[j];
+            right->expiryArray[j - numMoved] = right->expiryArray[j];
+          }
+        }
+        for(int j = rightLength - numMoved; j < rightLength; j++) {
+          memset(right->keyArray[j], 0, STRINGSIZE);
+          right->ridArray[j].page_number = Page::INVALID_NUMBER;
+          right->ridArray[j].slot_number = Page::INVALID_SLOT;
+          right->expiryArray[j] = NO_EXPIRY;
+        }
+        memcpy(node->keyArray[i], right->keyArray[0], STRINGSIZE);
+        node->maxExpiryArray[i] = leafExpiryBound(left);
+        node->maxExpiryArray[i+1] = leafExpiryBound(right);
+        leftDirty = rightDirty = dirty = true;
+      }
+      unPinIndexPage(leftPageNum, leftDirty);
+      unPinIndexPage(rightPageNum, rightDirty);
+      i++;
+      continue;
+    }
+    for(int j = 0; j < rightLength; j++) {
+      memcpy(left->keyArray[leftLength + j], right->keyArray[j], STRINGSIZE);
+      left->ridArray[leftLength + j] = right->ridArray[j];
+      left->expiryArray[leftLength + j] = right->expiryArray[j];
+    }
+    left->rightSibPageNo = right->rightSibPageNo;
+    //drop the separator and the pointer to the right leaf from the parent
+    node->maxExpiryArray[i] = combineExpiry(node->maxExpiryArray[i], node->maxExpiryArray[i+1]);
+    removeChild(node, i+1);
+    unPinIndexPage(leftPageNum, true);
+    bufferManager->unPinPage(file, rightPageNum, false);
+    dropPage(rightPageNum);
+    numMerged++;
+    dirty = true;
+  } while(i <= getNonLeafLength(node));
+  unPinIndexPage(pageNum, dirty);
+  return numMerged;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::sweepExpired
+// -----------------------------------------------------------------------------
+
+int BTreeIndex::sweepExpired() {
+  if(rootPageNum == Page::INVALID_NUMBER) { return 0; }
+  if(scanExecuting) { closeScan(); } //the scan may hold a leaf about to be dropped
+  PageId lastLeaf = Page::INVALID_NUMBER;
+  int numSwept = sweepSubtree(rootPageNum, expiryClock(), lastLeaf);
+  publishSharedPages();
+  return numSwept;
+}
+
+int BTreeIndex::sweepSubtree(PageId pageNum, const uint32_t now, PageId& lastLeaf) {
+  NonLeafNode* node = readNonLeafNode(file, pageNum);
+  int numSwept = 0;
+  if(node->level != 1) {
+    for(int i = 0; i <= getNonLeafLength(node); i++) {
+      numSwept += sweepSubtree(node->pageNoArray[i], now, lastLeaf);
+    }
+    bufferManager->unPinPage(file, pageNum, false);
+    return numSwept;
+  }
+  //children are leaves: drop each one whose every entry has expired, judged
+  //by the bound alone; lastLeaf is the kept leaf left of it in the chain
+  bool dirty = false;
+  int i = 0;
+  while(i <= getNonLeafLength(node)) {
+    uint32_t bound = node->maxExpiryArray[i];
+    PageId childPageNum = node->pageNoArray[i];
+    if(bound == NO_EXPIRY || bound > now) {
+      lastLeaf = childPageNum;
+      i++;
+      continue;
+    }
+    LeafNode* leaf = readLeafNode(file, childPageNum);
+    if(getLeafLength(leaf) == 0 && getNonLeafLength(node) == 0) {
+      bufferManager->unPinPage(file, childPageNum, false); //already the only, empty leaf
+      lastLeaf = childPageNum;
+      i++;
+      continue;
+    }
+    if(getNonLeafLength(node) == 0) { //a non-leaf keeps at least one child: empty it instead
+      for(int j = 0; j < getLeafLength(leaf); j++) {
+        memset(leaf->keyArray[j], 0, STRINGSIZE);
+        leaf->ridArray[j].page_number = Page::INVALID_NUMBER;
+        leaf->ridArray[j].slot_number = Page::INVALID_SLOT;
+        leaf->expiryArray[j] = NO_EXPIRY;
+      }
+      leaf->numTombstones = 0;
+      memset(leaf->tombstones, 0, sizeof(leaf->tombstones));
+      node->maxExpiryArray[i] = EMPTY_LEAF_EXPIRY;
+      unPinIndexPage(childPageNum, true);
+      lastLeaf = childPageNum;
+      dirty = true;
+      numSwept++;
+      i++;
+      continue;
+    }
+    //unlink the leaf from the chain and from the parent
+    PageId rightSibPageNo = leaf->rightSibPageNo;
+    bufferManager->unPinPage(file, childPageNum, false);
+    if(lastLeaf != Page::INVALID_NUMBER) {
+      LeafNode* prev = readLeafNode(file, lastLeaf);
+      prev->rightSibPageNo = rightSibPageNo;
+      unPinIndexPage(lastLeaf, true);
+    }
+    removeChild(node, i);
+    dropPage(childPageNum);
+    dirty = true;
+    numSwept++;
+  }
+  unPinIndexPage(pageNum, dirty);
+  return numSwept;
+}
+
 // -----------------------------------------------------------------------------
 // BTreeIndex::startScan
 // -----------------------------------------------------------------------------
@@ -149,72 +873,924 @@ const void BTreeIndex::startScan(const char* lowValParm,
 				   const Operator lowOpParm,
 				   const char* highValParm,
 				   const Operator highOpParm){
+  throwScanStatus(tryStartScan(lowValParm, lowOpParm, highValParm, highOpParm));
+}
+
+const void BTreeIndex::startScan(const char* lowValParm,
+                                 const Operator lowOpParm,
+                                 const char* highValParm,
+                                 const Operator highOpParm,
+                                 const KeyPredicate& predicate){
+  throwScanStatus(tryStartScan(lowValParm, lowOpParm, highValParm, highOpParm, predicate));
+}
+
+ScanStatus BTreeIndex::tryStartScan(const char* lowValParm,
+                                    const Operator lowOpParm,
+                                    const char* highValParm,
+                                    const Operator highOpParm){
+  ScanStatus status = startScanUntraced(lowValParm, lowOpParm, highValParm, highOpParm, NULL);
+  if(traceFile != NULL) {
+    traceKeys(TRACE_START_SCAN, lowOpParm, highOpParm, status, lowValParm, highValParm);
+  }
+  return status;
+}
+
+ScanStatus BTreeIndex::tryStartScan(const char* lowValParm,
+                                    const Operator lowOpParm,
+                                    const char* highValParm,
+                                    const Operator highOpParm,
+                                    const KeyPredicate& predicate){
+  ScanStatus status = startScanUntraced(lowValParm, lowOpParm, highValParm, highOpParm, &predicate);
+  if(traceFile != NULL) { traceFilterScan(lowValParm, lowOpParm, highValParm, highOpParm, predicate, status); }
+  return status;
+}
+
+ScanStatus BTreeIndex::startScanUntraced(const char* lowValParm,
+                                         const Operator lowOpParm,
+                                         const char* highValParm,
+                                         const Operator highOpParm,
+                                         const KeyPredicate* predicate){
   //Check if another scan is already executing
-  if(scanExecuting) { endScan(); }
+  if(scanExecuting) { closeScan(); }
+  scanStartTime = BTREE_PROBE_START(scan__end); //also for scans served from the range cache
+  recordingScan = false;
+  filterScan = false;
+  continueHotSetLoad();
+  //Scan bounds are compared as sort keys
+  lowValParm = sortKeyFor(lowValParm, lowSortKey);
+  highValParm = sortKeyFor(highValParm, highSortKey);
   //Check for bad input
   if(strncmp(lowValParm, highValParm, STRINGSIZE) > 0) {
-    throw BadScanrangeException();
+    return SCAN_BAD_RANGE;
   }
   if(lowOpParm != GT && lowOpParm != GTE) {
-    throw BadOpcodesException();
+    return SCAN_BAD_OPCODES;
   }
   if(highOpParm != LT && highOpParm != LTE) {
-    throw BadOpcodesException();
+    return SCAN_BAD_OPCODES;
+  }
+  if(predicate != NULL) {
+    if(collation == LOCALE || collation == INTEGER) { return SCAN_BAD_OPCODES; } //no key bytes in place
+    scanPredicate = *predicate;
+    if(collation == NOCASE) { //fold the pattern as makeSortKey() folds keys
+      for(int i = 0; i < STRINGSIZE; i++) {
+        char c = scanPredicate.pattern[i];
+        if(c >= 'A' && c <= 'Z') { scanPredicate.pattern[i] = c - 'A' + 'a'; }
+      }
+    }
+    if(scanPredicate.kind == KEY_MASK) {
+      for(int i = 0; i < STRINGSIZE; i++) { scanPredicate.pattern[i] &= scanPredicate.mask[i]; }
+    }
+    filterScan = true;
+  }
+  if(rootPageNum == Page::INVALID_NUMBER) { return SCAN_NO_SUCH_KEY; }
+  if(rangeCacheLimit > 0 && !filterScan) { //the cache keeps unfiltered results only
+    std::string key = rangeCacheKey(lowValParm, lowOpParm, highValParm, highOpParm);
+    cachedScan = findCachedRange(key);
+    if(cachedScan != NULL) { //served without reading a page
+      rangeCacheHits++;
+      if(cachedScan->rids.empty()) {
+        cachedScan = NULL;
+        return SCAN_NO_SUCH_KEY;
+      }
+      scanExecuting = true;
+      prefixScan = false;
+      cachedScanNext = 0;
+      return SCAN_OK;
+    }
+    rangeCacheMisses++;
+    recordingScan = true;
+    recordingKey = key;
+    recording.rids.clear();
+    recording.pages.clear();
+    recording.validUntil = NO_EXPIRY;
   }
   //Initialize scan data members
   scanExecuting = true;
+  prefixScan = false;
   nextEntry = 0;
   lowVal = lowValParm;
   highVal = highValParm;
   lowOp = lowOpParm;
   highOp = highOpParm;
-  findInSubtree(rootPageNum); // will set currentPageNum and currentPageData
+  scanTime = expiryClock();
+  ScanStatus status = positionScan();
+  if(status == SCAN_NO_SUCH_KEY && recordingScan) { storeRecordedRange(); } //empty results are cached too
+  return status;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::startPrefixScan
+// -----------------------------------------------------------------------------
+
+const void BTreeIndex::startPrefixScan(const char* prefix, const int len) {
+  throwScanStatus(tryStartPrefixScan(prefix, len));
+}
+
+ScanStatus BTreeIndex::tryStartPrefixScan(const char* prefix, const int len) {
+  ScanStatus status = startPrefixScanUntraced(prefix, len);
+  if(traceFile != NULL) {
+    traceKeys(TRACE_START_PREFIX_SCAN, std::max(0, std::min(len, STRINGSIZE)), 0, status, prefix, NULL);
+  }
+  return status;
+}
+
+ScanStatus BTreeIndex::startPrefixScanUntraced(const char* prefix, const int len) {
+  //Check if another scan is already executing
+  if(scanExecuting) { closeScan(); }
+  scanStartTime = BTREE_PROBE_START(scan__end);
+  recordingScan = false;
+  filterScan = false;
+  continueHotSetLoad();
+  if(collation == LOCALE || collation == INTEGER) { return SCAN_BAD_OPCODES; } //sort keys keep no prefixes
+  if(rootPageNum == Page::INVALID_NUMBER) { return SCAN_NO_SUCH_KEY; }
+  //Initialize scan data members; the zero padded prefix sorts before every
+  //key that starts with it, so a GTE descent lands on the first match
+  scanExecuting = true;
+  prefixScan = true;
+  prefixLen = std::max(0, std::min(len, STRINGSIZE));
+  char paddedPrefix[STRINGSIZE];
+  memset(paddedPrefix, 0, STRINGSIZE);
+  strncpy(paddedPrefix, prefix, prefixLen);
+  makeSortKey(collation, paddedPrefix, prefixVal);
+  nextEntry = 0;
+  lowVal = prefixVal;
+  highVal = prefixVal;
+  lowOp = GTE;
+  highOp = LTE;
+  scanTime = expiryClock();
+  return positionScan();
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::scanNext
+// -----------------------------------------------------------------------------
+
+const void BTreeIndex::scanNext(RecordId& outRid) {
+  throwScanStatus(tryScanNext(outRid));
+}
+
+ScanStatus BTreeIndex::tryScanNext(RecordId& outRid) {
+  ScanStatus status = scanNextUntraced(outRid);
+  if(traceFile != NULL) { traceOp(TRACE_SCAN_NEXT, 0, 0, status, NULL, 0); }
+  return status;
+}
+
+ScanStatus BTreeIndex::scanNextUntraced(RecordId& outRid) {
+  if(!scanExecuting) { return SCAN_NOT_INITIALIZED; }
+  if(cachedScan != NULL) {
+    if(cachedScanNext < cachedScan->rids.size()) {
+      outRid = cachedScan->rids[cachedScanNext++];
+      return SCAN_OK;
+    }
+    closeScan();
+    return SCAN_COMPLETED;
+  }
+  skipDeadEntries();
+  LeafNode *currNode = (LeafNode*) currentPageData;
+  int nextPageNo, numKeys;
+  // check if scan is at end
+  if(currentPageNum != Page::INVALID_NUMBER && matchRange(currNode->keyArray[nextEntry])) {
+    numKeys = getLeafLength(currNode);    
+    outRid = currNode->ridArray[nextEntry];
+    if(recordingScan) {
+      recording.rids.push_back(outRid);
+      uint32_t expiry = currNode->expiryArray[nextEntry];
+      if(expiry != NO_EXPIRY && (recording.validUntil == NO_EXPIRY || expiry < recording.validUntil)) {
+        recording.validUntil = expiry;
+      }
+      if(recording.rids.size() > (size_t) RANGE_CACHE_MAX_RIDS) { recordingScan = false; }
+    }
+  }
+  else {
+    if(recordingScan) { storeRecordedRange(); }
+    closeScan();
+    return SCAN_COMPLETED;
+  }
+  // check if at the end of a leaf
+  if(nextEntry == numKeys-1) {
+    nextEntry = 0;
+    nextPageNo = currNode->rightSibPageNo;
+    bufferManager->unPinPage(file, currentPageNum, false);
+    currentPageNum = nextPageNo;
+    currentPageData = NULL;
+    while(currentPageNum != Page::INVALID_NUMBER) { //skip leaves emptied by deletes
+      readIndexPage(currentPageNum, currentPageData);
+      if(getLeafLength((LeafNode*) currentPageData) > 0) { break; }
+      nextPageNo = ((LeafNode*) currentPageData)->rightSibPageNo;
+      bufferManager->unPinPage(file, currentPageNum, false);
+      currentPageNum = nextPageNo;
+      currentPageData = NULL;
+    }
+  }
+  else { nextEntry++; }
+  return SCAN_OK;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::endScan
+// -----------------------------------------------------------------------------
+
+const void BTreeIndex::endScan() {
+  if(!scanExecuting) {
+    if(traceFile != NULL) { traceOp(TRACE_END_SCAN, 0, 0, 1, NULL, 0); }
+    throw ScanNotInitializedException();
+  }
+  recordingScan = false; //ended early: the result is incomplete
+  closeScan();
+  if(traceFile != NULL) { traceOp(TRACE_END_SCAN, 0, 0, 0, NULL, 0); }
+}
+
+void BTreeIndex::closeScan() {
+  scanExecuting = false;
+  cachedScan = NULL;
+  BTREE_PROBE1(scan__end, BTREE_PROBE_ELAPSED(scanStartTime));
+  if(currentPageNum != Page::INVALID_NUMBER) {
+    bufferManager->unPinPage(file, currentPageNum, false);
+    currentPageNum = Page::INVALID_NUMBER;
+    currentPageData = NULL;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::aggregateScan
+// -----------------------------------------------------------------------------
+
+KeyAggregate BTreeIndex::aggregateScan(const int lowValParm, const Operator lowOpParm,
+                                       const int highValParm, const Operator highOpParm) {
+  if(collation != INTEGER) { throw BadOpcodesException(); }
+  if((lowOpParm != GT && lowOpParm != GTE) || (highOpParm != LT && highOpParm != LTE)) {
+    throw BadOpcodesException();
+  }
+  if(lowValParm > highValParm) { throw BadScanrangeException(); }
+  continueHotSetLoad();
+  KeyAggregate aggregate = { 0, 0, 0, 0 };
+  if(rootPageNum == Page::INVALID_NUMBER) {
+    if(traceFile != NULL) { traceAggregate(lowValParm, lowOpParm, highValParm, highOpParm, 0); }
+    return aggregate;
+  }
+  uint64_t start = BTREE_PROBE_START(aggregate__scan);
+  char low[STRINGSIZE], high[STRINGSIZE];
+  makeSortKey(collation, (const char*) &lowValParm, low);
+  makeSortKey(collation, (const char*) &highValParm, high);
+  //descend to the first leaf that may hold the low bound; GTE goes left of
+  //a separator equal to it, where duplicates of it may sit
+  PageId pageNum = rootPageNum;
+  int level;
+  do {
+    NonLeafNode* node = readNonLeafNode(file, pageNum);
+    int numKeys = getNonLeafLength(node);
+    int i = 0;
+    while(i < numKeys && (lowOpParm == GT ? strncmp(node->keyArray[i], low, STRINGSIZE) <= 0
+                                          : strncmp(node->keyArray[i], low, STRINGSIZE) < 0)) {
+      i++;
+    }
+    PageId childPageNum = node->pageNoArray[i];
+    level = node->level;
+    bufferManager->unPinPage(file, pageNum, false);
+    pageNum = childPageNum;
+  } while(level != 1);
+  uint32_t now = expiryClock();
+  while(pageNum != Page::INVALID_NUMBER) { //fold in the leaves' runs until one ends in the range
+    LeafNode* leaf = readLeafNode(file, pageNum);
+    int numKeys = getLeafLength(leaf);
+    int from = 0;
+    while(from < numKeys && (lowOpParm == GT ? strncmp(leaf->keyArray[from], low, STRINGSIZE) <= 0
+                                             : strncmp(leaf->keyArray[from], low, STRINGSIZE) < 0)) {
+      from++;
+    }
+    int to = from;
+    while(to < numKeys && keyInRange(leaf->keyArray[to], low, lowOpParm, high, highOpParm)) { to++; }
+    aggregateLeafRun(leaf, from, to, now, aggregate);
+    PageId nextPageNum = to < numKeys ? Page::INVALID_NUMBER : leaf->rightSibPageNo;
+    bufferManager->unPinPage(file, pageNum, false);
+    pageNum = nextPageNum;
+  }
+  BTREE_PROBE2(aggregate__scan, aggregate.count, BTREE_PROBE_ELAPSED(start));
+  if(traceFile != NULL) { traceAggregate(lowValParm, lowOpParm, highValParm, highOpParm, aggregate.count); }
+  return aggregate;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::lookup
+// -----------------------------------------------------------------------------
+
+bool BTreeIndex::lookup(const char* keyParm, RecordId& outRid) {
+  continueHotSetLoad();
+  if(rootPageNum == Page::INVALID_NUMBER) {
+    if(traceFile != NULL) { traceKeys(TRACE_LOOKUP, 0, 0, false, keyParm, NULL); }
+    return false;
+  }
+  uint64_t start = BTREE_PROBE_START(lookup__end);
+  char sortKey[STRINGSIZE];
+  const char* key = sortKeyFor(keyParm, sortKey);
+  BTREE_PROBE1(lookup__begin, key);
+  PageId pageNum;
+  int slot;
+  LeafNode* leaf = findLiveEntry(key, expiryClock(), pageNum, slot);
+  if(leaf != NULL) {
+    outRid = leaf->ridArray[slot];
+    bufferManager->unPinPage(file, pageNum, false);
+  }
+  BTREE_PROBE3(lookup__end, pageNum, slot >= 0, BTREE_PROBE_ELAPSED(start));
+  if(traceFile != NULL) { traceKeys(TRACE_LOOKUP, 0, 0, slot >= 0, keyParm, NULL); }
+  return slot >= 0;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::lookupBatch
+// -----------------------------------------------------------------------------
+
+/**
+ * State of one in-flight lookup of BTreeIndex::lookupBatch(): the key it
+ * is for and the pinned node it will examine on its next step.
+ */
+struct LookupProbe {
+  int keyIndex;
+  const char* key;
+  char sortKey[STRINGSIZE];
+  PageId pageNum;
+  Page* page;
+  bool atLeaf;
+  bool runsOn; //the run of keys equal to key may go on past the leaf
+};
+
+static inline void prefetchNode(const Page* page) {
+  for(int i = 0; i < LOOKUP_PREFETCH_BYTES; i += 64) {
+    __builtin_prefetch((const char*) page + i);
+  }
+}
+
+void BTreeIndex::lookupBatch(const char* const* keys, const int numKeys,
+                             RecordId* outRids, bool* found) {
+  continueHotSetLoad();
+  if(rootPageNum == Page::INVALID_NUMBER) {
+    for(int i = 0; i < numKeys; i++) { found[i] = false; }
+    if(traceFile != NULL) { traceLookupBatch(keys, numKeys, found); }
+    return;
+  }
+  uint64_t start = BTREE_PROBE_START(lookup__batch);
+  LookupProbe probes[LOOKUP_BATCH_WIDTH];
+  int nextKey = 0, numActive = 0;
+  const uint32_t now = expiryClock();
+  for(int p = 0; p < LOOKUP_BATCH_WIDTH; p++) { //start the first probes at the root
+    probes[p].keyIndex = -1;
+    if(nextKey < numKeys) {
+      probes[p].keyIndex = nextKey++;
+      probes[p].key = sortKeyFor(keys[probes[p].keyIndex], probes[p].sortKey);
+      probes[p].pageNum = rootPageNum;
+      probes[p].atLeaf = false;
+      probes[p].runsOn = false;
+      readIndexPage(rootPageNum, probes[p].page);
+      numActive++;
+    }
+  }
+  //round-robin: each probe does one node step, prefetches its next node and yields
+  while(numActive > 0) {
+    for(int p = 0; p < LOOKUP_BATCH_WIDTH; p++) {
+      LookupProbe& probe = probes[p];
+      if(probe.keyIndex < 0) { continue; }
+      const char* key = probe.key;
+      if(!probe.atLeaf) { //route through a non-leaf and move to the child
+        NonLeafNode* node = (NonLeafNode*) probe.page;
+        int i = findChildIndex(node, key);
+        //duplicates of a key equal to a separator may also sit left of it
+        while(i > 0 && strncmp(node->keyArray[i-1], key, STRINGSIZE) == 0) { i--; }
+        if(i < getNonLeafLength(node)) { probe.runsOn = strncmp(node->keyArray[i], key, STRINGSIZE) == 0; }
+        PageId childPageNum = node->pageNoArray[i];
+        probe.atLeaf = (node->level == 1);
+        bufferManager->unPinPage(file, probe.pageNum, false);
+        probe.pageNum = childPageNum;
+        readIndexPage(probe.pageNum, probe.page);
+        prefetchNode(probe.page);
+        continue;
+      }
+      //at the leaf: finish this lookup and reuse the slot for the next key
+      LeafNode* leaf = (LeafNode*) probe.page;
+      int slot = findKeyInLeaf(leaf, key, now);
+      if(slot < 0 && (probe.runsOn || leafEndsInKey(leaf, key))
+         && leaf->rightSibPageNo != Page::INVALID_NUMBER) { //look on in the right sibling
+        PageId nextPageNum = leaf->rightSibPageNo;
+        bufferManager->unPinPage(file, probe.pageNum, false);
+        probe.pageNum = nextPageNum;
+        probe.runsOn = false;
+        readIndexPage(probe.pageNum, probe.page);
+        prefetchNode(probe.page);
+        continue;
+      }
+      found[probe.keyIndex] = slot >= 0;
+      if(slot >= 0) { outRids[probe.keyIndex] = leaf->ridArray[slot]; }
+      bufferManager->unPinPage(file, probe.pageNum, false);
+      if(nextKey < numKeys) {
+        probe.keyIndex = nextKey++;
+        probe.key = sortKeyFor(keys[probe.keyIndex], probe.sortKey);
+        probe.pageNum = rootPageNum;
+        probe.atLeaf = false;
+        probe.runsOn = false;
+        readIndexPage(rootPageNum, probe.page);
+      }
+      else {
+        probe.keyIndex = -1;
+        numActive--;
+      }
+    }
+  }
+  BTREE_PROBE2(lookup__batch, numKeys, BTREE_PROBE_ELAPSED(start));
+  if(traceFile != NULL) { traceLookupBatch(keys, numKeys, found); }
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::sampleEntries
+// -----------------------------------------------------------------------------
+
+int BTreeIndex::sampleEntries(const int k, std::vector<RIDKeyPair>& samples) {
+  if(rootPageNum == Page::INVALID_NUMBER) { return 0; } //nothing to sample
+  RIDKeyPair sample;
+  // bound the retries so a (nearly) empty tree cannot loop forever
+  long attempts = 0, maxAttempts = (long) k * MAX_SAMPLE_ATTEMPTS;
+  int found = 0;
+  while(found < k && attempts < maxAttempts) {
+    attempts++;
+    if(sampleInSubtree(rootPageNum, sample, true)) {
+      samples.push_back(sample);
+      found++;
+    }
+  }
+  return found;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::exportSorted
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::exportSorted(const std::string & runFileName) {
+  FILE* run = fopen(runFileName.c_str(), "wb");
+  if(run == NULL) {
+    throw FileNotFoundException(runFileName);
+  }
+  RunFileHeader runHeader;
+  memset(&runHeader, 0, sizeof(RunFileHeader));
+  strncpy(runHeader.magic, RUN_FILE_MAGIC, sizeof(runHeader.magic));
+  runHeader.version = RUN_FILE_VERSION;
+  IndexMetaInfo* header = getHeader();
+  strncpy(runHeader.relationName, header->relationName, 20);
+  bufferManager->unPinPage(file, headerPageNum, false);
+  runHeader.attrByteOffset = attrByteOffset;
+  runHeader.keySize = STRINGSIZE;
+  runHeader.unique = unique;
+  runHeader.collation = collation;
+  runHeader.numRecords = 0; //rewritten with the count once the records are out
+  unsigned char headerBytes[RUN_HEADER_BYTES];
+  encodeRunHeader(runHeader, headerBytes);
+  bool written = fwrite(headerBytes, RUN_HEADER_BYTES, 1, run) == 1;
+
+  //Walk the leaf chain, writing pairs out a chunk at a time
+  std::vector<unsigned char> chunk((size_t) RUN_CHUNK_ENTRIES * RUN_RECORD_BYTES);
+  size_t chunkBytes = 0;
+  LeafCursor cursor;
+  RIDKeyPair krid;
+  for(openLeafCursor(cursor); written && cursor.pageNum != Page::INVALID_NUMBER; advanceLeafCursor(cursor)) {
+    krid.set(cursor.leaf->ridArray[cursor.slot], cursor.leaf->keyArray[cursor.slot],
+             cursor.leaf->expiryArray[cursor.slot]);
+    encodeRunRecord(krid, &chunk[chunkBytes]);
+    chunkBytes += RUN_RECORD_BYTES;
+    runHeader.numRecords++;
+    if(chunkBytes == chunk.size()) {
+      written = fwrite(&chunk[0], 1, chunkBytes, run) == chunkBytes;
+      chunkBytes = 0;
+    }
+  }
+  if(cursor.pageNum != Page::INVALID_NUMBER) { //stopped early on a failed write
+    bufferManager->unPinPage(file, cursor.pageNum, false);
+  }
+  if(written && chunkBytes > 0) {
+    written = fwrite(&chunk[0], 1, chunkBytes, run) == chunkBytes;
+  }
+  if(written) {
+    encodeRunHeader(runHeader, headerBytes);
+    written = fseek(run, 0, SEEK_SET) == 0 && fwrite(headerBytes, RUN_HEADER_BYTES, 1, run) == 1;
+  }
+  written = fclose(run) == 0 && written;
+  if(!written) {
+    throw BadIndexInfoException("Cannot write sorted run " + runFileName);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::startTrace
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::startTrace(const std::string & traceFileName) {
+  stopTrace();
+  traceFile = fopen(traceFileName.c_str(), "wb");
+  if(traceFile == NULL) {
+    throw FileNotFoundException(traceFileName);
+  }
+  TraceHeader traceHeader;
+  memset(&traceHeader, 0, sizeof(TraceHeader));
+  strncpy(traceHeader.magic, TRACE_FILE_MAGIC, sizeof(traceHeader.magic));
+  IndexMetaInfo* header = getHeader();
+  strncpy(traceHeader.relationName, header->relationName, 20);
+  bufferManager->unPinPage(file, headerPageNum, false);
+  traceHeader.attrByteOffset = attrByteOffset;
+  traceHeader.unique = unique;
+  traceHeader.collation = collation;
+  traceHeader.lazyDeletes = lazyDeletes;
+  fwrite(&traceHeader, sizeof(TraceHeader), 1, traceFile);
+  lastTraceMicros = traceClock();
+  traceStartExpiry = expiryClock();
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::stopTrace
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::stopTrace() {
+  if(traceFile == NULL) { return; }
+  fclose(traceFile);
+  traceFile = NULL;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::shareIndex
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::shareIndex(const std::string & segmentName, const PageId maxPages) {
+  if(sharedSegment != NULL) { throw BadIndexInfoException("Index is already shared"); }
+  size_t size = sharedSegmentSize(maxPages);
+  int fd = shm_open(segmentName.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+  if(fd < 0 || ftruncate(fd, size) != 0) {
+    if(fd >= 0) { close(fd); shm_unlink(segmentName.c_str()); }
+    throw BadIndexInfoException("Cannot create shared segment " + segmentName);
+  }
+  void* segment = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(segment == MAP_FAILED) {
+    shm_unlink(segmentName.c_str());
+    throw BadIndexInfoException("Cannot map shared segment " + segmentName);
+  }
+  sharedSegment = (SharedIndexHeader*) segment;
+  sharedSegmentName = segmentName;
+  memcpy(sharedSegment->magic, SHARED_INDEX_MAGIC, sizeof(SHARED_INDEX_MAGIC));
+  sharedSegment->maxPages = maxPages;
+  sharedSegment->headerPageNum = headerPageNum;
+  sharedSegment->collation = collation;
+  sharedSegment->invalid = 0;
+  //first copy: the meta page and every node of the tree
+  sharedDirtyPages.push_back(headerPageNum);
+  if(rootPageNum != Page::INVALID_NUMBER) { collectPages(rootPageNum, sharedDirtyPages); }
+  if(*std::max_element(sharedDirtyPages.begin(), sharedDirtyPages.end()) >= maxPages) {
+    sharedDirtyPages.clear();
+    munmap(sharedSegment, size);
+    shm_unlink(segmentName.c_str());
+    sharedSegment = NULL;
+    throw BadIndexInfoException("Index does not fit in shared segment " + segmentName);
+  }
+  publishSharedPages();
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::isShared
+// -----------------------------------------------------------------------------
+
+bool BTreeIndex::isShared() const {
+  return sharedSegment != NULL && !sharedSegment->invalid;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::warmUp
+// -----------------------------------------------------------------------------
+
+int BTreeIndex::warmUp(const bool internalLevels, const int numLeaves,
+                       const std::vector<PageId>& extraPages) {
+  int numRead = 0;
+  std::vector<PageId> leaves; //in key order
+  if(rootPageNum != Page::INVALID_NUMBER && internalLevels) {
+    std::vector<PageId> level(1, rootPageNum); //one level of non-leaves, in key order
+    while(!level.empty()) {
+      //read the level in page number order, but keep its children in key order
+      std::vector<std::pair<PageId, size_t> > byPage(level.size());
+      std::vector<PageId> pages(level);
+      for(size_t i = 0; i < level.size(); i++) { byPage[i] = std::make_pair(level[i], i); }
+      std::sort(byPage.begin(), byPage.end());
+      std::sort(pages.begin(), pages.end());
+      readAhead(pages);
+      std::vector<std::vector<PageId> > children(level.size());
+      bool aboveLeaves = false;
+      for(size_t i = 0; i < byPage.size(); i++) {
+        PageId pageNum = byPage[i].first;
+        NonLeafNode* node = readNonLeafNode(file, pageNum);
+        numRead++;
+        int numKeys = getNonLeafLength(node);
+        children[byPage[i].second].assign(node->pageNoArray, node->pageNoArray + numKeys + 1);
+        aboveLeaves = node->level == 1;
+        bufferManager->unPinPage(file, pageNum, false);
+      }
+      std::vector<PageId>& next = aboveLeaves ? leaves : level;
+      next.clear();
+      for(size_t i = 0; i < children.size(); i++) {
+        next.insert(next.end(), children[i].begin(), children[i].end());
+      }
+      if(aboveLeaves) { break; }
+    }
+  }
+  if(rootPageNum != Page::INVALID_NUMBER && numLeaves > 0) {
+    if(internalLevels) {
+      leaves.resize(std::min(leaves.size(), (size_t) numLeaves));
+      numRead += loadPages(leaves);
+    }
+    else { //without the level above the leaves, follow the leaf chain
+      PageId pageNum = findLeftmostLeaf();
+      for(int i = 0; i < numLeaves && pageNum != Page::INVALID_NUMBER; i++) {
+        LeafNode* leaf = readLeafNode(file, pageNum);
+        numRead++;
+        PageId nextPageNum = leaf->rightSibPageNo;
+        bufferManager->unPinPage(file, pageNum, false);
+        pageNum = nextPageNum;
+      }
+    }
+  }
+  std::vector<PageId> pages(extraPages);
+  pages.erase(std::remove(pages.begin(), pages.end(), (PageId) Page::INVALID_NUMBER), pages.end());
+  numRead += loadPages(pages);
+  return numRead;
+}
+
+int BTreeIndex::loadPages(std::vector<PageId>& pages) {
+  std::sort(pages.begin(), pages.end());
+  pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+  readAhead(pages);
+  for(size_t i = 0; i < pages.size(); i++) {
+    Page* page;
+    readIndexPage(pages[i], page);
+    bufferManager->unPinPage(file, pages[i], false);
+  }
+  return pages.size();
+}
+
+void BTreeIndex::readAhead(const std::vector<PageId>& pages) {
+  if(pages.empty()) { return; }
+  int fd = open(file->filename().c_str(), O_RDONLY);
+  if(fd < 0) { return; }
+  //pages sit in page number order after a file header smaller than a page,
+  //so page p lies within bytes [(p-1) * SIZE, (p+1) * SIZE)
+  size_t first = 0;
+  for(size_t i = 1; i <= pages.size(); i++) {
+    if(i < pages.size() && pages[i] <= pages[i-1] + 1) { continue; }
+    off_t start = (off_t) (pages[first] - 1) * Page::SIZE;
+    off_t length = (off_t) (pages[i-1] - pages[first] + 2) * Page::SIZE;
+    posix_fadvise(fd, start, length, POSIX_FADV_WILLNEED);
+    first = i;
+  }
+  close(fd);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::reserveInternalLevels
+// -----------------------------------------------------------------------------
+
+int BTreeIndex::reserveInternalLevels(const int maxFrames) {
+  releaseReservedPages();
+  reservedFrameLimit = std::max(0, maxFrames);
+  if(rootPageNum == Page::INVALID_NUMBER) { return 0; }
+  std::vector<PageId> level(1, rootPageNum);
+  for(size_t next = 0; next < level.size() && (int) reservedPages.size() < reservedFrameLimit; next++) {
+    Page* page;
+    bufferManager->readPage(file, level[next], page); //stays pinned
+    touchPage(level[next]);
+    NonLeafNode* node = (NonLeafNode*) page;
+    reservedPages.push_back(std::make_pair(node->level, level[next]));
+    if(node->level > 1) {
+      level.insert(level.end(), node->pageNoArray, node->pageNoArray + getNonLeafLength(node) + 1);
+    }
+  }
+  return reservedPages.size();
+}
+
+void BTreeIndex::reservePage(const PageId pageNum, const int level) {
+  if(reservedFrameLimit == 0) { return; }
+  size_t slot = reservedPages.size();
+  if((int) reservedPages.size() >= reservedFrameLimit) { //replace the lowest pinned page, if lower
+    slot = std::min_element(reservedPages.begin(), reservedPages.end()) - reservedPages.begin();
+    if(reservedPages[slot].first >= level) { return; }
+    bufferManager->unPinPage(file, reservedPages[slot].second, false);
+  }
+  else { reservedPages.push_back(std::make_pair(level, pageNum)); }
+  Page* page;
+  bufferManager->readPage(file, pageNum, page);
+  reservedPages[slot] = std::make_pair(level, pageNum);
+}
+
+void BTreeIndex::releaseReservedPages() {
+  for(size_t i = 0; i < reservedPages.size(); i++) {
+    bufferManager->unPinPage(file, reservedPages[i].second, false);
+  }
+  reservedPages.clear();
+}
+
+void BTreeIndex::touchPage(const PageId pageNum) {
+  if(pageNum >= touchedPages.size()) { touchedPages.resize(pageNum + 1, false); }
+  if(!touchedPages[pageNum]) {
+    touchedPages[pageNum] = true;
+    numTouchedPages++;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::setRangeCache
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::setRangeCache(const int maxRids) {
+  if(cachedScan != NULL) { closeScan(); } //its result may be dropped below
+  rangeCacheLimit = std::max(0, maxRids);
+  while(rangeCacheRids > rangeCacheLimit) { dropCachedRange(rangeCache.find(rangeCacheLru.back())); }
+  if(rangeCacheLimit == 0) {
+    recordingScan = false;
+    std::vector<uint32_t>().swap(pageVersions);
+    rangeCacheHits = rangeCacheMisses = 0;
+  }
+}
+
+std::string BTreeIndex::rangeCacheKey(const char* lowVal, const Operator lowOp,
+                                      const char* highVal, const Operator highOp) {
+  //bounds are compared up to STRINGSIZE bytes or a NUL, so pad them with NULs
+  char key[2 * STRINGSIZE + 2];
+  strncpy(key, lowVal, STRINGSIZE);
+  key[STRINGSIZE] = (char) lowOp;
+  strncpy(key + STRINGSIZE + 1, highVal, STRINGSIZE);
+  key[2 * STRINGSIZE + 1] = (char) highOp;
+  return std::string(key, sizeof(key));
+}
+
+const RangeCacheEntry* BTreeIndex::findCachedRange(const std::string& key) {
+  std::unordered_map<std::string, RangeCacheEntry>::iterator it = rangeCache.find(key);
+  if(it == rangeCache.end()) { return NULL; }
+  RangeCacheEntry& entry = it->second;
+  bool fresh = entry.validUntil == NO_EXPIRY || expiryClock() < entry.validUntil;
+  for(size_t i = 0; fresh && i < entry.pages.size(); i++) {
+    PageId pageNum = entry.pages[i].first;
+    fresh = (pageNum < pageVersions.size() ? pageVersions[pageNum] : 0) == entry.pages[i].second;
+  }
+  if(!fresh) {
+    dropCachedRange(it);
+    return NULL;
+  }
+  rangeCacheLru.splice(rangeCacheLru.begin(), rangeCacheLru, entry.lruPosition);
+  return &entry;
+}
+
+void BTreeIndex::storeRecordedRange() {
+  recordingScan = false;
+  size_t cost = recording.rids.size() + 1; //an empty result takes a slot too
+  if(cost > rangeCacheLimit) { return; }
+  std::sort(recording.pages.begin(), recording.pages.end());
+  recording.pages.erase(std::unique(recording.pages.begin(), recording.pages.end()),
+                        recording.pages.end());
+  std::unordered_map<std::string, RangeCacheEntry>::iterator it = rangeCache.find(recordingKey);
+  if(it != rangeCache.end()) { dropCachedRange(it); }
+  while(rangeCacheRids + cost > rangeCacheLimit) {
+    dropCachedRange(rangeCache.find(rangeCacheLru.back()));
+  }
+  rangeCacheLru.push_front(recordingKey);
+  RangeCacheEntry& entry = rangeCache[recordingKey];
+  entry.rids.swap(recording.rids);
+  entry.pages.swap(recording.pages);
+  entry.validUntil = recording.validUntil;
+  entry.lruPosition = rangeCacheLru.begin();
+  rangeCacheRids += cost;
+}
+
+void BTreeIndex::dropCachedRange(std::unordered_map<std::string, RangeCacheEntry>::iterator it) {
+  rangeCacheRids -= it->second.rids.size() + 1;
+  rangeCacheLru.erase(it->second.lruPosition);
+  rangeCache.erase(it);
+}
+
+// -----------------------------------------------------------------------------
+// Hot set entry orders
+// -----------------------------------------------------------------------------
+
+static bool moreAccesses(const HotSetEntry& a, const HotSetEntry& b) {
+  return a.accesses > b.accesses;
+}
+
+static bool lowerPageNo(const HotSetEntry& a, const HotSetEntry& b) {
+  return a.pageNo < b.pageNo;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::saveHotSet
+// -----------------------------------------------------------------------------
+
+int BTreeIndex::saveHotSet() {
+  if(!keepHotSet) { return 0; }
+  std::vector<HotSetEntry> entries;
+  for(size_t pageNum = 0; pageNum < pageAccesses.size(); pageNum++) {
+    if(pageAccesses[pageNum] == 0) { continue; }
+    HotSetEntry entry;
+    entry.pageNo = pageNum;
+    entry.accesses = pageAccesses[pageNum];
+    entries.push_back(entry);
+    pageAccesses[pageNum] /= 2;
+  }
+  if(entries.size() > (size_t) HOT_SET_MAX_PAGES) { //keep the most read pages
+    std::nth_element(entries.begin(), entries.begin() + HOT_SET_MAX_PAGES, entries.end(), moreAccesses);
+    entries.resize(HOT_SET_MAX_PAGES);
+    std::sort(entries.begin(), entries.end(), lowerPageNo);
+  }
+  //write a new file and rename it over the old one, so a crash leaves one of the two
+  std::string hotSetName = file->filename() + ".hot";
+  std::string tempName = hotSetName + ".tmp";
+  FILE* hotSetFile = fopen(tempName.c_str(), "wb");
+  if(hotSetFile == NULL) { return 0; }
+  HotSetHeader header;
+  memset(&header, 0, sizeof(HotSetHeader));
+  memcpy(header.magic, HOT_SET_MAGIC, sizeof(header.magic));
+  header.numPages = entries.size();
+  bool written = fwrite(&header, sizeof(HotSetHeader), 1, hotSetFile) == 1
+    && (entries.empty() || fwrite(&entries[0], sizeof(HotSetEntry), entries.size(), hotSetFile) == entries.size());
+  written = fclose(hotSetFile) == 0 && written;
+  if(!written || rename(tempName.c_str(), hotSetName.c_str()) != 0) {
+    remove(tempName.c_str());
+    return 0;
+  }
+  return entries.size();
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::scanNext
+// BTreeIndex::loadHotSetPages
 // -----------------------------------------------------------------------------
 
-const void BTreeIndex::scanNext(RecordId& outRid) {
-  if(!scanExecuting) { throw ScanNotInitializedException(); }
-  LeafNode *currNode = (LeafNode*) currentPageData;
-  int nextPageNo, numKeys;
-  // check if scan is at end
-  if(currentPageNum != Page::INVALID_NUMBER && matchRange(currNode->keyArray[nextEntry])) {
-    numKeys = getLeafLength(currNode);    
-    outRid = currNode->ridArray[nextEntry];
+int BTreeIndex::loadHotSetPages(const int maxPages) {
+  size_t end = std::min(pendingHotPages.size(), nextHotPage + std::max(0, maxPages));
+  for(; nextHotPage < end; nextHotPage++) {
+    Page* page;
+    try {
+      bufferManager->readPage(file, pendingHotPages[nextHotPage], page);
+    } catch(InvalidPageException e) { //the hot set is stale; drop the rest of it
+      nextHotPage = pendingHotPages.size();
+      break;
+    }
+    touchPage(pendingHotPages[nextHotPage]);
+    bufferManager->unPinPage(file, pendingHotPages[nextHotPage], false);
   }
-  else {
-    endScan();
-    throw IndexScanCompletedException();
+  if(nextHotPage == pendingHotPages.size()) { //done; free the list
+    std::vector<PageId>().swap(pendingHotPages);
+    nextHotPage = 0;
   }
-  // check if at the end of a leaf
-  if(nextEntry == numKeys-1) {
-    nextEntry = 0;
-    nextPageNo = currNode->rightSibPageNo;
-    bufferManager->unPinPage(file, currentPageNum, false);
-    currentPageNum = nextPageNo;
-    if(currentPageNum != Page::INVALID_NUMBER) {
-      bufferManager->readPage(file, currentPageNum, currentPageData);
+  return pendingHotPages.size() - nextHotPage;
+}
+
+void BTreeIndex::readHotSet() {
+  std::string hotSetName = file->filename() + ".hot";
+  FILE* hotSetFile = fopen(hotSetName.c_str(), "rb");
+  if(hotSetFile == NULL) { return; }
+  HotSetHeader header;
+  std::vector<HotSetEntry> entries;
+  if(fread(&header, sizeof(HotSetHeader), 1, hotSetFile) == 1
+     && memcmp(header.magic, HOT_SET_MAGIC, sizeof(header.magic)) == 0
+     && header.numPages <= (uint32_t) HOT_SET_MAX_PAGES) {
+    entries.resize(header.numPages);
+    if(header.numPages > 0
+       && fread(&entries[0], sizeof(HotSetEntry), header.numPages, hotSetFile) != header.numPages) {
+      entries.clear(); //truncated; ignore it
     }
-    else { currentPageData = NULL; }
   }
-  else { nextEntry++; }
-  return;
+  fclose(hotSetFile);
+  //the file may have shrunk since the hot set was saved; pages follow a file
+  //header smaller than a page, so pageLimit is one past the last page
+  struct stat fileStat;
+  bool sized = stat(file->filename().c_str(), &fileStat) == 0;
+  PageId pageLimit = sized ? fileStat.st_size / Page::SIZE + 1 : 0;
+  pendingHotPages.clear();
+  for(size_t i = 0; i < entries.size(); i++) {
+    if(entries[i].pageNo == Page::INVALID_NUMBER || entries[i].pageNo == headerPageNum
+       || (sized && entries[i].pageNo >= pageLimit)) { continue; }
+    pendingHotPages.push_back(entries[i].pageNo);
+    //carry the recorded counts over, so a hot set survives a short session
+    if(entries[i].pageNo >= pageAccesses.size()) { pageAccesses.resize(entries[i].pageNo + 1, 0); }
+    pageAccesses[entries[i].pageNo] += entries[i].accesses / 2;
+  }
+  std::sort(pendingHotPages.begin(), pendingHotPages.end());
+  pendingHotPages.erase(std::unique(pendingHotPages.begin(), pendingHotPages.end()), pendingHotPages.end());
+  nextHotPage = 0;
+  readAhead(pendingHotPages); //the OS reads them while index calls go on
 }
 
-// -----------------------------------------------------------------------------
-// BTreeIndex::endScan
-// -----------------------------------------------------------------------------
+void BTreeIndex::continueHotSetLoad() {
+  if(nextHotPage < pendingHotPages.size()) { loadHotSetPages(HOT_SET_PAGES_PER_CALL); }
+}
 
-const void BTreeIndex::endScan() {
-  if(!scanExecuting) { throw ScanNotInitializedException(); }
-  scanExecuting = false;
-  if(currentPageNum != Page::INVALID_NUMBER) {
-    bufferManager->unPinPage(file, currentPageNum, false);
-    currentPageNum = Page::INVALID_NUMBER;
-    currentPageData = NULL;
+void BTreeIndex::forgetPage(const PageId pageNum) {
+  if(pageNum < pageAccesses.size()) { pageAccesses[pageNum] = 0; }
+  bumpPageVersion(pageNum);
+  if(pageNum < touchedPages.size() && touchedPages[pageNum]) {
+    touchedPages[pageNum] = false;
+    numTouchedPages--;
   }
+  std::vector<PageId>::iterator it =
+    std::lower_bound(pendingHotPages.begin() + nextHotPage, pendingHotPages.end(), pageNum);
+  if(it != pendingHotPages.end() && *it == pageNum) { pendingHotPages.erase(it); }
 }
 
 // -----------------------------------------------------------------------------
@@ -236,109 +1812,62 @@ bool BTreeIndex::insertInSubtree(RIDKeyPair krid,
                                  PageKeyPair& splitKey){
 
   NonLeafNode *currNode = readNonLeafNode(file, pageNum);
-  int currNodeLen = getNonLeafLength(currNode);
+  int childIndex = findChildIndex(currNode, krid.key);
   bool split;
-  if(strncmp(krid.key, currNode->keyArray[0], STRINGSIZE) < 0) { // insert in first page
-    if (currNode->level == 1) {
-      split = insertInLeaf(krid, currNode->pageNoArray[0], splitKey);
-    }
-    else {
-      split = insertInSubtree(krid, currNode->pageNoArray[0], splitKey);
-    }
-  }
-  else if (strncmp(krid.key, currNode->keyArray[currNodeLen-1], STRINGSIZE) >= 0) { // insert in last page
-    if (currNode->level == 1) {
-      split = insertInLeaf(krid, currNode->pageNoArray[currNodeLen], splitKey);
-    }
-    else {
-      split = insertInSubtree(krid, currNode->pageNoArray[currNodeLen], splitKey);
-    }
+  bool boundChanged = false;
+  if (currNode->level == 1) {
+    //widen the child's expiry bound by the entry's; a split recomputes the
+    //bounds of both halves
+    uint32_t bound = combineExpiry(currNode->maxExpiryArray[childIndex], krid.expiry);
+    split = insertInLeaf(krid, currNode->pageNoArray[childIndex], splitKey, bound);
+    boundChanged = bound != currNode->maxExpiryArray[childIndex];
+    currNode->maxExpiryArray[childIndex] = bound;
   }
-  else { //insert in some middle page
-    if (currNode->level == 1) {
-      for(int i = 0; i < currNodeLen - 1; i++) {
-        if((strncmp(currNode->keyArray[i], krid.key, STRINGSIZE) <= 0) && (strncmp(krid.key, currNode->keyArray[i+1], STRINGSIZE) < 0)) {
-          split = insertInLeaf(krid, currNode->pageNoArray[i+1], splitKey); // i+1, right?
-          break;
-        }
-      }
-    }
-    else {
-      for(int i = 0; i < currNodeLen - 1; i++) {
-        if((strncmp(currNode->keyArray[i], krid.key, STRINGSIZE) <= 0) && (strncmp(krid.key, currNode->keyArray[i+1], STRINGSIZE) < 0)) {
-          split = insertInSubtree(krid, currNode->pageNoArray[i+1], splitKey); // i+1, right?
-          break;
-        }
-      }
-    }
+  else {
+    split = insertInSubtree(krid, currNode->pageNoArray[childIndex], splitKey);
   }
   if (split) { //if passed up splitkey 
     if(isRoomyNonLeaf(currNode)) { 
       insertInRoomyNonLeaf(currNode, splitKey);
-      bufferManager->unPinPage(file, pageNum, true);
+      unPinIndexPage(pageNum, true);
       return false;
     }
     else { // node is full
+      uint64_t start = BTREE_PROBE_START(nonleaf__split);
       PageId newPageNum;
       NonLeafNode* newNode = allocateNonLeafNode(file, newPageNum);
-      newNode->level = currNode->level;
-      //split node
-      int i;
-      int temp = currNode->pageNoArray[NON_LEAF_NUM_KEYS/2];
-      for (i = NON_LEAF_NUM_KEYS/2; i < NON_LEAF_NUM_KEYS; i++) { // shift/delete
-        strncpy(newNode->keyArray[i - NON_LEAF_NUM_KEYS/2], currNode->keyArray[i], STRINGSIZE);
-        newNode->pageNoArray[i - NON_LEAF_NUM_KEYS/2] = temp;
-        strncpy(currNode->keyArray[i], std::string(STRINGSIZE, '\0').c_str(), STRINGSIZE);
-        temp = currNode->pageNoArray[i+1];
-        currNode->pageNoArray[i+1] = Page::INVALID_NUMBER;
-      }
-      newNode->pageNoArray[i - NON_LEAF_NUM_KEYS/2] = temp;
-
-      //get middle key
       char midKey[STRINGSIZE]; //middle key to push up
-      if (strncmp(splitKey.key, newNode->keyArray[0], STRINGSIZE) < 0) { //key should go in old node
-        insertInRoomyNonLeaf(currNode, splitKey);
-        int currNodeLen = getNonLeafLength(currNode);
-        strncpy(midKey, currNode->keyArray[currNodeLen-1], STRINGSIZE); // set midKey to last key in old node
-        strncpy(currNode->keyArray[currNodeLen-1], std::string(STRINGSIZE, '\0').c_str(), STRINGSIZE); //delete last key
-        newNode->pageNoArray[0] = currNode->pageNoArray[currNodeLen];
-        currNode->pageNoArray[currNodeLen] = Page::INVALID_NUMBER;
-      }
-      else {  //key should go in new node
-        insertInRoomyNonLeaf(newNode, splitKey);
-        strncpy(midKey, newNode->keyArray[0], STRINGSIZE); //set midKey to first key in new node
-        int newNodeLength = getNonLeafLength(newNode);
-        for (int i = 0; i < newNodeLength; i++) { //shift
-          strncpy(newNode->keyArray[i], newNode->keyArray[i+1], STRINGSIZE);
-          newNode->pageNoArray[i] = newNode->pageNoArray[i+1];
-        }
-        strncpy(newNode->keyArray[newNodeLength-1], std::string(STRINGSIZE, '\0').c_str(), STRINGSIZE);
-        newNode->pageNoArray[newNodeLength] = Page::INVALID_NUMBER; //reset pageNoArray
-      }
+      splitNonLeaf(currNode, newNode, splitKey, midKey);
+      reservePage(newPageNum, currNode->level);
 
       // check if root or internal node
       if (pageNum == rootPageNum) { //if current node is root, have to make new root
         NonLeafNode* newRoot = allocateNonLeafNode(file, rootPageNum);
         getHeader()->rootPageNo = rootPageNum;
-        bufferManager->unPinPage(file, headerPageNum, true);
+        unPinIndexPage(headerPageNum, true);
         strncpy(newRoot->keyArray[0], midKey, STRINGSIZE);
         newRoot->pageNoArray[0] = pageNum;
         newRoot->pageNoArray[1] = newPageNum;
         newRoot->level = currNode->level + 1;
-        bufferManager->unPinPage(file, rootPageNum, true);
+        reservePage(rootPageNum, newRoot->level);
+        BTREE_PROBE3(root__split, pageNum, rootPageNum, newRoot->level);
+        unPinIndexPage(rootPageNum, true);
       }
       else { //if not, then pass up the middle key to the upper level insertInSubtree
         strncpy(splitKey.key, midKey, STRINGSIZE);
         splitKey.pageNo = newPageNum;
+        splitKey.maxExpiry = NO_EXPIRY; //bounds are only kept for leaves
       }
       // unpin currNode and newNode
-      bufferManager->unPinPage(file, pageNum, true);
-      bufferManager->unPinPage(file, newPageNum, true);
+      int level = newNode->level;
+      unPinIndexPage(pageNum, true);
+      unPinIndexPage(newPageNum, true);
+      BTREE_PROBE4(nonleaf__split, pageNum, newPageNum, level, BTREE_PROBE_ELAPSED(start));
       return true;
     }
   }
   else { //unpin the node
-    bufferManager->unPinPage(file, pageNum, false);
+    unPinIndexPage(pageNum, boundChanged);
     return false;
   }
   
@@ -346,77 +1875,89 @@ bool BTreeIndex::insertInSubtree(RIDKeyPair krid,
 
 bool BTreeIndex::insertInLeaf(RIDKeyPair krid,
                               PageId pageNum,
-                              PageKeyPair& splitKey) {
+                              PageKeyPair& splitKey,
+                              uint32_t& leafBound) {
   LeafNode* currLeaf = readLeafNode(file, pageNum);
+  compactLeaf(currLeaf); //reclaim tombstones before shifting entries
   if (isRoomyLeaf(currLeaf)) {
     insertInRoomyLeaf(currLeaf, krid);
-    bufferManager->unPinPage(file, pageNum, true);
+    unPinIndexPage(pageNum, true);
     return false;
   }
   else { //leaf is full
+    uint64_t start = BTREE_PROBE_START(leaf__split);
     PageId newPageNum; 
     LeafNode* newLeaf = allocateLeafNode(file, newPageNum);
-    for (int i = LEAF_NUM_KEYS/2; i < LEAF_NUM_KEYS; i++) { // evenly distributing keys
-      strncpy(newLeaf->keyArray[i - LEAF_NUM_KEYS/2], currLeaf->keyArray[i], STRINGSIZE);
-      newLeaf->ridArray[i - LEAF_NUM_KEYS/2] = currLeaf->ridArray[i];
-      strncpy(currLeaf->keyArray[i], std::string(STRINGSIZE, '\0').c_str(), STRINGSIZE);
-      currLeaf->ridArray[i].page_number = Page::INVALID_NUMBER;
-    }
-    if (strncmp(krid.key, newLeaf->keyArray[0], STRINGSIZE) < 0) { // insert into old leaf
-      insertInRoomyLeaf(currLeaf, krid);
-    }
-    else { //insert into new leaf
-      insertInRoomyLeaf(newLeaf, krid);
-    }
+    splitLeaf(currLeaf, newLeaf, krid);
     newLeaf->rightSibPageNo = currLeaf->rightSibPageNo; //set newLeaf's rightSibPageNo
     currLeaf->rightSibPageNo = newPageNum; //set currLeaf's rightSibPageNo to currLeaf's rightSibPage
     splitKey.pageNo = newPageNum;
     strncpy(splitKey.key, newLeaf->keyArray[0], STRINGSIZE); //copy up min key of new leaf
-    bufferManager->unPinPage(file, pageNum, true);
-    bufferManager->unPinPage(file, newPageNum, true);
+    splitKey.maxExpiry = leafExpiryBound(newLeaf);
+    leafBound = leafExpiryBound(currLeaf);
+    unPinIndexPage(pageNum, true);
+    unPinIndexPage(newPageNum, true);
+    BTREE_PROBE3(leaf__split, pageNum, newPageNum, BTREE_PROBE_ELAPSED(start));
     return true; //splitKey will get pushed up
   }
 }
 
-void BTreeIndex::findInSubtree(PageId currPid){
+ScanStatus BTreeIndex::positionScan() {
+  uint64_t start = BTREE_PROBE_START(scan__start);
+  // will set currentPageNum and currentPageData
+  if(!findInSubtree(rootPageNum)) { return SCAN_NO_SUCH_KEY; }
+  BTREE_PROBE2(scan__start, currentPageNum, BTREE_PROBE_ELAPSED(start));
+  return SCAN_OK;
+}
+
+bool BTreeIndex::findInSubtree(PageId currPid){
   NonLeafNode *currNode = readNonLeafNode(file, currPid);
   int numKeys = getNonLeafLength(currNode);  
-  int i;
-  for (i = 0; i < numKeys; i++) {
-    if (lowOp == GT) {
-      if (strncmp(currNode->keyArray[i], lowVal, STRINGSIZE) > 0) { break; }
-    }
-    else { //lowOp == GTE
-      if (i == numKeys-1) { //last key
-        if (strncmp(currNode->keyArray[i], lowVal, STRINGSIZE) > 0) { break; }
-        //else case just finishes for loop
-      }
-      else {
-        if (strncmp(currNode->keyArray[i], lowVal, STRINGSIZE) == 0) { i++; break; }
-        else if (strncmp(currNode->keyArray[i], lowVal, STRINGSIZE) > 0) { break; }
-      }
-    }
+  int i = 0;
+  //GTE goes left of a separator equal to lowVal, where duplicates of it may sit
+  while (i < numKeys && (lowOp == GT ? strncmp(currNode->keyArray[i], lowVal, STRINGSIZE) <= 0
+                                     : strncmp(currNode->keyArray[i], lowVal, STRINGSIZE) < 0)) {
+    i++;
   }
   //check if the node is right above leaves
   if (currNode->level != 1) {
     bufferManager->unPinPage(file, currPid, false);
-    findInSubtree(currNode->pageNoArray[i]);
+    return findInSubtree(currNode->pageNoArray[i]);
   }
   else { //is right above a leaf
     currentPageNum = currNode->pageNoArray[i];
     bufferManager->unPinPage(file, currPid, false);
-    bufferManager->readPage(file, currentPageNum, currentPageData);
+    readIndexPage(currentPageNum, currentPageData);
 
     RecordId rec;
     rec.page_number = Page::INVALID_NUMBER;
     rec.slot_number = Page::INVALID_SLOT;
     findInLeaf(currentPageNum, rec);
     if(rec.page_number == Page::INVALID_NUMBER) { //no record that matched param range found
-      endScan();
-      throw NoSuchKeyFoundException();
+      closeScan();
+      return false;
+    }
+    //position on the first entry scanNext() would return: tombstones,
+    //expired entries and keys the predicate rejects do not start a scan
+    skipDeadEntries();
+    if(currentPageNum == Page::INVALID_NUMBER
+       || !matchRange(((LeafNode*) currentPageData)->keyArray[nextEntry])) {
+      closeScan();
+      return false;
     }
   }
-  return;
+  return true;
+}
+
+void BTreeIndex::throwScanStatus(ScanStatus status) {
+  switch(status) {
+    case SCAN_OK: return;
+    case SCAN_NO_SUCH_KEY: throw NoSuchKeyFoundException();
+    case SCAN_COMPLETED: throw IndexScanCompletedException();
+    case SCAN_BAD_OPCODES: throw BadOpcodesException();
+    case SCAN_BAD_RANGE: throw BadScanrangeException();
+    case SCAN_NOT_INITIALIZED: throw ScanNotInitializedException();
+  }
 }
 
 void BTreeIndex::findInLeaf(PageId currPid, RecordId& result) {
@@ -428,19 +1969,292 @@ void BTreeIndex::findInLeaf(PageId currPid, RecordId& result) {
       nextEntry = i;
       return;
     }
-    else if(strncmp(currNode->keyArray[i], highVal, STRINGSIZE) > 0) { //if current key is larger highVal, return
+    else if(pastRange(currNode->keyArray[i])) { //if current key is larger highVal, return
       return;
     }
   }
   if(currNode->rightSibPageNo != Page::INVALID_NUMBER) { //jump to right sibling node if rightSibPageNo is valid
     currentPageNum = currNode->rightSibPageNo;
     bufferManager->unPinPage(file, currPid, false);
-    bufferManager->readPage(file, currentPageNum, currentPageData);
+    readIndexPage(currentPageNum, currentPageData);
     findInLeaf(currentPageNum, result);
   }
   return;
 }
 
+PageId BTreeIndex::findLeafPage(const char* key, LeafFences* fences, bool firstDuplicate) {
+  if(fences != NULL) {
+    fences->hasLow = false;
+    fences->hasHigh = false;
+  }
+  PageId pageNum = rootPageNum;
+  int level;
+  do { //descend to the leaf covering the key
+    NonLeafNode* node = readNonLeafNode(file, pageNum);
+    int i = findChildIndex(node, key);
+    //duplicates of a key equal to a separator may also sit left of it
+    while(firstDuplicate && i > 0 && strncmp(node->keyArray[i-1], key, STRINGSIZE) == 0) { i--; }
+    if(fences != NULL) { //narrow the key range of the subtree being entered
+      if(i > 0) {
+        fences->hasLow = true;
+        memcpy(fences->low, node->keyArray[i-1], STRINGSIZE);
+      }
+      if(i < getNonLeafLength(node)) {
+        fences->hasHigh = true;
+        memcpy(fences->high, node->keyArray[i], STRINGSIZE);
+      }
+    }
+    PageId childPageNum = node->pageNoArray[i];
+    level = node->level;
+    bufferManager->unPinPage(file, pageNum, false);
+    pageNum = childPageNum;
+  } while(level != 1);
+  return pageNum;
+}
+
+void BTreeIndex::deleteFromLeaf(LeafNode* leaf, int slot) {
+  if(lazyDeletes) { //one leaf write; compact once enough slots are dead
+    leaf->tombstones[slot / 8] |= 1 << (slot % 8);
+    leaf->numTombstones++;
+    if(leaf->numTombstones * 100 >= TOMBSTONE_COMPACT_PERCENT * LEAF_NUM_KEYS) {
+      compactLeaf(leaf);
+    }
+  }
+  else { removeFromLeaf(leaf, slot); }
+}
+
+void BTreeIndex::removeFromLeaf(LeafNode* leaf, int slot) {
+  int numKeys = getLeafLength(leaf);
+  for(int i = slot; i < numKeys - 1; i++) { //shift everything up
+    memcpy(leaf->keyArray[i], leaf->keyArray[i+1], STRINGSIZE);
+    leaf->ridArray[i] = leaf->ridArray[i+1];
+    leaf->expiryArray[i] = leaf->expiryArray[i+1];
+  }
+  memset(leaf->keyArray[numKeys-1], 0, STRINGSIZE);
+  leaf->ridArray[numKeys-1].page_number = Page::INVALID_NUMBER;
+  leaf->ridArray[numKeys-1].slot_number = Page::INVALID_SLOT;
+  leaf->expiryArray[numKeys-1] = NO_EXPIRY;
+}
+
+void BTreeIndex::removeChild(NonLeafNode* node, int i) {
+  //the separator left of the child goes with it; the first child takes the
+  //separator right of it, so the new first child keeps covering every key
+  int numKeys = getNonLeafLength(node);
+  for(int j = (i > 0 ? i - 1 : 0); j < numKeys - 1; j++) {
+    memcpy(node->keyArray[j], node->keyArray[j+1], STRINGSIZE);
+  }
+  for(int j = i; j < numKeys; j++) {
+    node->pageNoArray[j] = node->pageNoArray[j+1];
+    node->maxExpiryArray[j] = node->maxExpiryArray[j+1];
+  }
+  memset(node->keyArray[numKeys-1], 0, STRINGSIZE);
+  node->pageNoArray[numKeys] = Page::INVALID_NUMBER;
+  node->maxExpiryArray[numKeys] = NO_EXPIRY;
+}
+
+int BTreeIndex::findChildIndex(NonLeafNode* node, const char* key) {
+  //keys equal to a separator live in the subtree right of it
+  int numKeys = getNonLeafLength(node);
+  int i = 0;
+  while(i < numKeys && strncmp(node->keyArray[i], key, STRINGSIZE) <= 0) { i++; }
+  return i;
+}
+
+int BTreeIndex::findKeyInLeaf(LeafNode* leaf, const char* key, const uint32_t now) {
+  int numKeys = getLeafLength(leaf);
+  for(int i = 0; i < numKeys; i++) {
+    int cmp = strncmp(leaf->keyArray[i], key, STRINGSIZE);
+    if(cmp == 0 && isLive(leaf, i, now)) { return i; }
+    if(cmp > 0) { break; } //keys are sorted, so the key is not here
+  }
+  return -1;
+}
+
+LeafNode* BTreeIndex::findLiveEntry(const char* key, const uint32_t now, PageId& pageNum, int& slot) {
+  LeafFences fences;
+  pageNum = findLeafPage(key, &fences, true);
+  //left of a separator equal to the key, the run goes on past the leaf
+  bool runsOn = fences.hasHigh && strncmp(fences.high, key, STRINGSIZE) == 0;
+  while(true) {
+    LeafNode* leaf = readLeafNode(file, pageNum);
+    slot = findKeyInLeaf(leaf, key, now);
+    if(slot >= 0) { return leaf; }
+    PageId nextPageNum = runsOn || leafEndsInKey(leaf, key) ? leaf->rightSibPageNo : Page::INVALID_NUMBER;
+    bufferManager->unPinPage(file, pageNum, false);
+    if(nextPageNum == Page::INVALID_NUMBER) { return NULL; }
+    pageNum = nextPageNum;
+    runsOn = false;
+  }
+}
+
+bool BTreeIndex::leafEndsInKey(LeafNode* leaf, const char* key) {
+  int numKeys = getLeafLength(leaf);
+  return numKeys == 0 || strncmp(leaf->keyArray[numKeys-1], key, STRINGSIZE) == 0;
+}
+
+bool BTreeIndex::sampleInSubtree(PageId pageNum, RIDKeyPair& sample, const bool isRoot) {
+  NonLeafNode *currNode = readNonLeafNode(file, pageNum);
+  // pick one of the root's real children, which weighs every entry alike,
+  // or one of the NON_LEAF_NUM_KEYS+1 child slots below it, rejecting unused slots
+  int numSlots = isRoot ? getNonLeafLength(currNode) + 1 : NON_LEAF_NUM_KEYS + 1;
+  int slot = rand() / (RAND_MAX / numSlots + 1);
+  if(slot > getNonLeafLength(currNode)) {
+    bufferManager->unPinPage(file, pageNum, false);
+    return false;
+  }
+  PageId childPageNum = currNode->pageNoArray[slot];
+  int level = currNode->level;
+  bufferManager->unPinPage(file, pageNum, false);
+  if(level != 1) {
+    return sampleInSubtree(childPageNum, sample, false);
+  }
+  //child is a leaf: pick one of the LEAF_NUM_KEYS slots
+  LeafNode *leaf = readLeafNode(file, childPageNum);
+  slot = rand() / (RAND_MAX / LEAF_NUM_KEYS + 1);
+  bool accepted = slot < getLeafLength(leaf) && isLive(leaf, slot, expiryClock());
+  if(accepted) {
+    sample.set(leaf->ridArray[slot], leaf->keyArray[slot], leaf->expiryArray[slot]);
+  }
+  bufferManager->unPinPage(file, childPageNum, false);
+  return accepted;
+}
+
+PageId BTreeIndex::findLeftmostLeaf() {
+  if(rootPageNum == Page::INVALID_NUMBER) { return Page::INVALID_NUMBER; }
+  PageId pageNum = rootPageNum;
+  while(true) {
+    NonLeafNode* node = readNonLeafNode(file, pageNum);
+    PageId childPageNum = node->pageNoArray[0];
+    int level = node->level;
+    bufferManager->unPinPage(file, pageNum, false);
+    if(level == 1) { return childPageNum; }
+    pageNum = childPageNum;
+  }
+}
+
+void BTreeIndex::openLeafCursor(LeafCursor& cursor) {
+  cursor.pageNum = findLeftmostLeaf();
+  cursor.now = expiryClock();
+  settleLeafCursor(cursor);
+}
+
+void BTreeIndex::advanceLeafCursor(LeafCursor& cursor) {
+  cursor.slot++;
+  while(cursor.slot < cursor.length && !isLive(cursor.leaf, cursor.slot, cursor.now)) { cursor.slot++; }
+  if(cursor.slot < cursor.length) { return; }
+  //done with this leaf, move on to its right sibling
+  PageId nextPageNum = cursor.leaf->rightSibPageNo;
+  bufferManager->unPinPage(file, cursor.pageNum, false);
+  cursor.pageNum = nextPageNum;
+  settleLeafCursor(cursor);
+}
+
+void BTreeIndex::settleLeafCursor(LeafCursor& cursor) {
+  while(cursor.pageNum != Page::INVALID_NUMBER) {
+    cursor.leaf = readLeafNode(file, cursor.pageNum);
+    cursor.length = getLeafLength(cursor.leaf);
+    cursor.slot = 0;
+    while(cursor.slot < cursor.length && !isLive(cursor.leaf, cursor.slot, cursor.now)) { cursor.slot++; }
+    if(cursor.slot < cursor.length) { return; }
+    PageId nextPageNum = cursor.leaf->rightSibPageNo;
+    bufferManager->unPinPage(file, cursor.pageNum, false);
+    cursor.pageNum = nextPageNum;
+  }
+  cursor.leaf = NULL;
+  cursor.slot = 0;
+  cursor.length = 0;
+}
+
+void BTreeIndex::createHeader(const std::string & relationName) {
+  Page* headerPage;
+  bufferManager->allocatePage(file, headerPageNum, headerPage); //allocates header page
+  touchPage(headerPageNum);
+  IndexMetaInfo* header = (IndexMetaInfo*) headerPage; //get index metadata
+  strncpy(header->relationName, relationName.c_str(), 20); //sets header->relationName
+  header->attrByteOffset = attrByteOffset; //sets header->attrByteOffset
+  header->rootPageNo = rootPageNum; //sets header->rootPageNo
+  header->unique = unique; //sets header->unique
+  header->collation = collation; //sets header->collation
+  header->formatVersion = INDEX_FORMAT_VERSION;
+  unPinIndexPage(headerPageNum, true);
+}
+
+void BTreeIndex::bulkLoadBegin(BulkLoader& loader, const int leafFillPercent) {
+  loader.leafPageNum = Page::INVALID_NUMBER;
+  loader.leaf = NULL;
+  loader.leafLength = 0;
+  loader.leafCapacity = std::max(1, LEAF_NUM_KEYS * leafFillPercent / 100);
+  loader.leaves.clear();
+}
+
+void BTreeIndex::bulkLoadAppend(BulkLoader& loader, const RIDKeyPair& krid) {
+  if(loader.leaf == NULL || loader.leafLength == loader.leafCapacity) { //start a new leaf
+    PageId newPageNum;
+    LeafNode* newLeaf = allocateLeafNode(file, newPageNum);
+    newLeaf->rightSibPageNo = Page::INVALID_NUMBER;
+    if(loader.leaf != NULL) { //link and release the full leaf
+      loader.leaf->rightSibPageNo = newPageNum;
+      unPinIndexPage(loader.leafPageNum, true);
+    }
+    loader.leafPageNum = newPageNum;
+    loader.leaf = newLeaf;
+    loader.leafLength = 0;
+    PageKeyPair leafKey;
+    leafKey.set(newPageNum, krid.key);
+    leafKey.maxExpiry = krid.expiry;
+    loader.leaves.push_back(leafKey);
+  }
+  strncpy(loader.leaf->keyArray[loader.leafLength], krid.key, STRINGSIZE);
+  loader.leaf->ridArray[loader.leafLength] = krid.rid;
+  loader.leaf->expiryArray[loader.leafLength] = krid.expiry;
+  loader.leafLength++;
+  PageKeyPair& leafKey = loader.leaves.back();
+  leafKey.maxExpiry = combineExpiry(leafKey.maxExpiry, krid.expiry);
+}
+
+void BTreeIndex::bulkLoadFinish(BulkLoader& loader) {
+  if(loader.leaf == NULL) { return; } //nothing loaded, tree stays empty
+  unPinIndexPage(loader.leafPageNum, true);
+  std::vector<PageKeyPair> children;
+  children.swap(loader.leaves);
+  if(children.size() == 1) { //a non-leaf needs two children: add an empty first leaf like insertEntry does
+    PageKeyPair emptyKey;
+    LeafNode* emptyLeaf = allocateLeafNode(file, emptyKey.pageNo);
+    emptyLeaf->rightSibPageNo = children[0].pageNo;
+    memset(emptyKey.key, 0, STRINGSIZE);
+    emptyKey.maxExpiry = EMPTY_LEAF_EXPIRY;
+    unPinIndexPage(emptyKey.pageNo, true);
+    children.insert(children.begin(), emptyKey);
+  }
+  //Build each non-leaf level from the (first key, page) pairs of the level below
+  int level = 1;
+  while(children.size() > 1) {
+    size_t numChildren = children.size();
+    size_t numNodes = (numChildren + NON_LEAF_NUM_KEYS) / (NON_LEAF_NUM_KEYS + 1);
+    std::vector<PageKeyPair> parents;
+    size_t next = 0;
+    for(size_t n = 0; n < numNodes; n++) { //spread children evenly so every node gets at least two
+      size_t nodeChildren = numChildren / numNodes + (n < numChildren % numNodes ? 1 : 0);
+      PageKeyPair parentKey;
+      NonLeafNode* node = allocateNonLeafNode(file, parentKey.pageNo);
+      node->level = level;
+      strncpy(parentKey.key, children[next].key, STRINGSIZE);
+      for(size_t i = 0; i < nodeChildren; i++, next++) {
+        node->pageNoArray[i] = children[next].pageNo;
+        if(level == 1) { node->maxExpiryArray[i] = children[next].maxExpiry; }
+        if(i > 0) { strncpy(node->keyArray[i-1], children[next].key, STRINGSIZE); }
+      }
+      unPinIndexPage(parentKey.pageNo, true);
+      parents.push_back(parentKey);
+    }
+    children.swap(parents);
+    level++;
+  }
+  rootPageNum = children[0].pageNo;
+  getHeader()->rootPageNo = rootPageNum;
+  unPinIndexPage(headerPageNum, true);
+}
+
 void BTreeIndex::printSubtree(PageId pageNum){
   Page* nodePage;
   int numKeys;
@@ -495,6 +2309,7 @@ void BTreeIndex::printLeaf(PageId pageNum){
 NonLeafNode* BTreeIndex::allocateNonLeafNode(File *fptr, PageId &pageNo) { 
   Page* page;
   bufferManager->allocatePage(fptr, pageNo, page);
+  touchPage(pageNo);
   return (NonLeafNode*) page;
 }
 
@@ -502,27 +2317,45 @@ NonLeafNode* BTreeIndex::allocateNonLeafNode(File *fptr, PageId &pageNo) {
 LeafNode* BTreeIndex::allocateLeafNode(File *fptr, PageId& pageNo) {
   Page* page;
   bufferManager->allocatePage(fptr, pageNo, page);
+  touchPage(pageNo);
   return (LeafNode*) page;
 }
 
 NonLeafNode* BTreeIndex::readNonLeafNode(File *fptr, PageId &pageNo) {
   Page* page;
-  bufferManager->readPage(fptr, pageNo, page);
+  readIndexPage(pageNo, page);
   return (NonLeafNode*) page;
 }
 
 LeafNode* BTreeIndex::readLeafNode(File *fptr, PageId &pageNo) {
   Page* page;
-  bufferManager->readPage(fptr, pageNo, page);
+  readIndexPage(pageNo, page);
   return (LeafNode*) page;
 }
 
+void BTreeIndex::readIndexPage(const PageId pageNum, Page*& page) {
+  uint64_t start = BTREE_PROBE_START(page__read);
+  bufferManager->readPage(file, pageNum, page);
+  BTREE_PROBE2(page__read, pageNum, BTREE_PROBE_ELAPSED(start));
+  touchPage(pageNum);
+  if(recordingScan) {
+    uint32_t version = pageNum < pageVersions.size() ? pageVersions[pageNum] : 0;
+    recording.pages.push_back(std::make_pair(pageNum, version));
+    //a scan reading this much is not worth caching, or was abandoned
+    if(recording.pages.size() > (size_t) RANGE_CACHE_MAX_RIDS) { recordingScan = false; }
+  }
+  if(keepHotSet) {
+    if(pageNum >= pageAccesses.size()) { pageAccesses.resize(pageNum + 1, 0); }
+    pageAccesses[pageNum]++;
+  }
+}
+
 bool BTreeIndex::isRoomyLeaf(LeafNode* leaf) {
   return leaf->ridArray[LEAF_NUM_KEYS-1].page_number == Page::INVALID_NUMBER;
 }
 
 bool BTreeIndex::isRoomyNonLeaf(NonLeafNode* node) {
-  return node->pageNoArray[LEAF_NUM_KEYS] == Page::INVALID_NUMBER;
+  return node->pageNoArray[NON_LEAF_NUM_KEYS] == Page::INVALID_NUMBER;
 }
 
 void BTreeIndex::insertInRoomyLeaf(LeafNode* leaf, RIDKeyPair krid) {
@@ -530,15 +2363,18 @@ void BTreeIndex::insertInRoomyLeaf(LeafNode* leaf, RIDKeyPair krid) {
     if(leaf->ridArray[i].page_number == Page::INVALID_NUMBER) { 
       strncpy(leaf->keyArray[i], krid.key, STRINGSIZE);
       leaf->ridArray[i] = krid.rid;
+      leaf->expiryArray[i] = krid.expiry;
       return;
     }
     if (strncmp(leaf->keyArray[i], krid.key, STRINGSIZE) >= 0) { //if key in array is greater than key to insert
       for (int j = LEAF_NUM_KEYS - 2; j >= i; j--) { //shift everything down
         strncpy(leaf->keyArray[j+1], leaf->keyArray[j], STRINGSIZE);
         leaf->ridArray[j+1] = leaf->ridArray[j];
+        leaf->expiryArray[j+1] = leaf->expiryArray[j];
       }
       strncpy(leaf->keyArray[i], krid.key, STRINGSIZE);
       leaf->ridArray[i] = krid.rid;
+      leaf->expiryArray[i] = krid.expiry;
       return;
     }
   }
@@ -549,20 +2385,88 @@ void BTreeIndex::insertInRoomyNonLeaf(NonLeafNode* node, PageKeyPair pageKey) {
     if(node->pageNoArray[i+1] == Page::INVALID_NUMBER) {
       strncpy(node->keyArray[i], pageKey.key, STRINGSIZE);
       node->pageNoArray[i+1] = pageKey.pageNo;
+      node->maxExpiryArray[i+1] = pageKey.maxExpiry;
       return;
     }
-    if (strncmp(node->keyArray[i], pageKey.key, STRINGSIZE) >= 0) { //if key in array is greater than key to insert
+    //the split child sits right of any separators equal to the new one, so
+    //the new child goes after them too, keeping children in leaf order
+    if (strncmp(node->keyArray[i], pageKey.key, STRINGSIZE) > 0) { //if key in array is greater than key to insert
       for (int j = NON_LEAF_NUM_KEYS - 2; j >= i; j--) { //shift everything down
         strncpy(node->keyArray[j+1], node->keyArray[j], STRINGSIZE);
         node->pageNoArray[j+2] = node->pageNoArray[j+1];
+        node->maxExpiryArray[j+2] = node->maxExpiryArray[j+1];
       }
       strncpy(node->keyArray[i], pageKey.key, STRINGSIZE);
       node->pageNoArray[i+1] = pageKey.pageNo;
+      node->maxExpiryArray[i+1] = pageKey.maxExpiry;
       return;
     }
   }
 }
 
+void BTreeIndex::splitLeaf(LeafNode* leaf, LeafNode* newLeaf, const RIDKeyPair& krid) {
+  for (int i = LEAF_NUM_KEYS/2; i < LEAF_NUM_KEYS; i++) { // evenly distributing keys
+    strncpy(newLeaf->keyArray[i - LEAF_NUM_KEYS/2], leaf->keyArray[i], STRINGSIZE);
+    newLeaf->ridArray[i - LEAF_NUM_KEYS/2] = leaf->ridArray[i];
+    newLeaf->expiryArray[i - LEAF_NUM_KEYS/2] = leaf->expiryArray[i];
+    strncpy(leaf->keyArray[i], std::string(STRINGSIZE, '\0').c_str(), STRINGSIZE);
+    leaf->ridArray[i].page_number = Page::INVALID_NUMBER;
+    leaf->expiryArray[i] = NO_EXPIRY;
+  }
+  if (strncmp(krid.key, newLeaf->keyArray[0], STRINGSIZE) < 0) { // insert into old leaf
+    insertInRoomyLeaf(leaf, krid);
+  }
+  else { //insert into new leaf
+    insertInRoomyLeaf(newLeaf, krid);
+  }
+}
+
+void BTreeIndex::splitNonLeaf(NonLeafNode* node, NonLeafNode* newNode,
+                              const PageKeyPair& pageKey, char* midKey) {
+  newNode->level = node->level;
+  //split node
+  int i;
+  int temp = node->pageNoArray[NON_LEAF_NUM_KEYS/2];
+  uint32_t tempExpiry = node->maxExpiryArray[NON_LEAF_NUM_KEYS/2];
+  for (i = NON_LEAF_NUM_KEYS/2; i < NON_LEAF_NUM_KEYS; i++) { // shift/delete
+    strncpy(newNode->keyArray[i - NON_LEAF_NUM_KEYS/2], node->keyArray[i], STRINGSIZE);
+    newNode->pageNoArray[i - NON_LEAF_NUM_KEYS/2] = temp;
+    newNode->maxExpiryArray[i - NON_LEAF_NUM_KEYS/2] = tempExpiry;
+    strncpy(node->keyArray[i], std::string(STRINGSIZE, '\0').c_str(), STRINGSIZE);
+    temp = node->pageNoArray[i+1];
+    tempExpiry = node->maxExpiryArray[i+1];
+    node->pageNoArray[i+1] = Page::INVALID_NUMBER;
+    node->maxExpiryArray[i+1] = NO_EXPIRY;
+  }
+  newNode->pageNoArray[i - NON_LEAF_NUM_KEYS/2] = temp;
+  newNode->maxExpiryArray[i - NON_LEAF_NUM_KEYS/2] = tempExpiry;
+
+  //get middle key
+  if (strncmp(pageKey.key, newNode->keyArray[0], STRINGSIZE) < 0) { //key should go in old node
+    insertInRoomyNonLeaf(node, pageKey);
+    int nodeLen = getNonLeafLength(node);
+    strncpy(midKey, node->keyArray[nodeLen-1], STRINGSIZE); // set midKey to last key in old node
+    strncpy(node->keyArray[nodeLen-1], std::string(STRINGSIZE, '\0').c_str(), STRINGSIZE); //delete last key
+    newNode->pageNoArray[0] = node->pageNoArray[nodeLen];
+    newNode->maxExpiryArray[0] = node->maxExpiryArray[nodeLen];
+    node->pageNoArray[nodeLen] = Page::INVALID_NUMBER;
+    node->maxExpiryArray[nodeLen] = NO_EXPIRY;
+  }
+  else {  //key should go in new node
+    insertInRoomyNonLeaf(newNode, pageKey);
+    strncpy(midKey, newNode->keyArray[0], STRINGSIZE); //set midKey to first key in new node
+    int newNodeLength = getNonLeafLength(newNode);
+    for (int i = 0; i < newNodeLength; i++) { //shift
+      strncpy(newNode->keyArray[i], newNode->keyArray[i+1], STRINGSIZE);
+      newNode->pageNoArray[i] = newNode->pageNoArray[i+1];
+      newNode->maxExpiryArray[i] = newNode->maxExpiryArray[i+1];
+    }
+    strncpy(newNode->keyArray[newNodeLength-1], std::string(STRINGSIZE, '\0').c_str(), STRINGSIZE);
+    newNode->pageNoArray[newNodeLength] = Page::INVALID_NUMBER; //reset pageNoArray
+    newNode->maxExpiryArray[newNodeLength] = NO_EXPIRY;
+  }
+}
+
 int BTreeIndex::getNonLeafLength(NonLeafNode* node) {
   for (int i = 1; i < NON_LEAF_NUM_KEYS+1; i++) {
     if (node->pageNoArray[i] == Page::INVALID_NUMBER) {
@@ -582,6 +2486,14 @@ int BTreeIndex::getLeafLength(LeafNode* node) {
 }
 
 bool BTreeIndex::matchRange(const char* key) {
+  if(prefixScan) {
+    return strncmp(key, prefixVal, prefixLen) == 0;
+  }
+  return keyInRange(key, lowVal, lowOp, highVal, highOp);
+}
+
+bool BTreeIndex::keyInRange(const char* key, const char* lowVal, const Operator lowOp,
+                            const char* highVal, const Operator highOp) {
   bool lowFit, highFit;
   if(lowOp == GT) {
     lowFit = (strncmp(key, lowVal, STRINGSIZE) > 0);
@@ -598,9 +2510,376 @@ bool BTreeIndex::matchRange(const char* key) {
   return (lowFit && highFit);
 }
 
+const char* BTreeIndex::sortKeyFor(const char* key, char* sortKey) {
+  if(collation == BINARY) { return key; } //keys are their own sort keys
+  makeSortKey(collation, key, sortKey);
+  return sortKey;
+}
+
+bool BTreeIndex::pastRange(const char* key) {
+  if(prefixScan) {
+    return strncmp(key, prefixVal, prefixLen) > 0;
+  }
+  return strncmp(key, highVal, STRINGSIZE) > 0;
+}
+
+bool BTreeIndex::isTombstone(LeafNode* leaf, int slot) {
+  return (leaf->tombstones[slot / 8] >> (slot % 8)) & 1;
+}
+
+bool BTreeIndex::compactLeaf(LeafNode* leaf) {
+  if(leaf->numTombstones == 0) { return false; }
+  int numKeys = getLeafLength(leaf);
+  int numLive = 0;
+  for(int i = 0; i < numKeys; i++) { //shift the live entries down over the dead ones
+    if(isTombstone(leaf, i)) { continue; }
+    if(numLive != i) {
+      memcpy(leaf->keyArray[numLive], leaf->keyArray[i], STRINGSIZE);
+      leaf->ridArray[numLive] = leaf->ridArray[i];
+      leaf->expiryArray[numLive] = leaf->expiryArray[i];
+    }
+    numLive++;
+  }
+  for(int i = numLive; i < numKeys; i++) {
+    memset(leaf->keyArray[i], 0, STRINGSIZE);
+    leaf->ridArray[i].page_number = Page::INVALID_NUMBER;
+    leaf->ridArray[i].slot_number = Page::INVALID_SLOT;
+    leaf->expiryArray[i] = NO_EXPIRY;
+  }
+  leaf->numTombstones = 0;
+  memset(leaf->tombstones, 0, sizeof(leaf->tombstones));
+  return true;
+}
+
+bool BTreeIndex::isLive(LeafNode* leaf, int slot, const uint32_t now) {
+  uint32_t expiry = leaf->expiryArray[slot];
+  return !isTombstone(leaf, slot) && (expiry == NO_EXPIRY || expiry > now);
+}
+
+uint32_t BTreeIndex::leafExpiryBound(LeafNode* leaf) {
+  uint32_t bound = EMPTY_LEAF_EXPIRY;
+  int numKeys = getLeafLength(leaf);
+  for(int i = 0; i < numKeys; i++) {
+    bound = combineExpiry(bound, leaf->expiryArray[i]);
+  }
+  return bound;
+}
+
+int BTreeIndex::nextPredicateMatch(const KeyPredicate& predicate, LeafNode* leaf,
+                                   int from, const int numKeys) {
+#ifdef __SSE2__
+  //a key and the bytes after it fit one load; the last key's run into ridArray
+  static_assert(STRINGSIZE <= 16, "a key must fit one SSE2 register");
+  if(predicate.kind == KEY_MASK) {
+    char pattern[16], mask[16];
+    memset(pattern, 0, 16);
+    memset(mask, 0, 16);
+    memcpy(pattern, predicate.pattern, STRINGSIZE);
+    memcpy(mask, predicate.mask, STRINGSIZE);
+    __m128i patternBytes = _mm_loadu_si128((const __m128i*) pattern);
+    __m128i maskBytes = _mm_loadu_si128((const __m128i*) mask);
+    for(; from < numKeys; from++) {
+      __m128i key = _mm_loadu_si128((const __m128i*) leaf->keyArray[from]);
+      __m128i equal = _mm_cmpeq_epi8(_mm_and_si128(key, maskBytes), patternBytes);
+      if((_mm_movemask_epi8(equal) == 0xFFFF) != predicate.negate) { return from; }
+    }
+    return from;
+  }
+  //KEY_CONTAINS: compare the first pattern byte at every position at once,
+  //then check the rest of the pattern where it occurs
+  int len = predicate.patternLen;
+  if(len == 0) { return predicate.negate ? numKeys : from; }
+  __m128i first = _mm_set1_epi8(predicate.pattern[0]);
+  int starts = (1 << (STRINGSIZE - len + 1)) - 1;
+  for(; from < numKeys; from++) {
+    const char* key = leaf->keyArray[from];
+    int candidates = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) key), first)) & starts;
+    bool found = false;
+    while(candidates != 0 && !found) {
+      int i = __builtin_ctz(candidates);
+      found = memcmp(key + i, predicate.pattern, len) == 0;
+      candidates &= candidates - 1;
+    }
+    if(found != predicate.negate) { return from; }
+  }
+  return from;
+#else
+  for(; from < numKeys; from++) {
+    const char* key = leaf->keyArray[from];
+    bool found = false;
+    if(predicate.kind == KEY_MASK) {
+      found = true;
+      for(int i = 0; i < STRINGSIZE && found; i++) {
+        found = (char) (key[i] & predicate.mask[i]) == predicate.pattern[i];
+      }
+    }
+    else {
+      for(int i = 0; i + predicate.patternLen <= STRINGSIZE && !found; i++) {
+        found = memcmp(key + i, predicate.pattern, predicate.patternLen) == 0;
+      }
+    }
+    if(found != predicate.negate) { return from; }
+  }
+  return from;
+#endif
+}
+
+uint32_t BTreeIndex::biasedIntegerKey(const char* sortKey) {
+  uint32_t value = 0;
+  for(int i = 0; i < 8; i++) {
+    char c = sortKey[i];
+    value = (value << 4) | (uint32_t) (c <= '9' ? c - '0' : c - 'a' + 10);
+  }
+  return value;
+}
+
+void BTreeIndex::aggregateLeafRun(LeafNode* leaf, const int from, const int to,
+                                  const uint32_t now, KeyAggregate& aggregate) {
+  //decode the live keys of the run; as the keys are sorted, the first and
+  //last of them are its minimum and maximum
+  uint32_t biased[LEAF_NUM_KEYS];
+  int count = 0;
+  for(int slot = from; slot < to; slot++) {
+    if(isLive(leaf, slot, now)) { biased[count++] = biasedIntegerKey(leaf->keyArray[slot]); }
+  }
+  if(count == 0) { return; }
+  uint64_t sum = 0;
+  int i = 0;
+#ifdef __SSE2__
+  //widen four keys at a time into two 64-bit lanes each and add them up
+  __m128i zero = _mm_setzero_si128();
+  __m128i lanes = zero;
+  for(; i + 4 <= count; i += 4) {
+    __m128i keys = _mm_loadu_si128((const __m128i*) (biased + i));
+    lanes = _mm_add_epi64(lanes, _mm_unpacklo_epi32(keys, zero));
+    lanes = _mm_add_epi64(lanes, _mm_unpackhi_epi32(keys, zero));
+  }
+  uint64_t laneSums[2];
+  _mm_storeu_si128((__m128i*) laneSums, lanes);
+  sum = laneSums[0] + laneSums[1];
+#endif
+  for(; i < count; i++) { sum += biased[i]; }
+  //every key was biased by 2^31
+  int64_t runSum = (int64_t) (sum - ((uint64_t) count << 31));
+  int runMin = (int) (biased[0] ^ 0x80000000u);
+  int runMax = (int) (biased[count - 1] ^ 0x80000000u);
+  if(aggregate.count == 0 || runMin < aggregate.min) { aggregate.min = runMin; }
+  if(aggregate.count == 0 || runMax > aggregate.max) { aggregate.max = runMax; }
+  aggregate.count += count;
+  aggregate.sum += runSum;
+}
+
+void BTreeIndex::skipDeadEntries() {
+  while(currentPageNum != Page::INVALID_NUMBER) {
+    LeafNode* leaf = (LeafNode*) currentPageData;
+    int numKeys = getLeafLength(leaf);
+    while(nextEntry < numKeys) {
+      if(filterScan) {
+        int match = nextPredicateMatch(scanPredicate, leaf, nextEntry, numKeys);
+        //keys are sorted, so a rejected key past the range is the last one skipped
+        if(match > nextEntry && pastRange(leaf->keyArray[match - 1])) {
+          nextEntry = match - 1;
+          return;
+        }
+        nextEntry = match;
+        if(nextEntry == numKeys) { break; }
+      }
+      if(isLive(leaf, nextEntry, scanTime)) { return; }
+      nextEntry++;
+    }
+    //nothing live left in this leaf: move on to its right sibling
+    PageId nextPageNo = leaf->rightSibPageNo;
+    bufferManager->unPinPage(file, currentPageNum, false);
+    currentPageNum = nextPageNo;
+    currentPageData = NULL;
+    nextEntry = 0;
+    if(currentPageNum != Page::INVALID_NUMBER) {
+      readIndexPage(currentPageNum, currentPageData);
+    }
+  }
+}
+
+uint64_t BTreeIndex::traceClock() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void BTreeIndex::traceOp(const uint8_t op, const uint8_t lowOp, const uint8_t highOp,
+                         const uint8_t result, const void* payload, const size_t size) {
+  uint64_t now = traceClock();
+  TraceRecord record;
+  record.deltaMicros = (uint32_t) std::min(now - lastTraceMicros, (uint64_t) UINT32_MAX);
+  record.op = op;
+  record.lowOp = lowOp;
+  record.highOp = highOp;
+  record.result = result;
+  lastTraceMicros = now;
+  fwrite(&record, sizeof(TraceRecord), 1, traceFile);
+  if(size > 0) { fwrite(payload, size, 1, traceFile); }
+}
+
+void BTreeIndex::traceKeys(const uint8_t op, const uint8_t lowOp, const uint8_t highOp,
+                           const uint8_t result, const char* key, const char* highKey) {
+  char keys[2 * STRINGSIZE];
+  copyTraceKey(keys, key);
+  if(highKey != NULL) { copyTraceKey(keys + STRINGSIZE, highKey); }
+  traceOp(op, lowOp, highOp, result, keys, highKey != NULL ? 2 * STRINGSIZE : STRINGSIZE);
+}
+
+void BTreeIndex::traceEntry(const uint8_t op, const char* key, const RecordId rid,
+                            const uint32_t expiry, const uint8_t result) {
+  TraceEntry entry;
+  copyTraceKey(entry.key, key);
+  entry.rid = rid;
+  entry.expiry = traceExpiry(expiry, traceStartExpiry);
+  traceOp(op, 0, 0, result, &entry, sizeof(TraceEntry));
+}
+
+void BTreeIndex::traceUpdateKey(const char* oldKey, const char* newKey, const RecordId rid,
+                                const uint8_t result) {
+  char payload[sizeof(TraceEntry) + STRINGSIZE];
+  TraceEntry entry;
+  copyTraceKey(entry.key, oldKey);
+  entry.rid = rid;
+  entry.expiry = NO_EXPIRY;
+  memcpy(payload, &entry, sizeof(TraceEntry));
+  copyTraceKey(payload + sizeof(TraceEntry), newKey);
+  traceOp(TRACE_UPDATE_KEY, 0, 0, result, payload, sizeof(payload));
+}
+
+void BTreeIndex::copyTraceKey(char* dest, const char* key) {
+  if(collation == INTEGER) {
+    memset(dest, 0, STRINGSIZE);
+    memcpy(dest, key, sizeof(int));
+  }
+  else {
+    strncpy(dest, key, STRINGSIZE); //zero pads keys shorter than STRINGSIZE
+  }
+}
+
+void BTreeIndex::traceLookupBatch(const char* const* keys, const int numKeys, const bool* found) {
+  std::string payload((const char*) &numKeys, sizeof(uint32_t));
+  int numFound = 0;
+  char key[STRINGSIZE];
+  for(int i = 0; i < numKeys; i++) {
+    copyTraceKey(key, keys[i]);
+    payload.append(key, STRINGSIZE);
+    numFound += found[i];
+  }
+  traceOp(TRACE_LOOKUP_BATCH, 0, 0, numFound, payload.data(), payload.size());
+}
+
+void BTreeIndex::traceAggregate(const int lowVal, const Operator lowOp, const int highVal,
+                                const Operator highOp, const int64_t count) {
+  traceKeys(TRACE_AGGREGATE_SCAN, lowOp, highOp, count % 256,
+            (const char*) &lowVal, (const char*) &highVal);
+}
+
+void BTreeIndex::traceFilterScan(const char* lowVal, const Operator lowOp, const char* highVal,
+                                 const Operator highOp, const KeyPredicate& predicate,
+                                 const ScanStatus status) {
+  char payload[2 * STRINGSIZE + sizeof(TracePredicate)];
+  copyTraceKey(payload, lowVal);
+  copyTraceKey(payload + STRINGSIZE, highVal);
+  TracePredicate traced;
+  memset(&traced, 0, sizeof(TracePredicate));
+  traced.kind = predicate.kind;
+  traced.negate = predicate.negate;
+  traced.patternLen = predicate.patternLen;
+  memcpy(traced.pattern, predicate.pattern, STRINGSIZE);
+  memcpy(traced.mask, predicate.mask, STRINGSIZE);
+  memcpy(payload + 2 * STRINGSIZE, &traced, sizeof(TracePredicate));
+  traceOp(TRACE_START_FILTER_SCAN, lowOp, highOp, status, payload, sizeof(payload));
+}
+
+void BTreeIndex::dropPage(const PageId pageNum) {
+  if(isShared()) { //shared readers may still follow links to it
+    retiredPages.push_back(pageNum);
+    return;
+  }
+  bufferManager->disposePage(file, pageNum);
+  forgetPage(pageNum);
+}
+
+void BTreeIndex::disposeRetiredPages() {
+  for(size_t i = 0; i < retiredPages.size(); i++) {
+    bufferManager->disposePage(file, retiredPages[i]);
+    forgetPage(retiredPages[i]);
+  }
+  retiredPages.clear();
+}
+
+void BTreeIndex::unPinIndexPage(const PageId pageNum, const bool dirty) {
+  bufferManager->unPinPage(file, pageNum, dirty);
+  if(dirty && isShared()) { sharedDirtyPages.push_back(pageNum); }
+  if(dirty) { bumpPageVersion(pageNum); }
+}
+
+void BTreeIndex::bumpPageVersion(const PageId pageNum) {
+  if(rangeCacheLimit == 0) { return; } //versions only matter to cached results
+  if(pageNum >= pageVersions.size()) { pageVersions.resize(pageNum + 1, 0); }
+  pageVersions[pageNum]++;
+}
+
+void BTreeIndex::publishSharedPages() {
+  if(sharedSegment == NULL || sharedDirtyPages.empty()) { return; }
+  std::vector<PageId>& pages = sharedDirtyPages;
+  std::sort(pages.begin(), pages.end());
+  pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+  if(pages.back() >= sharedSegment->maxPages) {
+    //the write is already applied, so readers are told to stop using the
+    //segment rather than the caller being told the write failed
+    pages.clear();
+    __atomic_store_n(&sharedSegment->invalid, 1, __ATOMIC_RELEASE);
+    disposeRetiredPages();
+    return;
+  }
+  //make every version odd before copying any page, so a reader that sees
+  //one of the new pages cannot validate a path through the old ones
+  for(size_t i = 0; i < pages.size(); i++) {
+    SharedPageSlot* slot = sharedSlot(sharedSegment, pages[i]);
+    __atomic_store_n(&slot->version, slot->version + 1, __ATOMIC_RELAXED);
+  }
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  for(size_t i = 0; i < pages.size(); i++) {
+    Page* page;
+    bufferManager->readPage(file, pages[i], page);
+    touchPage(pages[i]);
+    memcpy(sharedSlot(sharedSegment, pages[i])->data, page, Page::SIZE);
+    bufferManager->unPinPage(file, pages[i], false);
+  }
+  for(size_t i = 0; i < pages.size(); i++) {
+    SharedPageSlot* slot = sharedSlot(sharedSegment, pages[i]);
+    __atomic_store_n(&slot->version, slot->version + 1, __ATOMIC_RELEASE);
+  }
+  pages.clear();
+}
+
+void BTreeIndex::collectPages(PageId pageNum, std::vector<PageId>& pages) {
+  NonLeafNode* node = readNonLeafNode(file, pageNum);
+  pages.push_back(pageNum);
+  int numChildren = getNonLeafLength(node) + 1;
+  for(int i = 0; i < numChildren; i++) {
+    if(node->level == 1) { pages.push_back(node->pageNoArray[i]); }
+    else { collectPages(node->pageNoArray[i], pages); }
+  }
+  bufferManager->unPinPage(file, pageNum, false);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::metaInfo
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::metaInfo(IndexMetaInfo& outInfo) {
+  outInfo = *getHeader();
+  bufferManager->unPinPage(file, headerPageNum, false);
+}
+
 IndexMetaInfo* BTreeIndex::getHeader() {
   Page* headerPage;
   bufferManager->readPage(file, headerPageNum, headerPage);
+  touchPage(headerPageNum);
   return (IndexMetaInfo*) headerPage;
 }
 
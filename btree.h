@@ -12,6 +12,12 @@
 #include <string>
 #include "string.h"
 #include <sstream>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <stdint.h>
+#include <stdio.h>
 
 #include "include/types.h"
 #include "include/page.h"
@@ -20,7 +26,10 @@
 
 //Uncomment next line to reduce size of nodes and make prints more readable
 // DEBUG mode uses just 8 keys in a node making splits more frequent
+// (compiling with -DPRODUCTION_FANOUT leaves it off without editing this line)
+#ifndef PRODUCTION_FANOUT
 #define DEBUG
+#endif
 
 namespace wiscdb
 {
@@ -37,11 +46,136 @@ enum Operator
   GT    /* Greater Than */
 };
 
+/**
+ * @brief How an insert treats an entry that already has the same key.
+ */
+enum InsertMode
+{
+  INSERT_ANY,         /* Always insert, allowing duplicate keys */
+  INSERT_IF_ABSENT,   /* Insert only if no entry has the key */
+  INSERT_OR_REPLACE   /* Replace the RecordId of an existing entry */
+};
+
+/**
+ * @brief Outcome of the non-throwing scan calls, e.g.
+ * BTreeIndex::tryScanNext(). Each status other than SCAN_OK stands for the
+ * exception the throwing counterpart raises.
+ */
+enum ScanStatus
+{
+  SCAN_OK,               /* Scan started, or an entry was returned */
+  SCAN_NO_SUCH_KEY,      /* No key satisfies the scan criteria */
+  SCAN_COMPLETED,        /* No more entries satisfy the scan criteria */
+  SCAN_BAD_OPCODES,      /* lowOp or highOp is not one of its expected values */
+  SCAN_BAD_RANGE,        /* lowVal > highVal */
+  SCAN_NOT_INITIALIZED   /* No scan has been started */
+};
+
 /**
  * @brief Size of String key prefix.
  */
 const  int STRINGSIZE = 10;
 
+/**
+ * @brief Orders in which an index can keep its keys. Each key is converted
+ * once, on insert and on probe, into an order-preserving binary sort key
+ * that is stored in the nodes, so searches and scans always compare plain
+ * bytes whatever the collation.
+ */
+enum Collation
+{
+  BINARY,   /* Byte order of the key itself */
+  NOCASE,   /* Byte order with ASCII letters folded to lower case */
+  LOCALE,   /* LC_COLLATE order of the process locale, via strxfrm(); see makeSortKey() */
+  INTEGER   /* Order of the native int the key points to */
+};
+
+/**
+ * @brief Bytes of a key that are fed to strxfrm() for LOCALE sort keys.
+ */
+const int COLLATION_SOURCE_SIZE = 64;
+
+/**
+ * @brief Converts a key into its sort key under a collation: comparing
+ * sort keys with strncmp() gives the collation's order. LOCALE sort keys
+ * depend on the LC_COLLATE locale in effect, which must stay the same for
+ * the life of an index. They are also cut to STRINGSIZE bytes, and a
+ * strxfrm() transform is usually several times longer than its source, so
+ * only the first few characters of a key decide its order: keys that share
+ * them compare equal, lookups match either, and ranges cannot separate them.
+ * A unique index therefore cannot use LOCALE. An INTEGER key is the sizeof(int) bytes of an int,
+ * as stored in the record; its sort key is the eight lower case hex digits
+ * of the value with its sign bit flipped, which hold no zero byte.
+ * @param collation  collation to convert for
+ * @param key        key as found in the tuple, char string
+ * @param sortKey    receives the STRINGSIZE bytes of the sort key
+ */
+void makeSortKey(const Collation collation, const char* key, char* sortKey);
+
+/**
+ * @brief COUNT, SUM, MIN and MAX of the keys of an INTEGER index in a
+ * range, see BTreeIndex::aggregateScan().
+ */
+struct KeyAggregate{
+  int64_t count;
+  int64_t sum;
+
+  /**
+   * Smallest and largest key; 0 when count is 0.
+   */
+  int min;
+  int max;
+};
+
+/**
+ * @brief Kinds of key predicates, see KeyPredicate.
+ */
+enum KeyPredicateKind
+{
+  KEY_MASK,     /* key & mask == pattern & mask, byte by byte */
+  KEY_CONTAINS  /* The first patternLen bytes of pattern occur in the key */
+};
+
+/**
+ * @brief A test on the STRINGSIZE bytes of a key, evaluated on the keys of
+ * a leaf during a scan (see BTreeIndex::startScan()) so that entries it
+ * rejects are skipped without their records being fetched. Keys shorter
+ * than STRINGSIZE are padded with zero bytes, which a KEY_MASK pattern can
+ * match to test where a key ends.
+ */
+struct KeyPredicate{
+  KeyPredicateKind kind;
+
+  /**
+   * Bytes to match, and for KEY_MASK the bits of each key byte compared.
+   */
+  char pattern[STRINGSIZE];
+  unsigned char mask[STRINGSIZE];
+
+  /**
+   * Number of leading pattern bytes a KEY_CONTAINS predicate looks for.
+   */
+  int patternLen;
+
+  /**
+   * True to keep the keys the test rejects instead.
+   */
+  bool negate;
+};
+
+/**
+ * @brief Returns a predicate matching keys that hold len bytes at an
+ * offset, e.g. a suffix of the STRINGSIZE bytes of the key. Bytes past
+ * STRINGSIZE are ignored.
+ */
+KeyPredicate keyBytesPredicate(const int offset, const char* bytes, const int len);
+
+/**
+ * @brief Returns a predicate matching keys that contain the first len
+ * bytes of bytes anywhere in their STRINGSIZE bytes.
+ */
+KeyPredicate keyContainsPredicate(const char* bytes, const int len);
+
 
 /**
  * @brief Number of keys stored in B+Tree leaf / non-leaf for prefix strings.
@@ -51,14 +185,117 @@ const int LEAF_NUM_KEYS = 4;
 const int NON_LEAF_NUM_KEYS = 4;
 #else
 const  int LEAF_NUM_KEYS =  
-  (Page::SIZE - sizeof(PageId)) / (STRINGSIZE + sizeof(RecordId));
-// free bytes - sibling ptr     /    size of one key,rid pair
+  (8 * (Page::SIZE - sizeof(PageId) - 2 * sizeof(int))) / (8 * (STRINGSIZE + sizeof(RecordId) + sizeof(uint32_t)) + 1);
+// free bytes - sibling ptr - tombstone count and padding / size of one key,rid,expiry triple and tombstone bit
 
 const  int NON_LEAF_NUM_KEYS = 
-  (Page::SIZE - sizeof(int) - sizeof(PageId)) / (STRINGSIZE + sizeof(PageId));
-// free bytes - level - extra ptr         /   size of one key, pageid pair  
+  (Page::SIZE - sizeof(int) - sizeof(PageId) - sizeof(uint32_t)) / (STRINGSIZE + sizeof(PageId) + sizeof(uint32_t));
+// free bytes - level - extra ptr and expiry  /   size of one key, pageid, expiry triple  
 #endif
 
+/**
+ * @brief Number of random descents BTreeIndex::sampleEntries() may make per
+ * requested sample before giving up on a (nearly) empty tree.
+ */
+const int MAX_SAMPLE_ATTEMPTS = 1000;
+
+/**
+ * @brief Number of lookups BTreeIndex::lookupBatch() keeps in flight at
+ * once, each waiting on its own prefetched node and holding one pinned
+ * page; larger batches are fed through this many slots.
+ */
+const int LOOKUP_BATCH_WIDTH = 16;
+
+/**
+ * @brief Bytes at the start of a node that are prefetched before a batched
+ * lookup switches away from it (the keys searched first).
+ */
+const int LOOKUP_PREFETCH_BYTES = 256;
+
+/**
+ * @brief Number of key/rid pairs moved per read or write of a sorted run
+ * file, so exports and imports go to disk in large sequential chunks.
+ */
+const int RUN_CHUNK_ENTRIES = 16384;
+
+/**
+ * @brief Magic string identifying a sorted run file.
+ */
+const char RUN_FILE_MAGIC[8] = "BTRUN03";
+
+/**
+ * @brief Layout version of sorted run files, stored after the magic.
+ */
+const uint32_t RUN_FILE_VERSION = 3;
+
+/**
+ * @brief Bytes of the encoded RunFileHeader at the start of a sorted run
+ * file, and of each record after it: key, rid page and slot, expiry.
+ */
+const int RUN_HEADER_BYTES = 8 + 4 + 20 + 4 + 4 + 1 + 1 + 8;
+const int RUN_RECORD_BYTES = STRINGSIZE + 4 + 2 + 4;
+
+/**
+ * @brief Layout version of index files, kept in their meta page. Raised
+ * whenever the layout of any index page changes, so files written by an
+ * older build are refused instead of misread.
+ */
+const uint32_t INDEX_FORMAT_VERSION = 1;
+
+/**
+ * @brief Magic string identifying a hot set file.
+ */
+const char HOT_SET_MAGIC[8] = "BTHOT01";
+
+/**
+ * @brief Most pages a hot set file records.
+ */
+const int HOT_SET_MAX_PAGES = 8192;
+
+/**
+ * @brief Pages of a recorded hot set read by each index call while the
+ * hot set is reloaded after the index is opened.
+ */
+const int HOT_SET_PAGES_PER_CALL = 4;
+
+/**
+ * @brief Share of a leaf's slots that lazy deletes may fill with tombstones
+ * before the leaf is compacted on the spot, in percent.
+ */
+const int TOMBSTONE_COMPACT_PERCENT = 50;
+
+/**
+ * @brief Most RecordIds a single cached range result may hold; longer scan
+ * results are not cached.
+ */
+const int RANGE_CACHE_MAX_RIDS = 4096;
+
+/**
+ * @brief Expiry time of an entry that never expires. Expiry times are in
+ * seconds since the epoch, as returned by expiryClock().
+ */
+const uint32_t NO_EXPIRY = 0;
+
+/**
+ * @brief Max-expiry bound of an empty leaf: it holds nothing that is live
+ * at any time, so the sweeper may drop it.
+ */
+const uint32_t EMPTY_LEAF_EXPIRY = 1;
+
+/**
+ * @brief Current time in the unit of entry expiry times.
+ */
+uint32_t expiryClock();
+
+/**
+ * @brief Combines two max-expiry bounds into one that covers both: the
+ * later time, or NO_EXPIRY if either side may hold entries that never expire.
+ */
+inline uint32_t combineExpiry(const uint32_t a, const uint32_t b) {
+  if(a == NO_EXPIRY || b == NO_EXPIRY) { return NO_EXPIRY; }
+  return a > b ? a : b;
+}
+
 
 
 /**
@@ -69,9 +306,11 @@ class RIDKeyPair{
  public:
   RecordId rid;
   char key[STRINGSIZE]; 
-  void set( RecordId r, const char* k){
+  uint32_t expiry;
+  void set( RecordId r, const char* k, uint32_t e = NO_EXPIRY){
     rid = r;
     strncpy(key,k,STRINGSIZE);
+    expiry = e;
   }
 };
 
@@ -84,9 +323,11 @@ class PageKeyPair{
  public:
   PageId pageNo;
   char key[STRINGSIZE];
+  uint32_t maxExpiry; //bound on the expiry of the entries of a leaf page
   void set( int p, const char* k){
     pageNo = p;
     strncpy(key,k,STRINGSIZE);
+    maxExpiry = NO_EXPIRY;
   }
 };
 
@@ -116,6 +357,189 @@ struct IndexMetaInfo{
    * Page number of root page of the B+ Tree inside the file index file.
    */
   PageId rootPageNo;
+
+  /**
+   * True if the index holds at most one entry per key.
+   */
+  bool unique;
+
+  /**
+   * Collation of the keys.
+   */
+  Collation collation;
+
+  /**
+   * INDEX_FORMAT_VERSION of the build that created the file.
+   */
+  uint32_t formatVersion;
+};
+
+/**
+ * @brief Options used when creating or opening an index. Options that are
+ * recorded in the meta page must match when an existing index is opened.
+*/
+struct IndexOptions{
+  /**
+   * Create a unique index: inserts never add a second entry for a key.
+   * While the index is built from its relation, only the first tuple with
+   * each key is indexed.
+   */
+  bool unique;
+
+  /**
+   * Order in which keys are kept; keys are stored as sort keys of this
+   * collation. LOCALE cannot be combined with unique, as its truncated sort
+   * keys make distinct keys collide (see makeSortKey()).
+   */
+  Collation collation;
+
+  /**
+   * Delete lazily: deleteEntry only marks the entry with a tombstone, and
+   * the space is reclaimed later by compaction and collectGarbage().
+   */
+  bool lazyDeletes;
+
+  /**
+   * Warm-up when an existing index is opened (see BTreeIndex::warmUp()):
+   * read every non-leaf level into the buffer pool, then the first
+   * warmUpLeaves leaves in key order and the pages in warmUpPages, e.g. a
+   * hot set recorded earlier.
+   */
+  bool warmUpInternal;
+  int warmUpLeaves;
+  std::vector<PageId> warmUpPages;
+
+  /**
+   * Keep a hot set: count reads of each page, record the most read pages in
+   * a sidecar file (index name + ".hot") when the index is closed or on
+   * saveHotSet(), and reload the recorded pages when it is opened again.
+   */
+  bool hotSet;
+
+  /**
+   * Keep up to this many non-leaf pages, upper levels first, pinned in the
+   * buffer pool while the index is open (see
+   * BTreeIndex::reserveInternalLevels()), so scans of other indexes sharing
+   * the pool cannot evict them.
+   */
+  int reservedFrames;
+
+  /**
+   * Cache the results of range scans, holding up to this many RecordIds
+   * over all cached results (see BTreeIndex::setRangeCache()); 0 for no
+   * cache.
+   */
+  int rangeCacheRids;
+
+  /**
+   * Percentage of each leaf, 1 to 100, that the bulk loader fills when an
+   * index is imported from a sorted run or merged. Packed leaves split on
+   * the first insert into them; leaving room keeps an index that will
+   * take inserts from splitting every leaf.
+   */
+  int leafFillPercent;
+
+  IndexOptions() : unique(false), collation(BINARY), lazyDeletes(false),
+                   warmUpInternal(false), warmUpLeaves(0), hotSet(false),
+                   reservedFrames(0), rangeCacheRids(0), leafFillPercent(100) {}
+};
+
+/**
+ * @brief Header of a hot set file written by BTreeIndex::saveHotSet(). It
+ * is followed by numPages HotSetEntry records in page number order.
+ */
+struct HotSetHeader{
+  /**
+   * Always HOT_SET_MAGIC.
+   */
+  char magic[8];
+
+  /**
+   * Number of pages recorded.
+   */
+  uint32_t numPages;
+};
+
+/**
+ * @brief A page of a hot set file and how often it was read.
+ */
+struct HotSetEntry{
+  PageId pageNo;
+  uint32_t accesses;
+};
+
+/**
+ * @brief Header of a sorted run file written by BTreeIndex::exportSorted().
+ * It is followed by numRecords records in key order and carries enough
+ * metadata to rebuild the index without its base relation. So that a run
+ * moves between hosts, the header and the records are stored as
+ * fixed-width little-endian fields, in the order given here and without
+ * padding (RUN_HEADER_BYTES and RUN_RECORD_BYTES).
+ */
+struct RunFileHeader{
+  /**
+   * Always RUN_FILE_MAGIC, then RUN_FILE_VERSION.
+   */
+  char magic[8];
+  uint32_t version;
+
+  /**
+   * Name of base relation of the exported index.
+   */
+  char relationName[20];
+
+  /**
+   * Offset of the indexed attribute within each tuple.
+   */
+  int attrByteOffset;
+
+  /**
+   * Size of the key prefix stored in each record (STRINGSIZE).
+   */
+  int keySize;
+
+  /**
+   * True if the exported index was unique.
+   */
+  bool unique;
+
+  /**
+   * Collation of the exported index; the run holds its sort keys.
+   */
+  Collation collation;
+
+  /**
+   * Number of records that follow.
+   */
+  uint64_t numRecords;
+};
+
+/**
+ * @brief A cached range scan result and the pages the scan read, each with
+ * its version at the time. The result stands while every page still has
+ * that version.
+ */
+struct RangeCacheEntry{
+  /**
+   * RecordIds the scan returned, in order.
+   */
+  std::vector<RecordId> rids;
+
+  /**
+   * Pages the scan read and their versions (see BTreeIndex::pageVersions).
+   */
+  std::vector<std::pair<PageId, uint32_t> > pages;
+
+  /**
+   * Earliest expiry of a returned entry, or NO_EXPIRY; the result is stale
+   * from that time on.
+   */
+  uint32_t validUntil;
+
+  /**
+   * Position in the cache's LRU list.
+   */
+  std::list<std::string>::iterator lruPosition;
 };
 
 /*****
@@ -145,6 +569,13 @@ struct NonLeafNode{
    *   non-leaf/leaf nodes in the tree.
    */
   PageId pageNoArray[ NON_LEAF_NUM_KEYS + 1 ];
+
+  /**
+   * In level 1 nodes, for each child leaf: no entry in the leaf expires
+   * later than this, or NO_EXPIRY if some entry may never expire. Lets the
+   * sweeper find fully expired leaves without reading them.
+   */
+  uint32_t maxExpiryArray[ NON_LEAF_NUM_KEYS + 1 ];
 };
 
 /**
@@ -161,90 +592,385 @@ struct LeafNode{
    */
   RecordId ridArray[ LEAF_NUM_KEYS ];
 
+  /**
+   * Expiry time of each entry, or NO_EXPIRY. Expired entries are skipped
+   * by lookups and scans until the sweeper drops their leaf.
+   */
+  uint32_t expiryArray[ LEAF_NUM_KEYS ];
+
   /**
    * Page number of the leaf on the right side.
    * This linking of leaves allows to easily move from one leaf to the 
    * next leaf during index scan.
    */
   PageId rightSibPageNo;
+
+  /**
+   * Number of entries marked deleted in tombstones.
+   */
+  int numTombstones;
+
+  /**
+   * Bit i is set if entry i was deleted lazily; such entries are skipped by
+   * lookups and scans until the leaf is compacted.
+   */
+  unsigned char tombstones[ (LEAF_NUM_KEYS + 7) / 8 ];
 };
 
 /**
- * @brief BTreeIndex class. It implements a B+ Tree index on a single 
- * attribute of a relation. This index supports only one scan at a time.
+ * @brief Key range a leaf covers, taken from the separators passed on the
+ * way down to it: low <= key < high. A missing fence is unbounded.
 */
-class BTreeIndex {
-
- private:
-
+struct LeafFences{
   /**
-   * File object for the index file.
+   * True if the range has a lower bound.
    */
-  File      *file;
+  bool hasLow;
 
   /**
-   * Buffer Manager Instance.
+   * Lower bound (inclusive) of the range.
    */
-  BufferManager *bufferManager;
+  char low[STRINGSIZE];
 
   /**
-   * Page number of meta page.
+   * True if the range has an upper bound.
    */
-  PageId    headerPageNum;
+  bool hasHigh;
 
   /**
-   * page number of root page of B+ tree inside index file.
+   * Upper bound (exclusive) of the range.
    */
-  PageId    rootPageNum;
+  char high[STRINGSIZE];
+};
 
-   /**
-   * Offset of attribute, over which index is built, inside records. 
+/**
+ * @brief State of a bottom-up bulk load. Leaves are packed left to right
+ * and the first key and page number of each packed leaf is remembered so
+ * the non-leaf levels can be built once all leaves are written.
+*/
+struct BulkLoader{
+  /**
+   * Page number of the leaf currently being packed.
    */
-  int       attrByteOffset;
-
-  // ********** MEMBERS SPECIFIC TO SCANNING ************ //
+  PageId leafPageNum;
 
   /**
-   * True if an index scan has been started.
+   * Leaf currently being packed; NULL before the first entry.
    */
-  bool      scanExecuting;
+  LeafNode* leaf;
 
   /**
-   * Index of next entry to be scanned in current leaf being scanned.
-   */ 
-  int       nextEntry;
+   * Number of entries in the leaf currently being packed.
+   */
+  int leafLength;
 
   /**
-   * Page number of current page being scanned.
+   * Number of entries a leaf is packed with before the next one is started.
    */
-  PageId    currentPageNum;
+  int leafCapacity;
 
   /**
-   * Current Page being scanned.
+   * First key and page number of every leaf packed so far.
    */
-  Page      *currentPageData;
+  std::vector<PageKeyPair> leaves;
+};
 
+/**
+ * @brief Position of a sequential walk over the leaf chain of an index,
+ * used to stream entries in key order. The current leaf stays pinned
+ * while the cursor is on it.
+*/
+struct LeafCursor{
   /**
-   * Low STRING value for scan.
+   * Page number of the current leaf; Page::INVALID_NUMBER once the end of
+   * the chain has been reached.
    */
-  const char* lowVal;
+  PageId pageNum;
 
   /**
-   * High STRING value for scan.
+   * Current leaf.
    */
-  const char* highVal;
-  
+  LeafNode* leaf;
+
   /**
-   * Low Operator. Can only be GT(>) or GTE(>=).
+   * Index of the current entry within the current leaf.
    */
-  Operator  lowOp;
+  int slot;
 
   /**
-   * High Operator. Can only be LT(<) or LTE(<=).
+   * Number of entries in the current leaf.
    */
-  Operator  highOp;
+  int length;
 
-  
+  /**
+   * Entries that expired by this time are skipped.
+   */
+  uint32_t now;
+};
+
+struct SharedIndexHeader;
+
+/**
+ * @brief BTreeIndex class. It implements a B+ Tree index on a single 
+ * attribute of a relation. This index supports only one scan at a time.
+*/
+class BTreeIndex {
+
+ private:
+
+  /**
+   * File object for the index file.
+   */
+  File      *file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+  BufferManager *bufferManager;
+
+  /**
+   * Page number of meta page.
+   */
+  PageId    headerPageNum;
+
+  /**
+   * page number of root page of B+ tree inside index file.
+   */
+  PageId    rootPageNum;
+
+   /**
+   * Offset of attribute, over which index is built, inside records. 
+   */
+  int       attrByteOffset;
+
+  /**
+   * True if the index holds at most one entry per key.
+   */
+  bool      unique;
+
+  /**
+   * Collation of the keys, see makeSortKey().
+   */
+  Collation collation;
+
+  /**
+   * True if deletes leave tombstones instead of removing entries.
+   */
+  bool      lazyDeletes;
+
+  // ********** MEMBERS SPECIFIC TO SCANNING ************ //
+
+  /**
+   * True if an index scan has been started.
+   */
+  bool      scanExecuting;
+
+  /**
+   * Index of next entry to be scanned in current leaf being scanned.
+   */ 
+  int       nextEntry;
+
+  /**
+   * Page number of current page being scanned.
+   */
+  PageId    currentPageNum;
+
+  /**
+   * Current Page being scanned.
+   */
+  Page      *currentPageData;
+
+  /**
+   * Low STRING value for scan.
+   */
+  const char* lowVal;
+
+  /**
+   * High STRING value for scan.
+   */
+  const char* highVal;
+  
+  /**
+   * Low Operator. Can only be GT(>) or GTE(>=).
+   */
+  Operator  lowOp;
+
+  /**
+   * High Operator. Can only be LT(<) or LTE(<=).
+   */
+  Operator  highOp;
+
+  /**
+   * True if the current scan is a prefix scan started by startPrefixScan().
+   */
+  bool      prefixScan;
+
+  /**
+   * Number of leading key bytes compared by a prefix scan.
+   */
+  int       prefixLen;
+
+  /**
+   * Zero padded prefix of a prefix scan; also its low value.
+   */
+  char      prefixVal[STRINGSIZE];
+
+  /**
+   * Sort keys of the low and high values of the current scan.
+   */
+  char      lowSortKey[STRINGSIZE];
+  char      highSortKey[STRINGSIZE];
+
+  /**
+   * True if the current scan skips the keys scanPredicate rejects.
+   */
+  bool      filterScan;
+
+  /**
+   * Key predicate of the current scan, with its pattern made a sort key.
+   */
+  KeyPredicate scanPredicate;
+
+  /**
+   * Entries that expired by this time are skipped by the current scan.
+   */
+  uint32_t  scanTime;
+
+  /**
+   * Start of the current scan for the scan__end probe, 0 when no tracer
+   * is attached to it (see btreeProbes.h).
+   */
+  uint64_t  scanStartTime;
+
+  // ********** MEMBERS SPECIFIC TO SHARING ************ //
+
+  /**
+   * Shared memory segment readers map, or NULL if the index is not shared.
+   */
+  SharedIndexHeader *sharedSegment;
+
+  /**
+   * Name of the shared memory segment.
+   */
+  std::string sharedSegmentName;
+
+  /**
+   * Pages written since they were last copied into the shared segment.
+   */
+  std::vector<PageId> sharedDirtyPages;
+
+  /**
+   * Pages dropped from the tree while it is shared. Readers holding an old
+   * copy of a node may still follow a link to one, so they are disposed
+   * only once the segment is no longer updated (see disposeRetiredPages()).
+   */
+  std::vector<PageId> retiredPages;
+
+  /**
+   * Reads nodes of shared indexes with the node helpers below.
+   */
+  friend class SharedIndexReader;
+
+  /**
+   * Times the node helpers on nodes built in memory (nodeBench.cpp).
+   */
+  friend class NodeBench;
+
+  /**
+   * Walks the leaf chain once for many scan cursors (sharedScan.h).
+   */
+  friend class SharedScan;
+
+  // ********** MEMBERS SPECIFIC TO THE HOT SET ************ //
+
+  /**
+   * True if the index keeps a hot set (IndexOptions::hotSet).
+   */
+  bool keepHotSet;
+
+  /**
+   * Reads of each page since the hot set was last saved, by page number.
+   */
+  std::vector<uint32_t> pageAccesses;
+
+  /**
+   * Pages of the recorded hot set in page number order, and the first of
+   * them not yet read back into the buffer pool.
+   */
+  std::vector<PageId> pendingHotPages;
+  size_t nextHotPage;
+
+  // ********** MEMBERS SPECIFIC TO BUFFER USAGE ************ //
+
+  /**
+   * Most non-leaf pages kept pinned, and the pinned ones with their levels.
+   */
+  int reservedFrameLimit;
+  std::vector<std::pair<int, PageId> > reservedPages;
+
+  /**
+   * Pages read or allocated through the buffer pool since the index was
+   * opened, by page number, and their number.
+   */
+  std::vector<bool> touchedPages;
+  int numTouchedPages;
+
+  // ********** MEMBERS SPECIFIC TO THE RANGE CACHE ************ //
+
+  /**
+   * Version of each page by page number, bumped whenever the page is
+   * written or disposed.
+   */
+  std::vector<uint32_t> pageVersions;
+
+  /**
+   * Cached results by rangeCacheKey(), their keys most recently used
+   * first, the RecordIds they hold and the most they may hold.
+   */
+  std::unordered_map<std::string, RangeCacheEntry> rangeCache;
+  std::list<std::string> rangeCacheLru;
+  size_t rangeCacheRids;
+  size_t rangeCacheLimit;
+
+  /**
+   * Cached result the executing scan returns, and its next entry.
+   */
+  const RangeCacheEntry* cachedScan;
+  size_t cachedScanNext;
+
+  /**
+   * True while the executing scan records its result for the cache, the
+   * key it is recorded under and the result so far.
+   */
+  bool recordingScan;
+  std::string recordingKey;
+  RangeCacheEntry recording;
+
+  /**
+   * Scans served from the cache, and scans of the index that were not.
+   */
+  uint64_t rangeCacheHits;
+  uint64_t rangeCacheMisses;
+
+  // ********** MEMBERS SPECIFIC TO TRACING ************ //
+
+  /**
+   * Trace being recorded (see indexTrace.h), or NULL if not tracing.
+   */
+  FILE      *traceFile;
+
+  /**
+   * traceClock() time of the last traced call.
+   */
+  uint64_t  lastTraceMicros;
+
+  /**
+   * expiryClock() time the trace started; expiry times are recorded
+   * relative to it.
+   */
+  uint32_t  traceStartExpiry;
+
+  
  public:
 
   /**
@@ -258,13 +984,59 @@ class BTreeIndex {
    * @param bufMgrIn            Buffer Manager Instance
    * @param attrByteOffset      Offset of attribute, over which index is 
    * to be built, in the record
+   * @param options             Options of the index, such as uniqueness
    * @throws  BadIndexInfoException     If the index file already exists 
    * for the corresponding attribute, but values in metapage(relationName,
-   * attribute byte offset, attribute type etc.) do not match with values 
-   * received through constructor parameters.
+   * attribute byte offset, attribute type, uniqueness etc.) do not match
+   * with values received through constructor parameters, or the options
+   * ask for a unique index with the LOCALE collation.
    */
   BTreeIndex(const std::string & relationName, std::string & outIndexName,
-            BufferManager *bufMgrIn,  const int attrByteOffset);
+            BufferManager *bufMgrIn,  const int attrByteOffset,
+            const IndexOptions & options = IndexOptions());
+
+  /**
+   * BTreeIndex Constructor that restores an index from a sorted run file
+   * written by exportSorted(). The run is fed straight into a bottom-up
+   * leaf packer: no sorting and no per-key descents.
+   *
+   * @param runFileName         Name of the sorted run file to import.
+   * @param outIndexName        Return the name of index file.
+   * @param bufMgrIn            Buffer Manager Instance
+   * @param options             Only leafFillPercent is used; the other
+   * options of the index come from the run.
+   * @throws  FileNotFoundException  If the run file cannot be opened.
+   * @throws  BadIndexInfoException  If the run file is not a sorted run
+   * of this version written with this key size, its keys are out of order
+   * or it does not hold as many records as its header says (no index file
+   * is left behind then), or options.leafFillPercent is out of range.
+   * @throws  FileExistsException    If the index file already exists.
+   */
+  BTreeIndex(const std::string & runFileName, std::string & outIndexName,
+            BufferManager *bufMgrIn, const IndexOptions & options = IndexOptions());
+
+  /**
+   * BTreeIndex Constructor that merges two indexes on the same attribute
+   * of the same relation, e.g. built from its halves, into a new, densely
+   * packed index. Both leaf chains are streamed in key
+   * order through a sorted merge into the bottom-up leaf packer, so the
+   * output is written sequentially and its non-leaf levels are built
+   * bottom-up. On equal keys, entries of the first index come first.
+   * The merged index is not unique, even if both inputs are.
+   *
+   * @param first               First index to merge.
+   * @param second              Second index to merge.
+   * @param mergedIndexName     Name of the index file to create.
+   * @param bufMgrIn            Buffer Manager Instance
+   * @param options             Only leafFillPercent is used.
+   * @throws  BadIndexInfoException  If the two indexes are not on the same
+   * relation and attribute byte offset or do not use the same collation,
+   * or options.leafFillPercent is out of range.
+   * @throws  FileExistsException    If the merged index file already exists.
+   */
+  BTreeIndex(BTreeIndex & first, BTreeIndex & second,
+            const std::string & mergedIndexName, BufferManager *bufMgrIn,
+            const IndexOptions & options = IndexOptions());
   
 
   /**
@@ -286,12 +1058,88 @@ class BTreeIndex {
    * This may continue all the way upto the root causing the root to get
    * split. If root gets split, metapage needs to be changed accordingly.
    * Make sure to unpin pages as soon as you can.
+   * On a unique index an entry whose key is already present is not
+   * inserted; use insertUnique() to learn about the conflict.
    * @param key      Key to insert, char string
    * @param rid      Record ID of a record whose entry is getting
    * inserted into the index.
+   * @param expiresAt  Time (see expiryClock()) after which the entry is no
+   *   longer returned, or NO_EXPIRY
+  **/
+  const void insertEntry(const char* key, const RecordId rid,
+                         const uint32_t expiresAt = NO_EXPIRY);
+
+  /**
+   * Insert <key,rid> only if no entry has the key yet. The key is looked
+   * up first, through every leaf its run of duplicates reaches (expired or
+   * deleted entries with the key can leave a live one on either side of a
+   * split), and inserted with a second descent if it is absent.
+   * @param key          Key to insert, char string
+   * @param rid          Record ID of the record being indexed
+   * @param conflictRid  Record ID of the existing entry, if there is one
+   * @param expiresAt    Expiry time of the entry, or NO_EXPIRY
+   * @return returns true if the entry was inserted, false on a conflict
+  **/
+  bool insertUnique(const char* key, const RecordId rid, RecordId& conflictRid,
+                    const uint32_t expiresAt = NO_EXPIRY);
+
+  /**
+   * Insert <key,rid>, or point an existing entry with the key at rid. The
+   * key is looked up as by insertUnique(); an existing entry is replaced by
+   * deleting it and inserting the new one.
+   * @param key      Key to insert or update, char string
+   * @param rid      Record ID of the record being indexed
+   * @param oldRid   Record ID the existing entry had, if there was one
+   * @param expiresAt  Expiry time of the entry, or NO_EXPIRY; replaces the
+   *   expiry time of an existing entry
+   * @return returns true if an existing entry was replaced
+  **/
+  bool upsert(const char* key, const RecordId rid, RecordId& oldRid,
+              const uint32_t expiresAt = NO_EXPIRY);
+
+
+  /**
+   * Remove the entry <key,rid>. Leaves are not merged when they underflow;
+   * a leaf emptied by deletes stays in the chain and is skipped by scans.
+   * @param key      Key of the entry, char string
+   * @param rid      Record ID of the entry
+   * @return returns true if the entry was found and removed
+  **/
+  bool deleteEntry(const char* key, const RecordId rid);
+
+  /**
+   * Move the entry <oldKey,rid> to newKey, e.g. when the indexed attribute
+   * of a tuple changes. If newKey belongs in the same leaf the entry is
+   * moved in place with a single descent; otherwise it is removed under
+   * the pin of that descent and inserted with one more. On a unique index
+   * the entry is left alone if another live entry already has newKey.
+   * @param oldKey   Current key of the entry, char string
+   * @param newKey   New key of the entry, char string
+   * @param rid      Record ID of the entry
+   * @return returns true if the entry was found and moved
   **/
-  const void insertEntry(const char* key, const RecordId rid);
+  bool updateKey(const char* oldKey, const char* newKey, const RecordId rid);
 
+  /**
+   * Reclaim the space of lazily deleted entries in one batch: compact every
+   * leaf that has tombstones, and merge neighbouring leaves under the same
+   * parent while their live entries fit in one leaf. Neighbours that do
+   * not fit are packed towards the left, which frees room for the next
+   * merge. Non-leaf nodes are not rebalanced. Ends any scan in progress.
+   * @return returns the number of leaves merged away
+  **/
+  int collectGarbage();
+
+  /**
+   * Drop every leaf whose entries have all expired, in bulk: leaves are
+   * picked by the max-expiry bounds kept in their parents, so leaves with
+   * live entries are not read. Expired entries in other leaves stay until
+   * their whole leaf has expired; lookups and scans skip them meanwhile.
+   * Meant to be run periodically, e.g. by the index server. Ends any scan
+   * in progress.
+   * @return returns the number of leaves dropped
+  **/
+  int sweepExpired();
 
   /**
    * Begin a filtered scan of the index.  For instance, if the method is called
@@ -307,13 +1155,75 @@ class BTreeIndex {
    * @param highVal  High value of range, pointer char string
    * @param highOp  High operator (LT/LTE)
    * @throws  BadOpcodesException If lowOp and highOp do not contain one
-   *   of their their expected values 
+   *   of their expected values 
    * @throws  BadScanrangeException If lowVal > highval
    * @throws  NoSuchKeyFoundException If there is no key in the B+ tree 
-   *   that satisfies the scan criteria.
+   *   that satisfies the scan criteria, or only deleted or expired ones.
   **/
   const void startScan(const char* lowVal, const Operator lowOp, const char* highVal, const Operator highOp);
 
+  /**
+   * Begin a filtered scan as startScan() does, reporting failures as a
+   * status instead of an exception; an empty range is the common case on
+   * busy scan paths and costs no unwinding here.
+   * @return SCAN_OK if the scan was started, otherwise SCAN_BAD_OPCODES,
+   *   SCAN_BAD_RANGE or SCAN_NO_SUCH_KEY
+  **/
+  ScanStatus tryStartScan(const char* lowVal, const Operator lowOp,
+                          const char* highVal, const Operator highOp);
+
+  /**
+   * Begin a filtered scan as startScan() does that also skips the entries
+   * whose key fails a predicate. The predicate is tested on the keys of
+   * each leaf as the scan reaches them, so scanNext() only returns
+   * qualifying entries and no record of a rejected key is fetched. The
+   * predicate sees keys as stored, that is as sort keys: under NOCASE its
+   * pattern is folded to lower case, and the LOCALE and INTEGER collations
+   * are refused.
+   * Such scans bypass the range cache, and are traced with their
+   * predicate.
+   * @param predicate  Key test; copied, so it need not outlive the call
+   * @throws  BadOpcodesException  As startScan(), or if the index uses the
+   *   LOCALE or INTEGER collation.
+   * @throws  BadScanrangeException  If lowVal > highval
+   * @throws  NoSuchKeyFoundException  If no live key in the B+ tree is in
+   *   the range and passes the predicate.
+  **/
+  const void startScan(const char* lowVal, const Operator lowOp, const char* highVal,
+                       const Operator highOp, const KeyPredicate& predicate);
+
+  /**
+   * Begin a scan with a key predicate as startScan() does, without throwing.
+   * @return SCAN_OK if the scan was started, otherwise SCAN_BAD_OPCODES,
+   *   SCAN_BAD_RANGE or SCAN_NO_SUCH_KEY
+  **/
+  ScanStatus tryStartScan(const char* lowVal, const Operator lowOp,
+                          const char* highVal, const Operator highOp,
+                          const KeyPredicate& predicate);
+
+
+  /**
+   * Begin a scan of all entries whose key starts with the first len bytes
+   * of prefix, e.g. for name LIKE 'abc%'. The scan is positioned with one
+   * descent, compares only the first len bytes while iterating, and ends
+   * at the first key past the prefix. A len of 0 matches every key and a
+   * len above STRINGSIZE is treated as STRINGSIZE. Entries are returned
+   * with scanNext() and the scan is ended with endScan(), as for startScan().
+   * @param prefix  Prefix to match, char string
+   * @param len     Number of leading bytes of prefix to match
+   * @throws  BadOpcodesException If the index uses the LOCALE or INTEGER
+   *   collation, whose sort keys do not preserve prefixes.
+   * @throws  NoSuchKeyFoundException If no key in the B+ tree starts with
+   *   the prefix.
+  **/
+  const void startPrefixScan(const char* prefix, const int len);
+
+  /**
+   * Begin a prefix scan as startPrefixScan() does, without throwing.
+   * @return SCAN_OK if the scan was started, otherwise SCAN_BAD_OPCODES or
+   *   SCAN_NO_SUCH_KEY
+  **/
+  ScanStatus tryStartPrefixScan(const char* prefix, const int len);
 
   /**
    * Fetch the record id of the next index entry that matches the scan.
@@ -329,6 +1239,14 @@ class BTreeIndex {
   **/
   const void scanNext(RecordId& outRid);  // returned record id
 
+  /**
+   * Fetch the next entry of the scan as scanNext() does, without throwing.
+   * As with scanNext(), the scan is ended once it completes.
+   * @param outRid  RecordId of the next entry, set when SCAN_OK is returned
+   * @return SCAN_OK, SCAN_COMPLETED or SCAN_NOT_INITIALIZED
+  **/
+  ScanStatus tryScanNext(RecordId& outRid);
+
 
   /**
    * Terminate the current scan. Unpin any pinned pages. Reset scan 
@@ -337,6 +1255,216 @@ class BTreeIndex {
   **/
   const void endScan();
 
+  /**
+   * Compute COUNT, SUM, MIN and MAX over the live keys of an INTEGER index
+   * in a range, e.g. for SUM(key) WHERE key BETWEEN a AND b. The range is
+   * walked as a scan would walk it, but each leaf's run of keys in the
+   * range is folded in as one block, and no entry is returned. A scan in
+   * progress is not affected.
+   * @param lowVal  Low value of range
+   * @param lowOp   Low operator (GT/GTE)
+   * @param highVal High value of range
+   * @param highOp  High operator (LT/LTE)
+   * @return the aggregates, with a count of 0 for an empty range
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one
+   *   of their expected values, or the index does not use the
+   *   INTEGER collation
+   * @throws  BadScanrangeException If lowVal > highval
+  **/
+  KeyAggregate aggregateScan(const int lowVal, const Operator lowOp,
+                             const int highVal, const Operator highOp);
+
+  /**
+   * Find the first entry whose key equals the given key.
+   * @param key     Key to look up, char string
+   * @param outRid  RecordId of the matching entry, if one is found
+   * @return returns true if an entry with the key exists
+  **/
+  bool lookup(const char* key, RecordId& outRid);
+
+  /**
+   * Run many lookups at once, interleaving their descents. Up to
+   * LOOKUP_BATCH_WIDTH lookups are in flight as small state machines; at
+   * every node step a lookup prefetches the node it moves to and yields
+   * to the next one, so the cache misses of independent descents overlap
+   * instead of being paid one after another.
+   *
+   * The width is fixed, not taken from numKeys: a batch of any size is run
+   * through LOOKUP_BATCH_WIDTH slots, each taking the next key when its
+   * lookup finishes, so at most that many descents overlap and at most that
+   * many pages are pinned at once. Batches smaller than the width leave
+   * slots idle and overlap fewer misses.
+   * @param keys      Keys to look up
+   * @param numKeys   Number of keys
+   * @param outRids   RecordId of the first matching entry for each key
+   * @param found     Set to whether an entry was found for each key
+  **/
+  void lookupBatch(const char* const* keys, const int numKeys,
+                   RecordId* outRids, bool* found);
+
+  /**
+   * Draw a uniform random sample of index entries without a full scan.
+   * Each sample is a random root-to-leaf descent. At the root it picks one
+   * of the real children uniformly, which scales every entry's chance by
+   * the same factor; below the root it picks a slot uniformly out of the
+   * maximum fanout and restarts when the slot is empty or dead
+   * (acceptance-rejection). Every live entry is equally likely and, as
+   * nodes below the root are at least half full, a sample costs O(height)
+   * page reads on average. Samples are drawn with replacement using
+   * rand(); seed with srand() for repeatable samples.
+   * @param k        Number of entries to sample
+   * @param samples  Sampled key/rid pairs are appended here, with keys as
+   *   stored (sort keys for non-BINARY collations)
+   * @return the number of samples appended: k, or fewer if the tree is
+   *   empty or so nearly empty (or dead) that k * MAX_SAMPLE_ATTEMPTS
+   *   descents did not find k live entries
+   */
+  int sampleEntries(const int k, std::vector<RIDKeyPair>& samples);
+
+  /**
+   * Stream the leaf chain into a compact sorted run file of <key,rid>
+   * pairs, written in chunks of RUN_CHUNK_ENTRIES (see RunFileHeader).
+   * The run can be loaded back with the run file constructor, also on a
+   * host of another byte order.
+   * @param runFileName  Name of the run file to (over)write
+   * @throws  FileNotFoundException  If the run file cannot be created.
+   * @throws  BadIndexInfoException  If writing the run fails, e.g. when
+   *   the disk is full; the run file is then incomplete.
+   */
+  void exportSorted(const std::string & runFileName);
+
+  /**
+   * Let reader processes map the index: copy all of its pages into a new
+   * POSIX shared memory segment (see sharedIndex.h) and, from now on, copy
+   * in the pages changed by every insert, delete and update before the call
+   * returns. Readers open the segment with SharedIndexReader. The segment
+   * is removed when the index is closed.
+   * @param segmentName  Shared memory object name, e.g. "/relA.0"
+   * @param maxPages     Number of page slots. A write that grows the index
+   *   file past this many pages still succeeds, but marks the segment
+   *   invalid: readers then throw, and it is no longer updated. Pages
+   *   emptied by collectGarbage() or sweepExpired() meanwhile are kept
+   *   until then, since readers may still follow links to them.
+   * @throws  BadIndexInfoException  If the segment cannot be created or
+   *   the index does not fit in it.
+   */
+  void shareIndex(const std::string & segmentName, const PageId maxPages);
+
+  /**
+   * Return true while the index is shared with shareIndex() and the
+   * segment is kept up to date.
+   */
+  bool isShared() const;
+
+  /**
+   * Record every insertEntry, insertUnique, upsert, updateKey, deleteEntry,
+   * lookup, lookupBatch, scan and aggregateScan call made from now on, as
+   * it returns, with its keys, operators, outcome and the time since the
+   * previous call, to a binary trace (see
+   * indexTrace.h) that traceReplay can run against a fresh index. Calls
+   * made while the trace is off cost one pointer test.
+   * @param traceFileName  Name of the trace file to (over)write
+   * @throws  FileNotFoundException  If the trace file cannot be created.
+   */
+  void startTrace(const std::string & traceFileName);
+
+  /**
+   * Stop recording and close the trace file, if a trace is being recorded.
+   * Also done when the index is closed.
+   */
+  void stopTrace();
+
+  /**
+   * Record the most read pages of the index, up to HOT_SET_MAX_PAGES, with
+   * their read counts in the hot set file, replacing it. The counts are then
+   * halved, so pages that stop being read age out of later hot sets. Called
+   * when the index is closed; call it periodically too to survive crashes.
+   * Does nothing unless the index was opened with IndexOptions::hotSet.
+   * @return returns the number of pages recorded
+  **/
+  int saveHotSet();
+
+  /**
+   * Read more of the recorded hot set back into the buffer pool. Index
+   * calls read HOT_SET_PAGES_PER_CALL pages each after the index is
+   * opened; call this when idle to finish sooner. A recorded page the file
+   * no longer has means the hot set is stale, and the rest of it is dropped.
+   * @param maxPages most pages to read
+   * @return returns the number of recorded pages still to be read
+  **/
+  int loadHotSetPages(const int maxPages);
+
+  /**
+   * Preload pages into the buffer pool, so the first queries after the
+   * index is opened do not read them cold one at a time: every non-leaf
+   * level top down, then the first numLeaves leaves in key order, then
+   * extraPages. Each batch is read in page number order, after the OS has
+   * been asked to read it ahead in runs of adjacent pages. Pages are left
+   * unpinned, so preloading more pages than the buffer pool holds evicts
+   * the first ones again.
+   * @param internalLevels whether to load the non-leaf levels
+   * @param numLeaves number of leaves to load from the left end of the tree
+   * @param extraPages further pages of this index to load
+   * @return returns the number of pages read
+  **/
+  int warmUp(const bool internalLevels, const int numLeaves, const std::vector<PageId>& extraPages);
+
+  /**
+   * Pin up to maxFrames non-leaf pages in the buffer pool, level by level
+   * from the root, and keep them pinned until the index is closed, releasing
+   * those pinned by an earlier call. Non-leaf pages created by later splits
+   * are pinned too while fewer than maxFrames are, or in place of a pinned
+   * page of a lower level. The frames are taken from the pool the index
+   * shares, so keep maxFrames well below its size.
+   * @param maxFrames most pages to pin; 0 releases every pinned page
+   * @return returns the number of pages pinned
+  **/
+  int reserveInternalLevels(const int maxFrames);
+
+  /**
+   * Return the number of non-leaf pages kept pinned.
+   */
+  int numReservedFrames() const { return reservedPages.size(); }
+
+  /**
+   * Return the number of pages of the index read or allocated through the
+   * buffer pool since it was opened, less those disposed. The pool only
+   * drops an index's pages to reuse their frames or when the index is
+   * closed, so this bounds the frames the index holds, and equals them
+   * until the pool first evicts one of its pages.
+   */
+  int numPagesTouched() const { return numTouchedPages; }
+
+  /**
+   * Copy the index's header page: its relation, attribute offset, root page
+   * and options.
+   * @param outInfo set to the header
+   */
+  void metaInfo(IndexMetaInfo& outInfo);
+
+  /**
+   * Cache the results of range scans started with startScan() or
+   * tryStartScan(), keyed by their bounds. A scan that runs to completion
+   * stores its RecordIds together with the version of every page it read;
+   * a later scan with the same bounds is served from the cache, without
+   * reading a page, while none of those pages has been written since and
+   * none of the returned entries has expired. Results above
+   * RANGE_CACHE_MAX_RIDS are not cached, and the least recently used
+   * results are dropped to keep the cache within maxRids RecordIds, each
+   * result counting one more than it holds. A scan served from the cache
+   * returns the result as it was when cached, even if the index changes
+   * while it is executing; changing the cache size ends such a scan.
+   * @param maxRids most RecordIds held over all results; 0 drops the cache
+   */
+  void setRangeCache(const int maxRids);
+
+  /**
+   * Return the number of scans served from the range cache, and of scans
+   * that were not, since the cache was enabled.
+   */
+  uint64_t numRangeCacheHits() const { return rangeCacheHits; }
+  uint64_t numRangeCacheMisses() const { return rangeCacheMisses; }
+
   /**
    * Optional method for debugging: prints all keys in tree
    */
@@ -368,21 +1496,397 @@ class BTreeIndex {
    * @param splitKey a reference parameter.  This contains no input value
    *   but could be used in case of a split to return the key/PageId pair
    *   to insert in the parent node
+   * @param leafBound a reference parameter. On a split, set to the expiry
+   *   bound of the leaf's remaining left half; splitKey carries the bound
+   *   of the new right half
    * @return returns true if a split occurred
    */
-  bool insertInLeaf(RIDKeyPair krid, PageId pageNum, PageKeyPair& splitKey);
+  bool insertInLeaf(RIDKeyPair krid, PageId pageNum, PageKeyPair& splitKey,
+                    uint32_t& leafBound);
+
+  /**
+   * Shared implementation of insertEntry, insertUnique and upsert
+   * @param key sort key to insert
+   * @param rid RecordId to insert
+   * @param expiry expiry time of the entry, or NO_EXPIRY
+   * @param mode how to treat an existing entry with the same key
+   * @param existingRid a reference parameter. Set to the RecordId of the
+   *   existing entry with the key, if one was found
+   * @return returns true if an existing entry with the key was found
+   */
+  bool insertWithMode(const char* key, const RecordId rid, const uint32_t expiry,
+                      InsertMode mode, RecordId& existingRid);
+
+  /**
+   * Shared implementation of deleteEntry and updateKey
+   * @param key sort key of the entry
+   * @param rid RecordId of the entry
+   * @param expiry a reference parameter. Set to the expiry time the
+   *   removed entry had
+   * @return returns true if the entry was found and removed
+   */
+  bool removeEntry(const char* key, const RecordId rid, uint32_t& expiry);
+
+  /**
+   * Implementation of updateKey
+   * @param oldKey current key of the entry, as passed in
+   * @param newKey new key of the entry, as passed in
+   * @param rid RecordId of the entry
+   * @return returns true if the entry was found and moved
+   */
+  bool moveEntry(const char* oldKey, const char* newKey, const RecordId rid);
+
+  /**
+   * Unpins a page of the index file, remembering it for the shared
+   * segment if it was written
+   * @param pageNum page to unpin
+   * @param dirty true if the page was written
+   */
+  void unPinIndexPage(const PageId pageNum, const bool dirty);
+
+  /**
+   * Bumps the version of a page that was written or disposed, which makes
+   * cached range results that read it stale
+   * @param pageNum page number of the page
+   */
+  void bumpPageVersion(const PageId pageNum);
+
+  /**
+   * Returns the range cache key of scan bounds, given as sort keys
+   */
+  static std::string rangeCacheKey(const char* lowVal, const Operator lowOp,
+                                   const char* highVal, const Operator highOp);
+
+  /**
+   * Returns the cached result for a key, moved to the front of the LRU
+   * list, or NULL if there is none or it is stale; stale results are dropped
+   */
+  const RangeCacheEntry* findCachedRange(const std::string& key);
+
+  /**
+   * Stores the result of the scan that just completed in the range cache
+   * and stops recording
+   */
+  void storeRecordedRange();
+
+  /**
+   * Drops a cached result
+   * @param it position of the result in rangeCache
+   */
+  void dropCachedRange(std::unordered_map<std::string, RangeCacheEntry>::iterator it);
+
+  /**
+   * Checks whether an entry of a leaf was deleted lazily
+   * @param leaf Pointer to the leaf
+   * @param slot index of the entry
+   * @return true if the entry has a tombstone
+   */
+  static bool isTombstone(LeafNode* leaf, int slot);
+
+  /**
+   * Checks whether an entry of a leaf is visible: neither deleted lazily
+   * nor expired
+   * @param leaf Pointer to the leaf
+   * @param slot index of the entry
+   * @param now entries that expired by this time are not live
+   * @return true if the entry is live
+   */
+  static bool isLive(LeafNode* leaf, int slot, const uint32_t now);
+
+  /**
+   * Finds the first key of a leaf from a slot on that passes a predicate,
+   * testing the keys with SSE2 where available: each key is loaded as 16
+   * bytes, its STRINGSIZE bytes and the start of the next key, which the
+   * mask discards
+   * @param predicate the key test
+   * @param leaf Pointer to the leaf
+   * @param from first slot to test
+   * @param numKeys number of keys in the leaf
+   * @return the slot of the first passing key, or numKeys if there is none
+   */
+  static int nextPredicateMatch(const KeyPredicate& predicate, LeafNode* leaf,
+                                int from, const int numKeys);
+
+  /**
+   * Returns the value of an INTEGER sort key with its sign bit flipped
+   */
+  static uint32_t biasedIntegerKey(const char* sortKey);
+
+  /**
+   * Folds the live keys of a leaf in slots [from, to), which are in the
+   * range of an aggregate scan, into its aggregates; the keys are summed
+   * with SSE2 where available
+   * @param leaf Pointer to the leaf
+   * @param from first slot of the run
+   * @param to slot past the run
+   * @param now entries that expired by this time are not live
+   * @param aggregate receives the run's keys
+   */
+  static void aggregateLeafRun(LeafNode* leaf, const int from, const int to,
+                               const uint32_t now, KeyAggregate& aggregate);
+
+  /**
+   * Latest expiry of the entries in a leaf, as kept for it in its parent
+   * @param leaf Pointer to the leaf
+   * @return NO_EXPIRY if an entry never expires, EMPTY_LEAF_EXPIRY for an
+   *   empty leaf
+   */
+  static uint32_t leafExpiryBound(LeafNode* leaf);
+
+  /**
+   * Removes the entries with tombstones from a leaf, shifting the live ones
+   * down. Leaves are compacted before entries are inserted or moved, so
+   * only lookups and scans ever have to step over tombstones
+   * @param leaf Pointer to the leaf
+   * @return true if any entry was removed
+   */
+  bool compactLeaf(LeafNode* leaf);
+
+  /**
+   * Recursive helper for collectGarbage
+   * @param pageNum PageId of a non-leaf node
+   * @return number of leaves merged away below the node
+   */
+  int collectGarbageInSubtree(PageId pageNum);
+
+  /**
+   * Recursive helper for sweepExpired
+   * @param pageNum PageId of a non-leaf node
+   * @param now time the sweep runs at
+   * @param lastLeaf a reference parameter. The last leaf kept so far in
+   *   key order, whose right sibling link is fixed when the leaf after it
+   *   is dropped; Page::INVALID_NUMBER before the first
+   * @return number of leaves dropped below the node
+   */
+  int sweepSubtree(PageId pageNum, const uint32_t now, PageId& lastLeaf);
+
+  /**
+   * Removes child i and the separator next to it from a non-leaf: the one
+   * on its left, or for the first child the one on its right
+   * @param node Pointer to the non-leaf
+   * @param i index of the child
+   */
+  void removeChild(NonLeafNode* node, int i);
+
+  /**
+   * Moves the scan past entries that are not live or that the scan's key
+   * predicate rejects, onto the next entry to return, a key past the
+   * range, or to the end of the leaf chain
+   */
+  void skipDeadEntries();
+
+  /**
+   * Copies the pages written since the last call into the shared segment,
+   * as one seqlock write so readers see all of them or none
+   */
+  void publishSharedPages();
+
+  /**
+   * Drops a page that is no longer in the tree: disposes it, or retires it
+   * while readers of the shared segment may still reach it
+   * @param pageNum page number of the page
+   */
+  void dropPage(const PageId pageNum);
+
+  /**
+   * Disposes the retired pages, once the shared segment is torn down or
+   * marked invalid and no reader copies a slot any more
+   */
+  void disposeRetiredPages();
+
+  /**
+   * Recursive helper for shareIndex; collects the pages of a subtree
+   * @param pageNum PageId of a non-leaf node
+   * @param pages the node's page and those of its descendants are appended
+   */
+  void collectPages(PageId pageNum, std::vector<PageId>& pages);
+
+  /**
+   * Converts a key passed to the public interface into the sort key it is
+   * stored as
+   * @param key key as passed in, char string
+   * @param sortKey buffer of STRINGSIZE bytes for the converted key
+   * @return returns key itself for BINARY indexes, sortKey otherwise
+   */
+  const char* sortKeyFor(const char* key, char* sortKey);
 
   /**
    * Recursive helper method for searching an internal node of the tree
    * @param currPid PageId of non-leaf node page
+   * @return false, with the scan ended, if no entry satisfies the scan
+   *   criteria
+   */
+  bool findInSubtree(PageId currPid); 
+
+  /**
+   * Positions a scan whose bounds are set on its first entry
+   * @return SCAN_OK, or SCAN_NO_SUCH_KEY with the scan ended if no entry
+   *   satisfies the scan criteria
+   */
+  ScanStatus positionScan();
+
+  /**
+   * Bodies of tryStartScan, tryStartPrefixScan and tryScanNext, which
+   * trace the calls around them
    */
-  void findInSubtree(PageId currPid); 
+  ScanStatus startScanUntraced(const char* lowVal, const Operator lowOp,
+                               const char* highVal, const Operator highOp,
+                               const KeyPredicate* predicate);
+  ScanStatus startPrefixScanUntraced(const char* prefix, const int len);
+  ScanStatus scanNextUntraced(RecordId& outRid);
+
+  /**
+   * Ends the current scan, which must be executing, without tracing the
+   * call as endScan() does
+   */
+  void closeScan();
+
+  /**
+   * Throws the exception a scan status other than SCAN_OK stands for
+   * @param status status returned by one of the non-throwing scan calls
+   */
+  static void throwScanStatus(ScanStatus status);
 
     /**
    * Recursive helper method for searching in a leaf node of the tree
    * @param currPid PageId of non-leaf node page
    */
   void findInLeaf(PageId currPid, RecordId& result); 
+
+  /**
+   * Helper for descending from the root to the leaf covering a key
+   * @param key key being searched for
+   * @param fences if not NULL, set to the key range the leaf covers
+   * @param firstDuplicate if true, go left of separators equal to the key, to
+   *        the first leaf that may hold a duplicate of it; callers looking
+   *        for one particular entry then walk right through the siblings
+   * @return returns the PageId of the leaf
+   */
+  PageId findLeafPage(const char* key, LeafFences* fences, bool firstDuplicate);
+
+  /**
+   * Helper for finding the first live entry with a key. Descends to the
+   * first leaf that may hold the key and walks right while the run of
+   * equal keys may go on, as expired or deleted duplicates can push live
+   * ones into either side of a split.
+   * @param key sort key being searched for
+   * @param now entries that expired by this time are ignored
+   * @param pageNum set to the leaf holding the entry
+   * @param slot set to the slot of the entry, or -1
+   * @return returns the leaf holding the entry, left pinned, or NULL if no
+   *   live entry has the key
+   */
+  LeafNode* findLiveEntry(const char* key, const uint32_t now, PageId& pageNum, int& slot);
+
+  /**
+   * Helper for telling whether a run of keys equal to a key may go on in
+   * the right sibling of a leaf that did not hold a live one
+   * @param leaf LeafNode that was searched
+   * @param key key being searched for
+   * @return returns true if the leaf is empty or its last key is the key
+   */
+  static bool leafEndsInKey(LeafNode* leaf, const char* key);
+
+  /**
+   * Removes an entry from a leaf, shifting the entries after it
+   * @param leaf Pointer to leaf being removed from
+   * @param slot index of the entry to remove
+   */
+  void removeFromLeaf(LeafNode* leaf, int slot);
+
+  /**
+   * Deletes the entry in a slot as deleteEntry does: marks it with a
+   * tombstone on a lazy index, compacting once enough slots are dead, or
+   * removes it
+   * @param leaf Pointer to leaf being deleted from
+   * @param slot index of the entry to delete
+   */
+  void deleteFromLeaf(LeafNode* leaf, int slot);
+
+  /**
+   * Helper for routing a key through a non-leaf node
+   * @param node NonLeafNode to route through
+   * @param key key being searched for
+   * @return returns the index in pageNoArray of the child covering the key
+   */
+  static int findChildIndex(NonLeafNode* node, const char* key);
+
+  /**
+   * Helper for finding a key within a leaf
+   * @param leaf LeafNode to search
+   * @param key key being searched for
+   * @param now entries that expired by this time are ignored
+   * @return returns the slot of the first live entry equal to the key, or -1
+   */
+  static int findKeyInLeaf(LeafNode* leaf, const char* key, const uint32_t now);
+
+  /**
+   * Recursive helper method for sampleEntries; makes one random descent
+   * @param pageNum PageId of the non-leaf node to descend from
+   * @param sample a reference parameter. Contains the sampled pair if the
+   *   descent was accepted
+   * @param isRoot whether pageNum is the root, whose real children are
+   *   picked from directly instead of by rejection
+   * @return returns true if the descent reached an entry, false if it was
+   *   rejected on an empty slot
+   */
+  bool sampleInSubtree(PageId pageNum, RIDKeyPair& sample, const bool isRoot);
+
+  /**
+   * Helper for finding the first leaf of the leaf chain
+   * @return returns the PageId of the leftmost leaf
+   */
+  PageId findLeftmostLeaf();
+
+  /**
+   * Positions a cursor on the first entry of the leaf chain, skipping
+   * empty leaves
+   * @param cursor cursor to position; its leaf is left pinned
+   */
+  void openLeafCursor(LeafCursor& cursor);
+
+  /**
+   * Moves a cursor to the next entry of the leaf chain, unpinning leaves
+   * it is done with
+   * @param cursor cursor to advance
+   */
+  void advanceLeafCursor(LeafCursor& cursor);
+
+  /**
+   * Skips a cursor over empty leaves until it is on an entry or past the
+   * end of the chain
+   * @param cursor cursor whose pageNum names the next leaf to examine
+   */
+  void settleLeafCursor(LeafCursor& cursor);
+
+  /**
+   * Allocates and fills in the header page of a newly created index file
+   * @param relationName name of the base relation to record in the header
+   */
+  void createHeader(const std::string & relationName);
+
+  /**
+   * Bulk load helper that starts packing leaves into an empty index
+   * @param loader bulk load state to initialize
+   * @param leafFillPercent percentage of each leaf to fill, 1 to 100
+   */
+  void bulkLoadBegin(BulkLoader& loader, const int leafFillPercent);
+
+  /**
+   * Bulk load helper that appends the next entry in key order to the
+   * leaf being packed, starting a new leaf when it holds leafCapacity
+   * @param loader bulk load state
+   * @param krid key, record id pair to append; must not sort before the
+   *   previously appended pair
+   */
+  void bulkLoadAppend(BulkLoader& loader, const RIDKeyPair& krid);
+
+  /**
+   * Bulk load helper that finishes the last leaf, builds the non-leaf
+   * levels bottom-up and points the header at the new root
+   * @param loader bulk load state
+   */
+  void bulkLoadFinish(BulkLoader& loader);
     
   /**
    * Recursive helper method for printing out contents of tree
@@ -431,47 +1935,188 @@ class BTreeIndex {
    */
   LeafNode* readLeafNode(File *fptr, PageId &pageNo);
 
+  /**
+   * Reads a page of the index through the buffer manager, firing the
+   * page__read probe
+   * @param pageNum Page number of the page to read
+   * @param page a reference parameter. Set to the pinned page
+   */
+  void readIndexPage(const PageId pageNum, Page*& page);
+
+  /**
+   * Reads the hot set file, if there is one, into pendingHotPages and asks
+   * the OS to read those pages ahead. Pages past the end of the index file
+   * are left out.
+   */
+  void readHotSet();
+
+  /**
+   * Reads a few pages of the recorded hot set, if any are left, on behalf
+   * of an index call
+   */
+  void continueHotSetLoad();
+
+  /**
+   * Drops a disposed page from the hot set
+   * @param pageNum page number of the page
+   */
+  void forgetPage(const PageId pageNum);
+
+  /**
+   * Pins a non-leaf page for reserveInternalLevels() if fewer than the
+   * limit are pinned, or in place of a pinned page of a lower level
+   * @param pageNum page number of the page
+   * @param level level of the page above the leaves
+   */
+  void reservePage(const PageId pageNum, const int level);
+
+  /**
+   * Unpins every page pinned by reserveInternalLevels()
+   */
+  void releaseReservedPages();
+
+  /**
+   * Counts a page read or allocated through the buffer pool for
+   * numPagesTouched()
+   * @param pageNum page number of the page
+   */
+  void touchPage(const PageId pageNum);
+
+  /**
+   * Reads pages through the buffer manager in page number order and
+   * unpins them again, for warmUp()
+   * @param pages pages to read; sorted in place
+   * @return returns the number of pages read
+   */
+  int loadPages(std::vector<PageId>& pages);
+
+  /**
+   * Asks the OS to read pages of the index file ahead, one request per run
+   * of adjacent pages. Does nothing if the file cannot be opened directly.
+   * @param pages pages about to be read, sorted by page number
+   */
+  void readAhead(const std::vector<PageId>& pages);
+
+  /**
+   * Monotonic time in microseconds for trace records
+   */
+  static uint64_t traceClock();
+
+  /**
+   * Appends a record and its payload to the trace
+   * @param op a TraceOp
+   * @param lowOp,highOp,result fields of the TraceRecord
+   * @param payload bytes following the record
+   * @param size number of payload bytes
+   */
+  void traceOp(const uint8_t op, const uint8_t lowOp, const uint8_t highOp,
+               const uint8_t result, const void* payload, const size_t size);
+
+  /**
+   * Traces a call whose payload is a key, or a key and a high key
+   * @param highKey second key, or NULL for none
+   */
+  void traceKeys(const uint8_t op, const uint8_t lowOp, const uint8_t highOp,
+                 const uint8_t result, const char* key, const char* highKey);
+
+  /**
+   * Traces an insert or delete of an entry
+   */
+  void traceEntry(const uint8_t op, const char* key, const RecordId rid,
+                  const uint32_t expiry, const uint8_t result);
+
+  /**
+   * Traces an updateKey() call: the entry under its old key, then the new key
+   */
+  void traceUpdateKey(const char* oldKey, const char* newKey, const RecordId rid,
+                      const uint8_t result);
+
+  /**
+   * Copies a key into a trace payload, zero padded to STRINGSIZE bytes:
+   * the bytes of the int for INTEGER indexes, the string otherwise
+   */
+  void copyTraceKey(char* dest, const char* key);
+
+  /**
+   * Traces a lookupBatch() call and how many of its keys were found
+   */
+  void traceLookupBatch(const char* const* keys, const int numKeys, const bool* found);
+
+  /**
+   * Traces an aggregateScan() call and how many keys it counted
+   */
+  void traceAggregate(const int lowVal, const Operator lowOp, const int highVal,
+                      const Operator highOp, const int64_t count);
+
+  /**
+   * Traces a tryStartScan() call with a key predicate, the predicate
+   * recorded after the bounds so a replay filters the same way
+   */
+  void traceFilterScan(const char* lowVal, const Operator lowOp, const char* highVal,
+                       const Operator highOp, const KeyPredicate& predicate,
+                       const ScanStatus status);
+
   /**
    * Helper for determining whether leaf is at capacity or not
    * @param leaf Pointer to leaf whose capactiy is being checked
    * @return returns true if the leaf still has room for more entries
    */
-  bool isRoomyLeaf(LeafNode* leaf);
+  static bool isRoomyLeaf(LeafNode* leaf);
 
   /**
    * Helper for determining whether a non-leaf is at capactiy or not
    * @param leaf Pointer to leaf whose capacity is being checked
    * @return returns true if the non-leaf still has room for more keys
    */
-  bool isRoomyNonLeaf(NonLeafNode* node);
+  static bool isRoomyNonLeaf(NonLeafNode* node);
 
   /**
    * Inserts a key, record id pair into a leaf
    * @param leaf Pointer to leaf being inserted into
    * @param krid Pair of key, record id for index storing to insert into leaf
    */
-  void insertInRoomyLeaf(LeafNode* leaf, RIDKeyPair krid);
+  static void insertInRoomyLeaf(LeafNode* leaf, RIDKeyPair krid);
 
   /**
    * Inserts a key, page id pair into a non-leaf
    * @param leaf Pointer to leaf being inserted into
    * @param krid Pair of key, page id for index storing to insert into leaf
    */
-  void insertInRoomyNonLeaf(NonLeafNode* node, PageKeyPair pageKey);
+  static void insertInRoomyNonLeaf(NonLeafNode* node, PageKeyPair pageKey);
+
+  /**
+   * Splits a full leaf, moving its upper half into an empty leaf, and
+   * inserts a pair into whichever of the two it belongs in
+   * @param leaf Pointer to the full leaf
+   * @param newLeaf Pointer to the empty leaf right of it
+   * @param krid Pair of key, record id to insert
+   */
+  static void splitLeaf(LeafNode* leaf, LeafNode* newLeaf, const RIDKeyPair& krid);
+
+  /**
+   * Splits a full non-leaf, moving its upper half into an empty non-leaf,
+   * and inserts a pair into whichever of the two it belongs in
+   * @param node Pointer to the full non-leaf
+   * @param newNode Pointer to the empty non-leaf right of it
+   * @param pageKey Pair of key, page id to insert
+   * @param midKey receives the STRINGSIZE bytes of the key pushed up
+   */
+  static void splitNonLeaf(NonLeafNode* node, NonLeafNode* newNode,
+                           const PageKeyPair& pageKey, char* midKey);
 
   /**
    * Obtains the number of keys in a non-leaf node
    * @param node NonLeafNode pointer to check length of
    * @return returns the number of keys in the non-leaf node
    */
-  int getNonLeafLength(NonLeafNode* node);
+  static int getNonLeafLength(NonLeafNode* node);
 
   /**
    * Obtains the number of keys in a leaf node
    * @param node LeafNode pointer to check length of
    * @return returns the number of keys in the leaf node
    */
-  int getLeafLength(LeafNode* node);
+  static int getLeafLength(LeafNode* node);
 
   /**
    * Checks whether the key is within the search range provided by the user
@@ -481,6 +2126,20 @@ class BTreeIndex {
    */
   bool matchRange(const char* key);
 
+  /**
+   * Checks whether a key is within a range given by its bounds
+   * @return true if the key fits both bounds
+   */
+  static bool keyInRange(const char* key, const char* lowVal, const Operator lowOp,
+                         const char* highVal, const Operator highOp);
+
+  /**
+   * Checks whether the key sorts after every key the current scan can match
+   * @param key pointer to char string that is the key to be checked
+   * @return true if no key at or after this one can be in the scan range
+   */
+  bool pastRange(const char* key);
+
   /**
    * Obtains the header page for the specified index. A higher-level function
    * has to unpin the header page after it is done using it
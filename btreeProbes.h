@@ -0,0 +1,101 @@
+/**
+ * btreeProbes.h
+ * Statically defined tracepoints (USDT probes) on the hot paths of
+ * BTreeIndex, for perf, bpftrace and systemtap on live hosts.
+ *
+ * Probes are compiled in only when building with -DBTREE_USDT, which needs
+ * <sys/sdt.h> (systemtap-sdt-dev / systemtap-sdt-devel). Each probe is then
+ * a single nop at its call site plus an ELF note naming it and its
+ * arguments, and a tracer attaching to it patches the nop. Durations need
+ * two clock reads, so they are only measured while a tracer is attached to
+ * the probe: every probe has a semaphore the tracer raises, tested by
+ * BTREE_PROBE_START(). Without BTREE_USDT every macro expands to nothing.
+ *
+ * Probes of provider btree (durations in nanoseconds):
+ *   lookup__begin(key)                       lookup(), sort key probed for
+ *   lookup__end(leafPageNo, found, nanos)
+ *   lookup__batch(numKeys, nanos)            lookupBatch()
+ *   scan__start(leafPageNo, nanos)           positioned on the first leaf
+ *   scan__end(nanos)                         since the scan started, also
+ *                                            if served from the range cache
+ *   aggregate__scan(count, nanos)            aggregateScan()
+ *   page__read(pageNo, nanos)                buffer pool read of a node
+ *   leaf__split(pageNo, newPageNo, nanos)
+ *   nonleaf__split(pageNo, newPageNo, level, nanos)
+ *   root__split(oldRootPageNo, newRootPageNo, newLevel)
+ *
+ * e.g. bpftrace -e 'usdt:./main:btree:page__read { @[arg0] = hist(arg1); }'
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department,
+ * University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef BTREE_USDT
+
+#include <time.h>
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+/**
+ * Semaphores of the probes, raised by a tracer while it is attached. The
+ * ELF notes name them unmangled, so they have C linkage; they are defined
+ * once, in btree.cpp, and read through volatile as the tracer writes them
+ * behind the compiler's back.
+ */
+#define BTREE_PROBE_SEMAPHORE(name) \
+  extern "C" volatile unsigned short btree_##name##_semaphore
+
+BTREE_PROBE_SEMAPHORE(lookup__begin);
+BTREE_PROBE_SEMAPHORE(lookup__end);
+BTREE_PROBE_SEMAPHORE(lookup__batch);
+BTREE_PROBE_SEMAPHORE(scan__start);
+BTREE_PROBE_SEMAPHORE(scan__end);
+BTREE_PROBE_SEMAPHORE(aggregate__scan);
+BTREE_PROBE_SEMAPHORE(page__read);
+BTREE_PROBE_SEMAPHORE(leaf__split);
+BTREE_PROBE_SEMAPHORE(nonleaf__split);
+BTREE_PROBE_SEMAPHORE(root__split);
+
+/**
+ * Monotonic time in nanoseconds.
+ */
+inline uint64_t btreeProbeClock() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#define BTREE_PROBE_ENABLED(name) __builtin_expect(btree_##name##_semaphore != 0, 0)
+#define BTREE_PROBE1(name, a) DTRACE_PROBE1(btree, name, a)
+#define BTREE_PROBE2(name, a, b) DTRACE_PROBE2(btree, name, a, b)
+#define BTREE_PROBE3(name, a, b, c) DTRACE_PROBE3(btree, name, a, b, c)
+#define BTREE_PROBE4(name, a, b, c, d) DTRACE_PROBE4(btree, name, a, b, c, d)
+
+#else
+
+#define BTREE_PROBE_ENABLED(name) 0
+#define BTREE_PROBE1(name, a) do { if(0) { (void)(a); } } while(0)
+#define BTREE_PROBE2(name, a, b) do { if(0) { (void)(a); (void)(b); } } while(0)
+#define BTREE_PROBE3(name, a, b, c) do { if(0) { (void)(a); (void)(b); (void)(c); } } while(0)
+#define BTREE_PROBE4(name, a, b, c, d) \
+  do { if(0) { (void)(a); (void)(b); (void)(c); (void)(d); } } while(0)
+
+inline uint64_t btreeProbeClock() { return 0; }
+
+#endif
+
+/**
+ * Start time for a probe that reports a duration, or 0 if no tracer is
+ * attached to it.
+ */
+#define BTREE_PROBE_START(name) (BTREE_PROBE_ENABLED(name) ? btreeProbeClock() : (uint64_t) 0)
+
+/**
+ * Nanoseconds since a start time taken with BTREE_PROBE_START().
+ */
+#define BTREE_PROBE_ELAPSED(start) ((start) != 0 ? btreeProbeClock() - (start) : (uint64_t) 0)
@@ -0,0 +1,241 @@
+/**
+ * indexCatalog.cpp
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department,
+ * University of Wisconsin-Madison.
+ */
+
+#include "indexCatalog.h"
+
+#include <algorithm>
+#include <sstream>
+#include "exceptions/bad_index_info_exception.h"
+
+namespace wiscdb
+{
+
+// -----------------------------------------------------------------------------
+// IndexCatalog::IndexCatalog -- Constructor
+// -----------------------------------------------------------------------------
+
+IndexCatalog::IndexCatalog(BufferManager *bufMgrIn, int maxOpenIn)
+  : bufMgr(bufMgrIn), maxOpen(maxOpenIn) {
+}
+
+// -----------------------------------------------------------------------------
+// IndexCatalog::~IndexCatalog -- destructor
+// -----------------------------------------------------------------------------
+
+IndexCatalog::~IndexCatalog() {
+  while(!lru.empty()) { close(*lru.back()); }
+  for(std::map<std::string, GroupPool>::iterator it = groupPools.begin();
+      it != groupPools.end(); ++it) {
+    delete it->second.bufMgr;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// IndexCatalog::registerIndex
+// -----------------------------------------------------------------------------
+
+const std::string IndexCatalog::registerIndex(const std::string & relationName,
+                                              const int attrByteOffset,
+                                              const IndexOptions & options,
+                                              const std::string & group) {
+  std::stringstream ss;
+  ss << relationName << '.' << attrByteOffset;
+  std::map<std::string, CatalogEntry>::iterator it = entries.find(ss.str());
+  if(it != entries.end()) { return ss.str(); }
+  CatalogEntry& entry = entries[ss.str()];
+  entry.relationName = relationName;
+  entry.attrByteOffset = attrByteOffset;
+  entry.options = options;
+  entry.index = NULL;
+  entry.users = 0;
+  entry.lastUsed = 0;
+  entry.numOpens = 0;
+  entry.group = group;
+  entry.hasHeader = false;
+  entry.reservedFrames = 0;
+  return ss.str();
+}
+
+// -----------------------------------------------------------------------------
+// IndexCatalog::setGroupQuota
+// -----------------------------------------------------------------------------
+
+void IndexCatalog::setGroupQuota(const std::string & group, const int frames) {
+  for(std::list<CatalogEntry*>::iterator it = lru.begin(); it != lru.end(); ++it) {
+    if((*it)->group == group) {
+      throw BadIndexInfoException("Index group " + group + " has open indexes");
+    }
+  }
+  std::map<std::string, GroupPool>::iterator it = groupPools.find(group);
+  if(it != groupPools.end()) {
+    delete it->second.bufMgr;
+    groupPools.erase(it);
+  }
+  if(frames > 0) {
+    GroupPool& groupPool = groupPools[group];
+    groupPool.bufMgr = new BufferManager(frames);
+    groupPool.frames = frames;
+    groupPool.reservedFrames = 0;
+  }
+}
+
+void IndexCatalog::setGroupQuotaBytes(const std::string & group, const size_t bytes) {
+  setGroupQuota(group, bytes / Page::SIZE);
+}
+
+// -----------------------------------------------------------------------------
+// IndexCatalog::usage
+// -----------------------------------------------------------------------------
+
+GroupUsage IndexCatalog::usage(const std::string & group) const {
+  GroupUsage usage = { 0, 0, 0, 0 };
+  std::map<std::string, GroupPool>::const_iterator pool = groupPools.find(group);
+  if(pool != groupPools.end()) { usage.quotaFrames = pool->second.frames; }
+  for(std::list<CatalogEntry*>::const_iterator it = lru.begin(); it != lru.end(); ++it) {
+    if((*it)->group != group) { continue; }
+    usage.numOpen++;
+    usage.reservedFrames += (*it)->index->numReservedFrames();
+    usage.pagesTouched += (*it)->index->numPagesTouched();
+  }
+  return usage;
+}
+
+// -----------------------------------------------------------------------------
+// IndexCatalog::acquire
+// -----------------------------------------------------------------------------
+
+BTreeIndex* IndexCatalog::acquire(const std::string & indexName) {
+  CatalogEntry& entry = find(indexName);
+  if(entry.index == NULL) {
+    BufferManager* pool = bufMgr;
+    IndexOptions options = entry.options;
+    std::map<std::string, GroupPool>::iterator it = groupPools.find(entry.group);
+    if(it != groupPools.end()) { //leave a private pool frames for everything else
+      pool = it->second.bufMgr;
+      int unreserved = it->second.frames / 2 - it->second.reservedFrames;
+      options.reservedFrames = std::max(0, std::min(options.reservedFrames, unreserved));
+    }
+    std::string outIndexName;
+    entry.index = new BTreeIndex(entry.relationName, outIndexName, pool,
+                                 entry.attrByteOffset, options);
+    if(it != groupPools.end()) {
+      entry.reservedFrames = options.reservedFrames;
+      it->second.reservedFrames += entry.reservedFrames;
+    }
+    entry.numOpens++;
+    entry.index->metaInfo(entry.header);
+    entry.hasHeader = true;
+    lru.push_front(&entry);
+    entry.lruPosition = lru.begin();
+  }
+  else {
+    lru.splice(lru.begin(), lru, entry.lruPosition);
+  }
+  entry.users++;
+  entry.lastUsed = time(NULL);
+  evict();
+  return entry.index;
+}
+
+// -----------------------------------------------------------------------------
+// IndexCatalog::release
+// -----------------------------------------------------------------------------
+
+void IndexCatalog::release(const std::string & indexName) {
+  CatalogEntry& entry = find(indexName);
+  if(entry.users == 0) { return; }
+  entry.users--;
+  entry.lastUsed = time(NULL);
+  lru.splice(lru.begin(), lru, entry.lruPosition); //keeps the list in lastUsed order
+  evict();
+}
+
+// -----------------------------------------------------------------------------
+// IndexCatalog::closeIdle
+// -----------------------------------------------------------------------------
+
+int IndexCatalog::closeIdle(const int idleSeconds) {
+  time_t cutoff = time(NULL) - idleSeconds;
+  int numClosed = 0;
+  //the list is in order of use, so the idle indexes are at its end
+  std::list<CatalogEntry*>::iterator it = lru.end();
+  while(it != lru.begin()) {
+    CatalogEntry* entry = *--it;
+    if(entry->lastUsed > cutoff) { break; }
+    if(entry->users > 0) { continue; }
+    ++it; //stays valid while close() erases the entry before it
+    close(*entry);
+    numClosed++;
+  }
+  return numClosed;
+}
+
+// -----------------------------------------------------------------------------
+// IndexCatalog::openIndexNames
+// -----------------------------------------------------------------------------
+
+void IndexCatalog::openIndexNames(std::vector<std::string>& outNames) const {
+  for(std::list<CatalogEntry*>::const_iterator it = lru.begin(); it != lru.end(); ++it) {
+    std::stringstream ss;
+    ss << (*it)->relationName << '.' << (*it)->attrByteOffset;
+    outNames.push_back(ss.str());
+  }
+}
+
+// -----------------------------------------------------------------------------
+// IndexCatalog::entry
+// -----------------------------------------------------------------------------
+
+const CatalogEntry* IndexCatalog::entry(const std::string & indexName) const {
+  std::map<std::string, CatalogEntry>::const_iterator it = entries.find(indexName);
+  return it == entries.end() ? NULL : &it->second;
+}
+
+// -----------------------------------------------------------------------------
+// IndexCatalog::find
+// -----------------------------------------------------------------------------
+
+CatalogEntry& IndexCatalog::find(const std::string & indexName) {
+  std::map<std::string, CatalogEntry>::iterator it = entries.find(indexName);
+  if(it == entries.end()) {
+    throw BadIndexInfoException("Index " + indexName + " is not in the catalog");
+  }
+  return it->second;
+}
+
+// -----------------------------------------------------------------------------
+// IndexCatalog::evict
+// -----------------------------------------------------------------------------
+
+void IndexCatalog::evict() {
+  std::list<CatalogEntry*>::iterator it = lru.end();
+  int numOpen = lru.size();
+  while(numOpen > maxOpen && it != lru.begin()) {
+    CatalogEntry* entry = *--it;
+    if(entry->users > 0) { continue; }
+    ++it;
+    close(*entry);
+    numOpen--;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// IndexCatalog::close
+// -----------------------------------------------------------------------------
+
+void IndexCatalog::close(CatalogEntry& entry) {
+  lru.erase(entry.lruPosition);
+  entry.index->metaInfo(entry.header); //the root may have moved while it was open
+  delete entry.index; //flushes the index file and closes it
+  entry.index = NULL;
+  std::map<std::string, GroupPool>::iterator it = groupPools.find(entry.group);
+  if(it != groupPools.end()) { it->second.reservedFrames -= entry.reservedFrames; }
+  entry.reservedFrames = 0;
+}
+
+}
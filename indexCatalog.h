@@ -0,0 +1,260 @@
+/**
+ * indexCatalog.h
+ * Catalog of many B+ tree indexes sharing one buffer pool, of which only a
+ * bounded number are open at a time.
+ *
+ * Registering an index only records how to open it (relation, attribute
+ * offset, options), so a catalog of any size is set up without touching a
+ * file. An index is opened on its first acquire(); opening reads its header
+ * page and keeps its file open. The open indexes form an LRU list, ordered by
+ * their last acquire() or release(): when more than maxOpen are open, the
+ * least recently used ones that nobody holds are closed again, and
+ * closeIdle() closes those unused for a while. Closing an index flushes its
+ * pages and releases its file handle; its registration stays, together with
+ * a copy of its header page, so entry() describes the index (root page,
+ * uniqueness, collation) without opening it again. The next acquire() opens
+ * it again.
+ *
+ * Indexes share the catalog's buffer pool unless they are registered in a
+ * group given a quota with setGroupQuota(). Each such group has a private
+ * buffer pool of its quota's frames, so a scan over one group's indexes
+ * only ever evicts pages of that group. IndexOptions::reservedFrames pins
+ * an index's upper levels within whichever pool it uses.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department,
+ * University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <time.h>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include "btree.h"
+
+namespace wiscdb
+{
+
+/**
+ * @brief A registered index, open or not.
+ */
+struct CatalogEntry{
+  /**
+   * Name of the base relation and offset of the indexed attribute.
+   */
+  std::string relationName;
+  int attrByteOffset;
+
+  /**
+   * Options the index is opened with.
+   */
+  IndexOptions options;
+
+  /**
+   * The open index, NULL while it is closed.
+   */
+  BTreeIndex* index;
+
+  /**
+   * Number of acquire() calls not yet released; an index in use is never
+   * closed.
+   */
+  int users;
+
+  /**
+   * Time of the last acquire() or release().
+   */
+  time_t lastUsed;
+
+  /**
+   * Number of times the index has been opened.
+   */
+  int numOpens;
+
+  /**
+   * Position in the LRU list, valid while the index is open.
+   */
+  std::list<CatalogEntry*>::iterator lruPosition;
+
+  /**
+   * Group the index belongs to; "" for the shared buffer pool.
+   */
+  std::string group;
+
+  /**
+   * Frames of its group's quota the open index may keep pinned for its
+   * upper levels; 0 in the shared pool, where reservations are not capped.
+   */
+  int reservedFrames;
+
+  /**
+   * Copy of the index's header page as of when it was last open; valid
+   * once hasHeader is set, also while the index is closed.
+   */
+  IndexMetaInfo header;
+  bool hasHeader;
+};
+
+/**
+ * @brief Buffer pool use of a group of indexes, see IndexCatalog::usage().
+ */
+struct GroupUsage{
+  /**
+   * Frames of the group's private pool, or 0 if it uses the shared pool.
+   */
+  int quotaFrames;
+
+  /**
+   * Open indexes of the group.
+   */
+  int numOpen;
+
+  /**
+   * Pages the open indexes keep pinned (IndexOptions::reservedFrames).
+   */
+  int reservedFrames;
+
+  /**
+   * Pages the open indexes have read or allocated since they were opened
+   * (BTreeIndex::numPagesTouched()); the group holds at most this many
+   * frames, and at most quotaFrames if it has a quota.
+   */
+  int pagesTouched;
+};
+
+/**
+ * @brief IndexCatalog class. Opens registered indexes on first use and
+ * keeps at most maxOpen of them open.
+ */
+class IndexCatalog {
+ public:
+  /**
+   * Create an empty catalog.
+   * @param bufMgrIn  Buffer Manager Instance shared by every index
+   * @param maxOpen   Number of indexes kept open when not in use
+   */
+  IndexCatalog(BufferManager *bufMgrIn, int maxOpen);
+
+  /**
+   * Close every open index, flushing its file.
+   */
+  ~IndexCatalog();
+
+  /**
+   * Record an index without opening it. Registering an index a second time
+   * returns its name and keeps the first options.
+   * @param relationName    Name of the base relation
+   * @param attrByteOffset  Offset of the indexed attribute in the record
+   * @param options         Options to open the index with
+   * @param group           Group whose buffer pool the index uses, "" for
+   *   the shared pool
+   * @return the index's "relation.offset" name, as used by acquire()
+   */
+  const std::string registerIndex(const std::string & relationName, const int attrByteOffset,
+                                  const IndexOptions & options = IndexOptions(),
+                                  const std::string & group = "");
+
+  /**
+   * Give a group of indexes a private buffer pool of a number of frames, so
+   * its indexes neither evict nor are evicted by indexes of other groups.
+   * The group's open indexes together get at most half of the quota to
+   * reserve for their upper levels; an index opened once that half is
+   * taken gets none. A quota of 0 returns the group to the shared
+   * pool. Set quotas before the group's indexes are used.
+   * @param group   Group name given to registerIndex()
+   * @param frames  Frames of the group's pool, each Page::SIZE bytes
+   * @throws  BadIndexInfoException  If an index of the group is open.
+   */
+  void setGroupQuota(const std::string & group, const int frames);
+
+  /**
+   * As setGroupQuota(), with the quota given in bytes and rounded down to
+   * whole frames.
+   */
+  void setGroupQuotaBytes(const std::string & group, const size_t bytes);
+
+  /**
+   * Return the buffer pool use of a group's open indexes.
+   */
+  GroupUsage usage(const std::string & group) const;
+
+  /**
+   * Return a registered index, opening it if it is closed (and building it
+   * if its file does not exist). The index stays open until the matching
+   * release().
+   * @param indexName  Name returned by registerIndex()
+   * @throws  BadIndexInfoException  If the index is not registered, or as
+   *   the BTreeIndex constructor if it cannot be opened.
+   */
+  BTreeIndex* acquire(const std::string & indexName);
+
+  /**
+   * End a use of an index started with acquire(), making it the most
+   * recently used. Unused indexes beyond maxOpen are closed.
+   */
+  void release(const std::string & indexName);
+
+  /**
+   * Close every open index nobody holds that has not been used for
+   * idleSeconds.
+   * @return the number of indexes closed
+   */
+  int closeIdle(const int idleSeconds);
+
+  /**
+   * Append the names of the open indexes, most recently used first.
+   */
+  void openIndexNames(std::vector<std::string>& outNames) const;
+
+  /**
+   * Return the registered entry of an index, or NULL. Its header is that of
+   * the index when last open, or not set if it has never been opened.
+   */
+  const CatalogEntry* entry(const std::string & indexName) const;
+
+  int numRegistered() const { return entries.size(); }
+  int numOpen() const { return lru.size(); }
+
+ private:
+  CatalogEntry& find(const std::string & indexName);
+
+  /**
+   * Close the least recently used unused indexes until at most maxOpen are
+   * open.
+   */
+  void evict();
+
+  void close(CatalogEntry& entry);
+
+  BufferManager *bufMgr;
+  int maxOpen;
+
+  /**
+   * @brief A group's private buffer pool.
+   */
+  struct GroupPool{
+    BufferManager* bufMgr;
+    int frames;
+
+    /**
+     * Frames granted to the group's open indexes for their upper levels.
+     */
+    int reservedFrames;
+  };
+
+  /**
+   * Private buffer pools, by group.
+   */
+  std::map<std::string, GroupPool> groupPools;
+
+  /**
+   * Registered indexes by name, and the open ones, most recently used first.
+   */
+  std::map<std::string, CatalogEntry> entries;
+  std::list<CatalogEntry*> lru;
+};
+
+}
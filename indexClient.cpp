@@ -0,0 +1,160 @@
+/**
+ * indexClient.cpp
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department,
+ * University of Wisconsin-Madison.
+ */
+
+#include "indexClient.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <stdexcept>
+
+namespace wiscdb
+{
+
+IndexClient::IndexClient(const std::string & socketPath) : nextRequestId(1) {
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0) { throw std::runtime_error("socket: " + std::string(strerror(errno))); }
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+  if(connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+    std::string error = strerror(errno);
+    close(fd);
+    throw std::runtime_error("connect " + socketPath + ": " + error);
+  }
+}
+
+IndexClient::~IndexClient() {
+  close(fd);
+}
+
+uint32_t IndexClient::openIndex(const std::string & relationName, const int attrByteOffset) {
+  IndexRequest request;
+  memset(&request, 0, sizeof(request));
+  request.type = REQ_OPEN;
+  strncpy(request.relationName, relationName.c_str(), sizeof(request.relationName));
+  request.attrByteOffset = attrByteOffset;
+  send(request);
+  IndexResponse response;
+  std::vector<RecordId> rids;
+  receive(response, rids);
+  if(response.status != RESP_OK) {
+    throw std::runtime_error("server could not open index on " + relationName);
+  }
+  return response.indexId;
+}
+
+uint32_t IndexClient::sendLookup(const uint32_t indexId, const char* key) {
+  IndexRequest request;
+  memset(&request, 0, sizeof(request));
+  request.type = REQ_LOOKUP;
+  request.indexId = indexId;
+  strncpy(request.key, key, STRINGSIZE);
+  return send(request);
+}
+
+uint32_t IndexClient::sendInsert(const uint32_t indexId, const char* key, const RecordId rid,
+                                 const uint32_t expiresAt) {
+  IndexRequest request;
+  memset(&request, 0, sizeof(request));
+  request.type = REQ_INSERT;
+  request.indexId = indexId;
+  strncpy(request.key, key, STRINGSIZE);
+  request.rid = rid;
+  request.expiresAt = expiresAt;
+  return send(request);
+}
+
+uint32_t IndexClient::sendScan(const uint32_t indexId, const char* lowVal, const Operator lowOp,
+                               const char* highVal, const Operator highOp) {
+  IndexRequest request;
+  memset(&request, 0, sizeof(request));
+  request.type = REQ_SCAN;
+  request.indexId = indexId;
+  request.lowOp = lowOp;
+  request.highOp = highOp;
+  strncpy(request.key, lowVal, STRINGSIZE);
+  strncpy(request.highKey, highVal, STRINGSIZE);
+  return send(request);
+}
+
+uint32_t IndexClient::send(IndexRequest& request) {
+  request.requestId = nextRequestId++;
+  out.append((const char*) &request, sizeof(IndexRequest));
+  return request.requestId;
+}
+
+void IndexClient::flush() {
+  size_t offset = 0;
+  while(offset < out.size()) {
+    ssize_t n = write(fd, out.data() + offset, out.size() - offset);
+    if(n < 0) {
+      if(errno == EINTR) { continue; }
+      throw std::runtime_error("write: " + std::string(strerror(errno)));
+    }
+    offset += n;
+  }
+  out.clear();
+}
+
+void IndexClient::receive(IndexResponse& response, std::vector<RecordId>& rids) {
+  if(!out.empty()) { flush(); }
+  readFully((char*) &response, sizeof(IndexResponse));
+  rids.resize(response.numRids);
+  if(response.numRids > 0) {
+    readFully((char*) &rids[0], response.numRids * sizeof(RecordId));
+  }
+}
+
+void IndexClient::readFully(char* buffer, size_t length) {
+  size_t offset = 0;
+  while(offset < length) {
+    ssize_t n = read(fd, buffer + offset, length - offset);
+    if(n < 0 && errno == EINTR) { continue; }
+    if(n <= 0) { throw std::runtime_error("index server closed the connection"); }
+    offset += n;
+  }
+}
+
+bool IndexClient::lookup(const uint32_t indexId, const char* key, RecordId& outRid) {
+  sendLookup(indexId, key);
+  IndexResponse response;
+  std::vector<RecordId> rids;
+  receive(response, rids);
+  if(response.status != RESP_OK) { return false; }
+  outRid = rids[0];
+  return true;
+}
+
+bool IndexClient::insert(const uint32_t indexId, const char* key, const RecordId rid,
+                         const uint32_t expiresAt) {
+  sendInsert(indexId, key, rid, expiresAt);
+  IndexResponse response;
+  std::vector<RecordId> rids;
+  receive(response, rids);
+  return response.status == RESP_OK;
+}
+
+bool IndexClient::scan(const uint32_t indexId, const char* lowVal, const Operator lowOp,
+                       const char* highVal, const Operator highOp, std::vector<RecordId>& outRids) {
+  sendScan(indexId, lowVal, lowOp, highVal, highOp);
+  outRids.clear();
+  IndexResponse response;
+  std::vector<RecordId> rids;
+  do {
+    receive(response, rids);
+    if(response.status == RESP_ERROR) { return false; }
+    outRids.insert(outRids.end(), rids.begin(), rids.end());
+  } while(response.status == RESP_SCAN_CHUNK);
+  return true;
+}
+
+}
@@ -0,0 +1,103 @@
+/**
+ * indexClient.h
+ * Client side of the index server protocol (indexProtocol.h).
+ *
+ * The send* calls queue requests without waiting and return the request id;
+ * flush() writes everything queued and receive() reads the next response, so
+ * a caller can keep many requests in flight on one connection. lookup(),
+ * insert() and scan() are blocking conveniences built on the same calls and
+ * must not be mixed with outstanding pipelined requests.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department,
+ * University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "indexProtocol.h"
+
+namespace wiscdb
+{
+
+/**
+ * @brief IndexClient class. One connection to an index server.
+ */
+class IndexClient {
+ public:
+  /**
+   * Connect to the server listening on socketPath.
+   * Throws std::runtime_error if the connection fails.
+   */
+  IndexClient(const std::string & socketPath = DEFAULT_INDEX_SOCKET);
+
+  /**
+   * Close the connection.
+   */
+  ~IndexClient();
+
+  /**
+   * Open (building it if it does not exist) the index on the given relation
+   * and attribute offset and return its id.
+   * Throws std::runtime_error if the server could not open it.
+   */
+  uint32_t openIndex(const std::string & relationName, const int attrByteOffset);
+
+  /**
+   * Queue a request without waiting for its response.
+   * @return the request id its responses will carry
+   */
+  uint32_t sendLookup(const uint32_t indexId, const char* key);
+  uint32_t sendInsert(const uint32_t indexId, const char* key, const RecordId rid,
+                      const uint32_t expiresAt = NO_EXPIRY);
+  uint32_t sendScan(const uint32_t indexId, const char* lowVal, const Operator lowOp,
+                    const char* highVal, const Operator highOp);
+
+  /**
+   * Write every queued request to the server.
+   */
+  void flush();
+
+  /**
+   * Read the next response, flushing queued requests first.
+   * @param response   the response header
+   * @param rids       set to the RecordIds that followed it
+   */
+  void receive(IndexResponse& response, std::vector<RecordId>& rids);
+
+  /**
+   * Blocking lookup.
+   * @return true and the rid if the key is in the index
+   */
+  bool lookup(const uint32_t indexId, const char* key, RecordId& outRid);
+
+  /**
+   * Blocking insert; the entry expires at expiresAt unless it is NO_EXPIRY.
+   * @return false if the server reported an error
+   */
+  bool insert(const uint32_t indexId, const char* key, const RecordId rid,
+              const uint32_t expiresAt = NO_EXPIRY);
+
+  /**
+   * Blocking scan; collects every matching rid.
+   * @return false if the server reported an error
+   */
+  bool scan(const uint32_t indexId, const char* lowVal, const Operator lowOp,
+            const char* highVal, const Operator highOp, std::vector<RecordId>& outRids);
+
+ private:
+  uint32_t send(IndexRequest& request);
+  void readFully(char* buffer, size_t length);
+
+  int fd;
+  uint32_t nextRequestId;
+
+  /**
+   * Requests queued since the last flush().
+   */
+  std::string out;
+};
+
+}
@@ -0,0 +1,188 @@
+/**
+ * indexLoadGen.cpp
+ * Load generator for the index server. Forks one client process per
+ * connection; each keeps a fixed number of pipelined requests in flight,
+ * drawn from a lookup/scan/insert mix over keys of the form
+ * "%05d string record", and the parent reports the combined throughput.
+ *
+ * The relation relLoad is created first if it does not exist, and the index
+ * on its string attribute is opened through the server.
+ *
+ * Usage: indexLoadGen [connections] [pipelineDepth] [requestsPerConnection]
+ *                     [lookupPercent] [scanPercent] [socketPath]
+ * Requests that are neither lookups nor scans are inserts.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department,
+ * University of Wisconsin-Madison.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <iostream>
+#include <stdexcept>
+#include "indexClient.h"
+#include "include/page.h"
+#include "exceptions/insufficient_space_exception.h"
+
+using namespace wiscdb;
+
+const std::string relationName = "relLoad";
+const int relationSize = 5000;
+
+typedef struct tuple {
+  int i;
+  double d;
+  char s[64];
+} RECORD;
+
+/**
+ * @brief What each client process reports back to the parent.
+ */
+struct ClientResult{
+  long requests;
+  long rids;
+  long errors;
+};
+
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/**
+ * Create relLoad with relationSize records unless it already exists.
+ */
+static void createRelation() {
+  if(File::exists(relationName)) { return; }
+  PageFile file(relationName, true);
+  RECORD record;
+  memset(record.s, ' ', sizeof(record.s));
+  PageId pageNum;
+  Page page = file.allocatePage(pageNum);
+  for(int i = 0; i < relationSize; i++) {
+    sprintf(record.s, "%05d string record", i);
+    record.i = i;
+    record.d = (double)i;
+    std::string data((char*)(&record), sizeof(record));
+    while(1) {
+      try {
+        page.insertRecord(data);
+        break;
+      } catch(InsufficientSpaceException e) {
+        file.writePage(pageNum, page);
+        page = file.allocatePage(pageNum);
+      }
+    }
+  }
+  file.writePage(pageNum, page);
+}
+
+/**
+ * Queue one request of the mix.
+ */
+static void sendRandomRequest(IndexClient& client, const uint32_t indexId,
+                              const int lookupPercent, const int scanPercent) {
+  //keys are formatted as the records are, so lookups hit
+  char key[32], highKey[32];
+  int dice = rand() % 100;
+  if(dice < lookupPercent) {
+    sprintf(key, "%05d string record", rand() % relationSize);
+    client.sendLookup(indexId, key);
+  }
+  else if(dice < lookupPercent + scanPercent) {
+    int low = rand() % relationSize;
+    sprintf(key, "%05d string record", low);
+    sprintf(highKey, "%05d string record", low + 20);
+    client.sendScan(indexId, key, GTE, highKey, LT);
+  }
+  else {
+    sprintf(key, "%05d string record", relationSize + rand() % relationSize);
+    RecordId rid;
+    rid.page_number = 1;
+    rid.slot_number = rand() % 100;
+    client.sendInsert(indexId, key, rid);
+  }
+}
+
+/**
+ * Body of one client process.
+ */
+static ClientResult runClient(const std::string & socketPath, const int depth,
+                              const long numRequests, const int lookupPercent,
+                              const int scanPercent) {
+  ClientResult result = { 0, 0, 0 };
+  IndexClient client(socketPath);
+  uint32_t indexId = client.openIndex(relationName, offsetof(RECORD, s));
+  long sent = 0;
+  int inFlight = 0;
+  IndexResponse response;
+  std::vector<RecordId> rids;
+  while(result.requests < numRequests) {
+    while(inFlight < depth && sent < numRequests) {
+      sendRandomRequest(client, indexId, lookupPercent, scanPercent);
+      sent++;
+      inFlight++;
+    }
+    client.receive(response, rids);
+    result.rids += rids.size();
+    if(response.status == RESP_SCAN_CHUNK) { continue; } //more of the same scan
+    if(response.status == RESP_ERROR) { result.errors++; }
+    result.requests++;
+    inFlight--;
+  }
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  int connections = argc > 1 ? atoi(argv[1]) : 4;
+  int depth = argc > 2 ? atoi(argv[2]) : 32;
+  long numRequests = argc > 3 ? atol(argv[3]) : 100000;
+  int lookupPercent = argc > 4 ? atoi(argv[4]) : 90;
+  int scanPercent = argc > 5 ? atoi(argv[5]) : 5;
+  std::string socketPath = argc > 6 ? argv[6] : DEFAULT_INDEX_SOCKET;
+
+  createRelation();
+
+  int pipes[2];
+  if(pipe(pipes) < 0) { perror("pipe"); return 1; }
+  double start = now();
+  for(int c = 0; c < connections; c++) {
+    if(fork() == 0) {
+      close(pipes[0]);
+      srand(c + 1);
+      ClientResult result = { 0, 0, 1 };
+      try {
+        result = runClient(socketPath, depth, numRequests, lookupPercent, scanPercent);
+      } catch(std::runtime_error& e) {
+        std::cerr << "client " << c << ": " << e.what() << std::endl;
+      }
+      if(write(pipes[1], &result, sizeof(result)) != sizeof(result)) { _exit(1); }
+      _exit(0);
+    }
+  }
+  close(pipes[1]);
+
+  ClientResult total = { 0, 0, 0 };
+  ClientResult result;
+  while(read(pipes[0], &result, sizeof(result)) == sizeof(result)) {
+    total.requests += result.requests;
+    total.rids += result.rids;
+    total.errors += result.errors;
+  }
+  while(wait(NULL) > 0) {}
+  double seconds = now() - start;
+
+  printf("%d connections, pipeline depth %d, %d%% lookup %d%% scan %d%% insert\n",
+         connections, depth, lookupPercent, scanPercent, 100 - lookupPercent - scanPercent);
+  printf("%ld requests in %.3f s: %.0f requests/s, %ld rids returned, %ld errors\n",
+         total.requests, seconds, total.requests / seconds, total.rids, total.errors);
+  return 0;
+}
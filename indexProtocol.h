@@ -0,0 +1,137 @@
+/**
+ * indexProtocol.h
+ * Wire format spoken between the index server (indexServer.cpp) and its
+ * clients (indexClient.h) over a Unix domain socket. Both ends run on the
+ * same host, so fields are sent in host byte order.
+ *
+ * A client writes fixed size IndexRequest frames and may pipeline as many
+ * as it likes before reading. Every request is answered by one or more
+ * IndexResponse frames carrying the request's id; a response is followed by
+ * numRids RecordIds. Responses to different requests may arrive out of
+ * order, since the server batches lookups on the same index across clients.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department,
+ * University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "btree.h"
+
+namespace wiscdb
+{
+
+/**
+ * @brief Socket path used when none is given.
+ */
+const char DEFAULT_INDEX_SOCKET[] = "/tmp/wiscdb-index.sock";
+
+/**
+ * @brief Most RecordIds sent in one scan response; longer scans are streamed
+ * as several SCAN_CHUNK responses followed by a SCAN_END response.
+ */
+const int SCAN_CHUNK_RIDS = 256;
+
+/**
+ * @brief Request types.
+ */
+enum RequestType
+{
+  REQ_OPEN = 1,   /* Open (or build) the index on relationName/attrByteOffset */
+  REQ_LOOKUP,     /* lookup(key) */
+  REQ_SCAN,       /* startScan(key, lowOp, highKey, highOp) to completion */
+  REQ_INSERT      /* insertEntry(key, rid) */
+};
+
+/**
+ * @brief Response status codes.
+ */
+enum ResponseStatus
+{
+  RESP_OK = 0,      /* Request done; lookups carry the rid found */
+  RESP_NOT_FOUND,   /* Lookup found no entry with the key */
+  RESP_SCAN_CHUNK,  /* Part of a scan result, more follows */
+  RESP_SCAN_END,    /* Last (possibly empty) part of a scan result */
+  RESP_ERROR        /* Bad request, unknown index or index exception */
+};
+
+/**
+ * @brief One request frame.
+ */
+struct IndexRequest{
+  /**
+   * Chosen by the client and echoed in every response to the request.
+   */
+  uint32_t requestId;
+
+  /**
+   * Index the request is for, as returned by REQ_OPEN.
+   */
+  uint32_t indexId;
+
+  /**
+   * A RequestType.
+   */
+  uint8_t type;
+
+  /**
+   * Scan operators (an Operator each), REQ_SCAN only.
+   */
+  uint8_t lowOp;
+  uint8_t highOp;
+
+  /**
+   * Key of a lookup or insert; low value of a scan.
+   */
+  char key[STRINGSIZE];
+
+  /**
+   * High value of a scan.
+   */
+  char highKey[STRINGSIZE];
+
+  /**
+   * RecordId of an insert.
+   */
+  RecordId rid;
+
+  /**
+   * Expiry time of an insert in expiryClock() seconds, or NO_EXPIRY.
+   */
+  uint32_t expiresAt;
+
+  /**
+   * Base relation and attribute offset of the index, REQ_OPEN only.
+   */
+  char relationName[20];
+  int32_t attrByteOffset;
+};
+
+/**
+ * @brief Header of one response frame, followed by numRids RecordIds.
+ */
+struct IndexResponse{
+  /**
+   * Id of the request being answered.
+   */
+  uint32_t requestId;
+
+  /**
+   * Index id assigned by REQ_OPEN.
+   */
+  uint32_t indexId;
+
+  /**
+   * A ResponseStatus.
+   */
+  uint16_t status;
+
+  /**
+   * Number of RecordIds following this header.
+   */
+  uint16_t numRids;
+};
+
+}
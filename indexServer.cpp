@@ -0,0 +1,635 @@
+/**
+ * indexServer.cpp
+ * Local index server. A single process owns the buffer pool and every open
+ * BTreeIndex, and serves lookup, scan and insert requests from many client
+ * processes over a Unix domain socket (see indexProtocol.h), so the
+ * processes on a host share one cached copy of each index.
+ *
+ * The server is one poll() loop. Each round it reads every pipelined request
+ * that has arrived from any client, then executes them in arrival order,
+ * except that lookups on the same index are held back and run together
+ * through BTreeIndex::lookupBatch(). Held lookups on an index are run
+ * before any later insert or scan on that index.
+ *
+ * Scans are streamed: the scans on an index all attach to one SharedScan,
+ * which reads each leaf once for all of them, and each round sends every
+ * scan at most SCAN_CHUNKS_PER_ROUND chunks of SCAN_CHUNK_RIDS, and none to
+ * a client with more than MAX_CLIENT_OUTPUT bytes still unsent. A long
+ * scan thus neither holds up other clients nor buffers its whole result.
+ * A client's requests read behind one of its unfinished scans wait until
+ * the scan ends, so each client still sees its own requests applied in
+ * order; a streamed scan may see the inserts of other clients on leaves it
+ * has not reached yet. Every SWEEP_INTERVAL seconds, between rounds, the
+ * loop also drops the leaves of expired entries from each open index that
+ * has no scan streaming.
+ *
+ * Indexes keep a hot set (IndexOptions::hotSet), saved every
+ * HOT_SET_INTERVAL seconds and when the server stops. After a restart each
+ * index reads its recorded hot set back a few pages per request, and the
+ * loop reads HOT_SET_IDLE_PAGES more per index in rounds without requests,
+ * so the working set returns while requests are already being served.
+ *
+ * The indexes are kept in an IndexCatalog: opening an index that exists on
+ * disk only registers it, and its file is opened by the first request that
+ * uses it. At most MAX_OPEN_INDEXES are kept open, and indexes without
+ * requests for IDLE_CLOSE_SECONDS are closed, so a server with many
+ * indexes starts at once and holds few file descriptors.
+ *
+ * Usage: indexServer [socketPath] [bufferFrames]
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department,
+ * University of Wisconsin-Madison.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "btree.h"
+#include "indexCatalog.h"
+#include "sharedScan.h"
+#include "indexProtocol.h"
+
+using namespace wiscdb;
+
+/**
+ * Set by SIGINT/SIGTERM to make the poll loop exit and close the indexes.
+ */
+static volatile sig_atomic_t stopServer = 0;
+
+static void handleStopSignal(int) { stopServer = 1; }
+
+/**
+ * Seconds between two sweeps of expired entries.
+ */
+const int SWEEP_INTERVAL = 10;
+
+/**
+ * Seconds between two saves of the hot sets of the open indexes.
+ */
+const int HOT_SET_INTERVAL = 60;
+
+/**
+ * Pages of a recorded hot set read per index in a round without requests.
+ */
+const int HOT_SET_IDLE_PAGES = 256;
+
+/**
+ * Indexes kept open while not in use, and seconds after which an index
+ * without requests is closed.
+ */
+const int MAX_OPEN_INDEXES = 1024;
+const int IDLE_CLOSE_SECONDS = 300;
+
+/**
+ * Scan chunks sent per streamed scan in one round, and bytes of unsent
+ * output above which a client's scans wait for it to read.
+ */
+const int SCAN_CHUNKS_PER_ROUND = 4;
+const size_t MAX_CLIENT_OUTPUT = 1 << 20;
+
+/**
+ * @brief A connected client and its unparsed input and unsent output.
+ */
+struct Client{
+  int fd;
+  std::string in;
+  std::string out;
+
+  /**
+   * True once the connection failed; the client is dropped that round.
+   */
+  bool closed;
+
+  /**
+   * True once the client has shut down its side; it is dropped when its
+   * requests are answered and their responses sent.
+   */
+  bool eof;
+
+  /**
+   * Scans of the client held or streaming, and the requests read behind
+   * them, which run once numScans is back to 0.
+   */
+  int numScans;
+  std::deque<IndexRequest> waiting;
+};
+
+/**
+ * @brief A scan being streamed to a client through its index's SharedScan.
+ */
+struct ScanStream{
+  Client* client;
+  uint32_t requestId;
+  uint32_t indexId;
+  int cursor;
+};
+
+/**
+ * @brief A request read in the current round, with the client to answer.
+ */
+struct PendingRequest{
+  Client* client;
+  IndexRequest request;
+};
+
+/**
+ * @brief IndexServer class. Owns the listening socket, the clients and
+ * the open indexes.
+ */
+class IndexServer {
+ public:
+  IndexServer(const std::string & socketPath, BufferManager *bufMgrIn);
+  ~IndexServer();
+
+  /**
+   * Serve clients until SIGINT or SIGTERM.
+   */
+  void run();
+
+ private:
+  void acceptClients();
+  void readRequests(Client* client, std::vector<PendingRequest>& pending);
+  void writeResponses(Client* client);
+  void execute(std::vector<PendingRequest>& pending);
+  void flushLookups(uint32_t indexId);
+  void openIndex(const PendingRequest& pending);
+  void flushScans(uint32_t indexId);
+  void streamScans();
+  void endIdleScan(uint32_t indexId);
+  void insert(const PendingRequest& pending);
+  void sweepExpired();
+  void saveHotSets();
+  bool loadHotSets();
+  void respond(Client* client, uint32_t requestId, uint32_t indexId,
+               ResponseStatus status, const RecordId* rids, int numRids);
+  bool validIndex(const PendingRequest& pending);
+
+  std::string socketPath;
+  int listenFd;
+  BufferManager *bufferManager;
+  std::vector<Client*> clients;
+
+  /**
+   * The indexes, the "relation.offset" name of each by id, the id of each
+   * by name, and the lookups and scans on each held back for the current
+   * batch.
+   */
+  IndexCatalog catalog;
+  std::vector<std::string> indexNames;
+  std::map<std::string, uint32_t> indexIds;
+  std::vector<std::vector<PendingRequest> > heldLookups;
+  std::vector<std::vector<PendingRequest> > heldScans;
+
+  /**
+   * Scans being streamed: the SharedScan of each index with unfinished
+   * scans, NULL for the others, which keeps its index acquired, and the
+   * scans in the order they started.
+   */
+  std::vector<SharedScan*> indexScans;
+  std::vector<ScanStream> streams;
+
+  /**
+   * True while some open index still has recorded hot set pages to read.
+   */
+  bool loadingHotSets;
+};
+
+IndexServer::IndexServer(const std::string & socketPathIn, BufferManager *bufMgrIn)
+  : socketPath(socketPathIn), bufferManager(bufMgrIn),
+    catalog(bufMgrIn, MAX_OPEN_INDEXES), loadingHotSets(false) {
+  listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(listenFd < 0) { perror("socket"); exit(1); }
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+  unlink(socketPath.c_str()); //stale socket of an earlier run
+  if(bind(listenFd, (struct sockaddr*) &addr, sizeof(addr)) < 0) { perror("bind"); exit(1); }
+  if(listen(listenFd, 128) < 0) { perror("listen"); exit(1); }
+  fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+}
+
+IndexServer::~IndexServer() {
+  for(uint32_t indexId = 0; indexId < indexScans.size(); indexId++) {
+    if(indexScans[indexId] == NULL) { continue; }
+    delete indexScans[indexId];
+    catalog.release(indexNames[indexId]);
+  }
+  for(size_t i = 0; i < clients.size(); i++) {
+    close(clients[i]->fd);
+    delete clients[i];
+  }
+  close(listenFd);
+  unlink(socketPath.c_str());
+}
+
+void IndexServer::run() {
+  std::vector<struct pollfd> fds;
+  std::vector<PendingRequest> pending;
+  time_t lastSweep = time(NULL);
+  time_t lastHotSetSave = time(NULL);
+  while(!stopServer) {
+    fds.clear();
+    struct pollfd listenPoll = { listenFd, POLLIN, 0 };
+    fds.push_back(listenPoll);
+    bool workLeft = loadingHotSets || !streams.empty();
+    for(size_t i = 0; i < clients.size(); i++) {
+      struct pollfd clientPoll = { clients[i]->fd, (short) (clients[i]->eof ? 0 : POLLIN), 0 };
+      if(!clients[i]->out.empty()) { clientPoll.events |= POLLOUT; }
+      fds.push_back(clientPoll);
+      workLeft = workLeft || (clients[i]->numScans == 0 && !clients[i]->waiting.empty());
+    }
+    //while scans stream or hot sets are read back, only wait briefly
+    if(poll(&fds[0], fds.size(), workLeft ? 0 : 1000) < 0) {
+      if(errno == EINTR) { continue; }
+      perror("poll");
+      break;
+    }
+    //gather the requests whose scans have ended, then every request that
+    //has arrived, from every client
+    pending.clear();
+    for(size_t i = 0; i < clients.size(); i++) {
+      Client* client = clients[i];
+      while(client->numScans == 0 && !client->waiting.empty()) {
+        PendingRequest request;
+        request.client = client;
+        request.request = client->waiting.front();
+        client->waiting.pop_front();
+        pending.push_back(request);
+      }
+      if(fds[i+1].revents & (POLLIN | POLLHUP | POLLERR)) {
+        readRequests(client, pending);
+      }
+    }
+    execute(pending);
+    streamScans();
+    for(size_t i = 0; i < clients.size(); i++) {
+      if(!clients[i]->out.empty()) { writeResponses(clients[i]); }
+    }
+    //drop disconnected clients, and those that are done after shutting down
+    for(size_t i = 0; i < clients.size(); ) {
+      Client* client = clients[i];
+      //a closed client stays until its streamed scans have been detached
+      if((client->closed && client->numScans == 0)
+         || (client->eof && client->numScans == 0 && client->waiting.empty() && client->out.empty())) {
+        close(clients[i]->fd);
+        delete clients[i];
+        clients.erase(clients.begin() + i);
+      }
+      else { i++; }
+    }
+    if(fds[0].revents & POLLIN) { acceptClients(); }
+    if(time(NULL) - lastSweep >= SWEEP_INTERVAL) {
+      sweepExpired();
+      lastSweep = time(NULL);
+    }
+    if(time(NULL) - lastHotSetSave >= HOT_SET_INTERVAL) {
+      saveHotSets();
+      catalog.closeIdle(IDLE_CLOSE_SECONDS);
+      lastHotSetSave = time(NULL);
+    }
+    //requests may have opened indexes, whose hot sets are then read back
+    loadingHotSets = pending.empty() ? loadHotSets() : true;
+  }
+}
+
+void IndexServer::acceptClients() {
+  while(true) {
+    int fd = accept(listenFd, NULL, NULL);
+    if(fd < 0) { return; } //EAGAIN: no more waiting
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    Client* client = new Client();
+    client->fd = fd;
+    client->closed = false;
+    client->eof = false;
+    client->numScans = 0;
+    clients.push_back(client);
+  }
+}
+
+void IndexServer::readRequests(Client* client, std::vector<PendingRequest>& pending) {
+  char buffer[64 * 1024];
+  while(true) {
+    ssize_t n = read(client->fd, buffer, sizeof(buffer));
+    if(n > 0) {
+      client->in.append(buffer, n);
+      continue;
+    }
+    if(n == 0) { //shut down: the requests it sent are still answered
+      client->eof = true;
+    }
+    else if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      client->closed = true;
+    }
+    if(n == 0 || errno != EINTR) { break; }
+  }
+  //split off every complete frame
+  size_t offset = 0;
+  while(client->in.size() - offset >= sizeof(IndexRequest)) {
+    PendingRequest request;
+    request.client = client;
+    memcpy(&request.request, client->in.data() + offset, sizeof(IndexRequest));
+    pending.push_back(request);
+    offset += sizeof(IndexRequest);
+  }
+  client->in.erase(0, offset);
+}
+
+void IndexServer::writeResponses(Client* client) {
+  while(!client->out.empty()) {
+    ssize_t n = write(client->fd, client->out.data(), client->out.size());
+    if(n > 0) {
+      client->out.erase(0, n);
+      continue;
+    }
+    if(n < 0 && errno == EINTR) { continue; }
+    if(n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) { client->closed = true; }
+    return;
+  }
+}
+
+void IndexServer::execute(std::vector<PendingRequest>& pending) {
+  for(size_t i = 0; i < pending.size(); i++) {
+    const PendingRequest& request = pending[i];
+    if(request.client->closed) { continue; }
+    if(request.client->numScans > 0) { //behind a scan of the same client
+      request.client->waiting.push_back(request.request);
+      continue;
+    }
+    switch(request.request.type) {
+      case REQ_OPEN:
+        openIndex(request);
+        break;
+      case REQ_LOOKUP:
+        if(validIndex(request)) {
+          flushScans(request.request.indexId);
+          heldLookups[request.request.indexId].push_back(request);
+        }
+        break;
+      case REQ_SCAN:
+        if(validIndex(request)) {
+          flushLookups(request.request.indexId);
+          heldScans[request.request.indexId].push_back(request);
+          request.client->numScans++;
+        }
+        break;
+      case REQ_INSERT:
+        if(validIndex(request)) {
+          flushLookups(request.request.indexId);
+          flushScans(request.request.indexId);
+          insert(request);
+        }
+        break;
+      default:
+        respond(request.client, request.request.requestId, request.request.indexId,
+                RESP_ERROR, NULL, 0);
+    }
+  }
+  for(uint32_t indexId = 0; indexId < indexNames.size(); indexId++) {
+    flushLookups(indexId);
+    flushScans(indexId);
+  }
+}
+
+void IndexServer::flushLookups(uint32_t indexId) {
+  std::vector<PendingRequest>& batch = heldLookups[indexId];
+  if(batch.empty()) { return; }
+  int numKeys = batch.size();
+  std::vector<const char*> keys(numKeys);
+  std::vector<RecordId> rids(numKeys);
+  bool* found = new bool[numKeys];
+  for(int i = 0; i < numKeys; i++) { keys[i] = batch[i].request.key; }
+  try {
+    catalog.acquire(indexNames[indexId])->lookupBatch(&keys[0], numKeys, &rids[0], found);
+    catalog.release(indexNames[indexId]);
+    for(int i = 0; i < numKeys; i++) {
+      respond(batch[i].client, batch[i].request.requestId, indexId,
+              found[i] ? RESP_OK : RESP_NOT_FOUND, &rids[i], found[i] ? 1 : 0);
+    }
+  } catch(...) { //the index file could not be reopened
+    for(int i = 0; i < numKeys; i++) {
+      respond(batch[i].client, batch[i].request.requestId, indexId, RESP_ERROR, NULL, 0);
+    }
+  }
+  delete[] found;
+  batch.clear();
+}
+
+void IndexServer::openIndex(const PendingRequest& pending) {
+  const IndexRequest& request = pending.request;
+  std::string relationName(request.relationName, strnlen(request.relationName, 20));
+  std::stringstream ss;
+  ss << relationName << '.' << request.attrByteOffset;
+  std::map<std::string, uint32_t>::iterator it = indexIds.find(ss.str());
+  if(it != indexIds.end()) {
+    respond(pending.client, request.requestId, it->second, RESP_OK, NULL, 0);
+    return;
+  }
+  try {
+    IndexOptions options;
+    options.hotSet = true;
+    std::string indexName = catalog.registerIndex(relationName, request.attrByteOffset, options);
+    if(!File::exists(indexName)) { //build it now rather than on the first request
+      catalog.acquire(indexName);
+      catalog.release(indexName);
+    }
+    uint32_t indexId = indexNames.size();
+    indexNames.push_back(indexName);
+    heldLookups.push_back(std::vector<PendingRequest>());
+    heldScans.push_back(std::vector<PendingRequest>());
+    indexScans.push_back(NULL);
+    indexIds[ss.str()] = indexId;
+    respond(pending.client, request.requestId, indexId, RESP_OK, NULL, 0);
+  } catch(...) { //missing relation or mismatched index file
+    respond(pending.client, request.requestId, 0, RESP_ERROR, NULL, 0);
+  }
+}
+
+void IndexServer::flushScans(uint32_t indexId) {
+  std::vector<PendingRequest>& batch = heldScans[indexId];
+  if(batch.empty()) { return; }
+  const std::string& indexName = indexNames[indexId];
+  if(indexScans[indexId] == NULL) {
+    try {
+      indexScans[indexId] = new SharedScan(*catalog.acquire(indexName));
+    } catch(...) { //the index file could not be reopened
+      for(size_t i = 0; i < batch.size(); i++) {
+        respond(batch[i].client, batch[i].request.requestId, indexId, RESP_ERROR, NULL, 0);
+        batch[i].client->numScans--;
+      }
+      batch.clear();
+      return;
+    }
+  }
+  //attach in order of low keys, so an idle pass starts at the lowest range
+  std::vector<std::pair<std::string, size_t> > byLowKey(batch.size());
+  for(size_t i = 0; i < batch.size(); i++) {
+    const char* key = batch[i].request.key;
+    byLowKey[i] = std::make_pair(std::string(key, strnlen(key, STRINGSIZE)), i);
+  }
+  std::sort(byLowKey.begin(), byLowKey.end());
+  for(size_t i = 0; i < byLowKey.size(); i++) {
+    const PendingRequest& pending = batch[byLowKey[i].second];
+    const IndexRequest& request = pending.request;
+    ScanStream stream;
+    stream.client = pending.client;
+    stream.requestId = request.requestId;
+    stream.indexId = indexId;
+    try {
+      stream.cursor = indexScans[indexId]->attach(request.key, (Operator) request.lowOp,
+                                                  request.highKey, (Operator) request.highOp);
+      streams.push_back(stream);
+    } catch(...) { //bad operators or range
+      respond(pending.client, request.requestId, indexId, RESP_ERROR, NULL, 0);
+      pending.client->numScans--;
+    }
+  }
+  batch.clear();
+  endIdleScan(indexId);
+}
+
+void IndexServer::streamScans() {
+  RecordId chunk[SCAN_CHUNK_RIDS];
+  for(size_t i = 0; i < streams.size(); ) {
+    ScanStream& stream = streams[i];
+    SharedScan* scan = indexScans[stream.indexId];
+    bool done = stream.client->closed;
+    if(!done && stream.client->out.size() < MAX_CLIENT_OUTPUT) {
+      for(int numChunks = 0; numChunks < SCAN_CHUNKS_PER_ROUND && !done; numChunks++) {
+        int numRids = 0;
+        while(numRids < SCAN_CHUNK_RIDS && scan->next(stream.cursor, chunk[numRids]) == SCAN_OK) {
+          numRids++;
+        }
+        done = numRids < SCAN_CHUNK_RIDS; //a full chunk may be followed by an empty end
+        respond(stream.client, stream.requestId, stream.indexId,
+                done ? RESP_SCAN_END : RESP_SCAN_CHUNK, chunk, numRids);
+      }
+    }
+    if(!done) {
+      i++;
+      continue;
+    }
+    uint32_t indexId = stream.indexId;
+    scan->detach(stream.cursor);
+    stream.client->numScans--;
+    streams.erase(streams.begin() + i);
+    endIdleScan(indexId);
+  }
+}
+
+void IndexServer::endIdleScan(uint32_t indexId) {
+  for(size_t i = 0; i < streams.size(); i++) {
+    if(streams[i].indexId == indexId) { return; }
+  }
+  delete indexScans[indexId]; //unpins the leaf its pass was on
+  indexScans[indexId] = NULL;
+  catalog.release(indexNames[indexId]);
+}
+
+void IndexServer::insert(const PendingRequest& pending) {
+  const IndexRequest& request = pending.request;
+  char key[STRINGSIZE + 1];
+  memcpy(key, request.key, STRINGSIZE);
+  key[STRINGSIZE] = '\0';
+  const std::string& indexName = indexNames[request.indexId];
+  try {
+    BTreeIndex* index = catalog.acquire(indexName);
+    try {
+      index->insertEntry(key, request.rid, request.expiresAt);
+    } catch(...) {
+      catalog.release(indexName);
+      throw;
+    }
+    catalog.release(indexName);
+    respond(pending.client, request.requestId, request.indexId, RESP_OK, NULL, 0);
+  } catch(...) {
+    respond(pending.client, request.requestId, request.indexId, RESP_ERROR, NULL, 0);
+  }
+}
+
+//the periodic work only visits open indexes; a closed index saved its hot
+//set when it was closed, and is swept again once a request reopens it
+
+void IndexServer::sweepExpired() {
+  std::vector<std::string> names;
+  catalog.openIndexNames(names);
+  for(size_t i = 0; i < names.size(); i++) {
+    //a streaming pass keeps a leaf pinned that the sweep could drop
+    std::map<std::string, uint32_t>::iterator it = indexIds.find(names[i]);
+    if(it != indexIds.end() && indexScans[it->second] != NULL) { continue; }
+    int numSwept = catalog.entry(names[i])->index->sweepExpired();
+    if(numSwept > 0) { printf("index %s: swept %d expired leaves\n", names[i].c_str(), numSwept); }
+  }
+}
+
+void IndexServer::saveHotSets() {
+  std::vector<std::string> names;
+  catalog.openIndexNames(names);
+  for(size_t i = 0; i < names.size(); i++) { catalog.entry(names[i])->index->saveHotSet(); }
+}
+
+bool IndexServer::loadHotSets() {
+  std::vector<std::string> names;
+  catalog.openIndexNames(names);
+  bool pagesLeft = false;
+  for(size_t i = 0; i < names.size(); i++) {
+    BTreeIndex* index = catalog.entry(names[i])->index;
+    pagesLeft = index->loadHotSetPages(HOT_SET_IDLE_PAGES) > 0 || pagesLeft;
+  }
+  return pagesLeft;
+}
+
+void IndexServer::respond(Client* client, uint32_t requestId, uint32_t indexId,
+                          ResponseStatus status, const RecordId* rids, int numRids) {
+  IndexResponse response;
+  response.requestId = requestId;
+  response.indexId = indexId;
+  response.status = status;
+  response.numRids = numRids;
+  client->out.append((const char*) &response, sizeof(IndexResponse));
+  if(numRids > 0) {
+    client->out.append((const char*) rids, numRids * sizeof(RecordId));
+  }
+}
+
+bool IndexServer::validIndex(const PendingRequest& pending) {
+  if(pending.request.indexId < indexNames.size()) { return true; }
+  respond(pending.client, pending.request.requestId, pending.request.indexId,
+          RESP_ERROR, NULL, 0);
+  return false;
+}
+
+int main(int argc, char **argv)
+{
+  std::string socketPath = argc > 1 ? argv[1] : DEFAULT_INDEX_SOCKET;
+  int bufferFrames = argc > 2 ? atoi(argv[2]) : 5000;
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, handleStopSignal);
+  signal(SIGTERM, handleStopSignal);
+
+  BufferManager * bufMgr = new BufferManager(bufferFrames);
+  {
+    IndexServer server(socketPath, bufMgr);
+    printf("index server listening on %s with %d buffer frames\n",
+           socketPath.c_str(), bufferFrames);
+    server.run();
+  }
+  delete bufMgr;
+  return 0;
+}
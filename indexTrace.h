@@ -0,0 +1,173 @@
+/**
+ * indexTrace.h
+ * Binary format of the operation traces BTreeIndex::startTrace() records
+ * and traceReplay.cpp runs again.
+ *
+ * A trace is a TraceHeader followed by one record per call. Each record is
+ * a TraceRecord followed by a payload that depends on its op: a key for a
+ * lookup, key, rid and expiry for an insert, upsert or delete, the same
+ * followed by the new key for an updateKey, both bounds of a
+ * scan (followed by its predicate for a filtered scan), or a count and
+ * that many keys for a batch of lookups; scanNext and endScan have none. Keys are recorded as passed to the index, not as
+ * sort keys, so a replay goes through the same collation. Each call is
+ * recorded once it returns, with its outcome. Fields are in host byte
+ * order.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department,
+ * University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "btree.h"
+
+namespace wiscdb
+{
+
+/**
+ * @brief Identifies a trace file.
+ */
+const char TRACE_FILE_MAGIC[8] = "BTTRC03";
+
+/**
+ * @brief Calls a trace records.
+ */
+enum TraceOp
+{
+  TRACE_INSERT = 1,       /* insertEntry(key, rid, expiry) */
+  TRACE_DELETE,           /* deleteEntry(key, rid) */
+  TRACE_LOOKUP,           /* lookup(key) */
+  TRACE_LOOKUP_BATCH,     /* lookupBatch(keys, numKeys) */
+  TRACE_START_SCAN,       /* tryStartScan(key, lowOp, highKey, highOp) */
+  TRACE_START_PREFIX_SCAN,/* tryStartPrefixScan(key, len), len in lowOp */
+  TRACE_SCAN_NEXT,        /* tryScanNext() */
+  TRACE_END_SCAN,         /* endScan() */
+  TRACE_AGGREGATE_SCAN,   /* aggregateScan(lowVal, lowOp, highVal, highOp) */
+  TRACE_START_FILTER_SCAN,/* tryStartScan(key, lowOp, highKey, highOp, predicate) */
+  TRACE_INSERT_UNIQUE,    /* insertUnique(key, rid, conflictRid, expiry) */
+  TRACE_UPSERT,           /* upsert(key, rid, oldRid, expiry) */
+  TRACE_UPDATE_KEY        /* updateKey(oldKey, newKey, rid) */
+};
+
+/**
+ * @brief Number of TraceOp values, plus one as they start at 1: the size
+ * of an array indexed by op.
+ */
+const int TRACE_NUM_OPS = TRACE_UPDATE_KEY + 1;
+
+/**
+ * @brief Start of a trace file: what a replay needs to build a fresh index
+ * of the same kind.
+ */
+struct TraceHeader{
+  /**
+   * Always TRACE_FILE_MAGIC.
+   */
+  char magic[8];
+
+  /**
+   * Base relation and attribute offset of the traced index.
+   */
+  char relationName[20];
+  int32_t attrByteOffset;
+
+  /**
+   * IndexOptions of the traced index.
+   */
+  uint8_t unique;
+  uint8_t collation;
+  uint8_t lazyDeletes;
+  uint8_t padding;
+};
+
+/**
+ * @brief Fixed part of one trace record.
+ */
+struct TraceRecord{
+  /**
+   * Microseconds since the previous record (or since the trace started),
+   * so a replay can keep the original pacing.
+   */
+  uint32_t deltaMicros;
+
+  /**
+   * A TraceOp.
+   */
+  uint8_t op;
+
+  /**
+   * Scan operators (an Operator each) of TRACE_START_SCAN,
+   * TRACE_START_FILTER_SCAN and TRACE_AGGREGATE_SCAN; lowOp holds the prefix length of
+   * TRACE_START_PREFIX_SCAN.
+   */
+  uint8_t lowOp;
+  uint8_t highOp;
+
+  /**
+   * Outcome seen when recording, for a replay to compare against: 1 if an
+   * insert added the entry (0 if a unique index already held the key), an
+   * upsert replaced an entry, an updateKey moved the entry, a lookup found
+   * the key or a delete removed the entry, the ScanStatus of
+   * scan calls, the number of keys found by a batch of lookups or counted
+   * by an aggregate scan modulo 256, and for endScan 1 if no scan was
+   * executing, 0 otherwise.
+   */
+  uint8_t result;
+};
+
+/**
+ * @brief Payload of TRACE_INSERT, TRACE_INSERT_UNIQUE, TRACE_UPSERT and
+ * TRACE_DELETE, and the start of that of TRACE_UPDATE_KEY, whose entry
+ * holds the old key and is followed by the new key.
+ */
+struct TraceEntry{
+  char key[STRINGSIZE];
+  RecordId rid;
+
+  /**
+   * Expiry time in seconds after the trace started (see traceExpiry()),
+   * or NO_EXPIRY.
+   */
+  uint32_t expiry;
+};
+
+/**
+ * @brief Payload of TRACE_START_FILTER_SCAN after the two scan bounds: the
+ * KeyPredicate as passed to the index, before NOCASE folding.
+ */
+struct TracePredicate{
+  /**
+   * A KeyPredicateKind, and 1 if the predicate is negated.
+   */
+  uint8_t kind;
+  uint8_t negate;
+  uint16_t padding;
+
+  int32_t patternLen;
+  char pattern[STRINGSIZE];
+  unsigned char mask[STRINGSIZE];
+};
+
+/**
+ * @brief Expiry time as recorded in a TraceEntry: relative to the
+ * expiryClock() time the trace started, so a replay run later keeps the
+ * entries' lifetimes instead of finding them long expired.
+ */
+inline uint32_t traceExpiry(const uint32_t expiry, const uint32_t traceStart) {
+  if(expiry == NO_EXPIRY) { return NO_EXPIRY; }
+  uint32_t relative = expiry - traceStart;
+  //0 would read as NO_EXPIRY; a second earlier is just as expired
+  return relative == NO_EXPIRY ? (uint32_t) -1 : relative;
+}
+
+/**
+ * @brief Expiry time of a recorded TraceEntry for a replay started at
+ * replayStart (an expiryClock() time).
+ */
+inline uint32_t replayExpiry(const uint32_t recorded, const uint32_t replayStart) {
+  return recorded == NO_EXPIRY ? NO_EXPIRY : replayStart + recorded;
+}
+
+}
@@ -10,9 +10,15 @@
  */
 
 #include <vector>
+#include <algorithm>
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
 #include "btree.h"
+#include "indexTrace.h"
+#include "sharedIndex.h"
+#include "indexCatalog.h"
+#include "sharedScan.h"
 #include "include/page.h"
 #include "include/fileScanner.h"
 #include "include/page_iterator.h"
@@ -26,8 +32,11 @@
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_exists_exception.h"
 
 #include "randRels.cpp"
+#define TRACE_REPLAY_NO_MAIN
+#include "traceReplay.cpp"
 
 #define checkPassFail(a, b)                                         \
 {                                                                   \
@@ -43,6 +52,11 @@
   }                                                                 \
 }
 
+// Name of the build printed with the benchmarks; pgoBuild.sh sets it
+#ifndef BTREE_BUILD
+#define BTREE_BUILD "plain"
+#endif
+
 #define PRINT_ERROR(str) \
 { \
   std::cerr << "On Line No:" << __LINE__ << "\n"; \
@@ -103,12 +117,53 @@ void showInsertBackward();
 void stringTests();
 int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
 void scanExceptionTests();
+void scanStatusTests();
+void traceTests();
+void traceReplayTests();
+void samplingTests();
+void exportImportTests();
+void mergeTests();
+void lookupTests();
+void uniqueTests();
+void deleteUpdateTests();
+void lazyDeleteTests();
+void ttlTests();
+void prefixScanTests();
+int prefixScan(BTreeIndex *index, const char* prefix, int len);
+void collationTests();
+void sharedIndexTests();
+void warmUpTests();
+void hotSetTests();
+void catalogTests();
+void quotaTests();
+void sharedScanTests();
+void rangeCacheTests();
+void predicateScanTests();
+void aggregateTests();
+int predicateScan(BTreeIndex *index, int lowVal, int highVal, const KeyPredicate& predicate);
+int drainCursor(SharedScan& scan, int cursor, int maxRids, std::vector<RecordId>& rids);
+bool lowerRid(const RecordId& a, const RecordId& b);
+
+void runBenchmarks();
+void lookupBenchmark();
+void shortScanBenchmark();
+void insertBenchmark();
 
 int main(int argc, char **argv)
 {
   std::cout << "leaf size:" << LEAF_NUM_KEYS 
             << " non-leaf size:" << NON_LEAF_NUM_KEYS << std::endl;
 
+  // --bench runs only the benchmarks, e.g. as the training run of pgoBuild.sh
+  if(argc > 1 && strcmp(argv[1], "--bench") == 0) {
+    try {
+      File::remove(relationName);
+    } catch(FileNotFoundException) {}
+    runBenchmarks();
+    delete bufMgr;
+    return 0;
+  }
+
   // Clean up from any previous runs that crashed.
   try {
     File::remove(relationName);
@@ -372,6 +427,28 @@ void indexTests() {
   showInsertBackward();
   stringTests();
   scanExceptionTests();
+  scanStatusTests();
+  traceTests();
+  traceReplayTests();
+  samplingTests();
+  exportImportTests();
+  mergeTests();
+  lookupTests();
+  uniqueTests();
+  deleteUpdateTests();
+  lazyDeleteTests();
+  ttlTests();
+  prefixScanTests();
+  collationTests();
+  sharedIndexTests();
+  warmUpTests();
+  hotSetTests();
+  catalogTests();
+  quotaTests();
+  sharedScanTests();
+  rangeCacheTests();
+  predicateScanTests();
+  aggregateTests();
   try{
     File::remove(indexName);
   }
@@ -489,6 +566,796 @@ void scanExceptionTests() {
   return;
 }
 
+/**
+ * scanStatusTests - Checks that the non-throwing scan calls report the
+ * status of each case scanExceptionTests covers, and return the same
+ * entries as the throwing calls
+ */
+void scanStatusTests() {
+  BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+  char lowKey[32], highKey[32];
+  RecordId rid;
+  checkPassFail(index.tryScanNext(rid), SCAN_NOT_INITIALIZED);
+  sprintf(lowKey, "%05d string record", 10);
+  sprintf(highKey, "%05d string record", 5);
+  checkPassFail(index.tryStartScan(lowKey, GT, highKey, LT), SCAN_BAD_RANGE);
+  sprintf(highKey, "%05d string record", 15);
+  checkPassFail(index.tryStartScan(lowKey, LT, highKey, LT), SCAN_BAD_OPCODES);
+  checkPassFail(index.tryStartScan(lowKey, GT, highKey, GTE), SCAN_BAD_OPCODES);
+  sprintf(lowKey, "%05d string record", relationSize + 10);
+  sprintf(highKey, "%05d string record", relationSize + 20);
+  checkPassFail(index.tryStartScan(lowKey, GTE, highKey, LT), SCAN_NO_SUCH_KEY);
+  checkPassFail(index.tryScanNext(rid), SCAN_NOT_INITIALIZED);
+  sprintf(lowKey, "%05d string record", 25);
+  sprintf(highKey, "%05d string record", 40);
+  int numResults = 0;
+  ScanStatus status = index.tryStartScan(lowKey, GT, highKey, LTE);
+  checkPassFail(status, SCAN_OK);
+  while (index.tryScanNext(rid) == SCAN_OK) { numResults++; }
+  checkPassFail(numResults, stringScan(&index, 25, GT, 40, LTE));
+  checkPassFail(index.tryScanNext(rid), SCAN_NOT_INITIALIZED); // completing ended the scan
+  checkPassFail(index.tryStartPrefixScan("0001", 4), SCAN_OK);
+  numResults = 0;
+  while (index.tryScanNext(rid) == SCAN_OK) { numResults++; }
+  checkPassFail(numResults, prefixScan(&index, "0001", 4));
+  checkPassFail(index.tryStartPrefixScan("9", 1), SCAN_NO_SUCH_KEY);
+  printf("===Passed scanStatusTests===\n");
+}
+
+/**
+ * traceTests - Records a few calls of each kind and reads the trace back,
+ * checking the op, outcome and payload of every record
+ */
+void traceTests() {
+  const std::string traceName = "btree_trace_test";
+  BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+  char key[32], highKey[32];
+  RecordId rid;
+  index.startTrace(traceName);
+  sprintf(key, "%05d string record", 7);
+  index.lookup(key, rid);
+  sprintf(highKey, "%05d string record", 9);
+  index.startScan(key, GTE, highKey, LTE);
+  int numResults = 0;
+  while (index.tryScanNext(rid) == SCAN_OK) { numResults++; }
+  index.startScan(key, GTE, highKey, LTE);
+  index.endScan();
+  index.stopTrace();
+  index.lookup(key, rid); // not traced
+
+  FILE* trace = fopen(traceName.c_str(), "rb");
+  TraceHeader header;
+  checkPassFail(fread(&header, sizeof(TraceHeader), 1, trace), 1);
+  checkPassFail(strncmp(header.magic, TRACE_FILE_MAGIC, 8), 0);
+  checkPassFail(header.attrByteOffset, (int) offsetof(tuple,s));
+  std::vector<int> ops, results;
+  TraceRecord record;
+  char payload[2 * STRINGSIZE];
+  while (fread(&record, sizeof(TraceRecord), 1, trace) == 1) {
+    ops.push_back(record.op);
+    results.push_back(record.result);
+    if (record.op == TRACE_LOOKUP) {
+      checkPassFail(fread(payload, STRINGSIZE, 1, trace), 1);
+      checkPassFail(strncmp(payload, key, STRINGSIZE), 0);
+    }
+    else if (record.op == TRACE_START_SCAN) {
+      checkPassFail(fread(payload, 2 * STRINGSIZE, 1, trace), 1);
+      checkPassFail(strncmp(payload + STRINGSIZE, highKey, STRINGSIZE), 0);
+    }
+  }
+  fclose(trace);
+  remove(traceName.c_str());
+  // lookup, startScan, numResults+1 scanNext, startScan, endScan
+  checkPassFail((int) ops.size(), numResults + 5);
+  checkPassFail(ops[0], TRACE_LOOKUP);
+  checkPassFail(results[0], 1);
+  checkPassFail(ops[1], TRACE_START_SCAN);
+  checkPassFail(results[numResults + 2], SCAN_COMPLETED);
+  checkPassFail(ops[numResults + 3], TRACE_START_SCAN);
+  checkPassFail(ops[numResults + 4], TRACE_END_SCAN);
+  printf("===Passed traceTests===\n");
+}
+
+/**
+ * traceReplayTests - Records inserts, deletes, lookups and scans on a fresh
+ * index, replays the trace with traceReplay's replayTrace() against another
+ * fresh index and checks every call gave the recorded outcome, and that
+ * expiry times are recorded relative to the start of the trace
+ */
+void traceReplayTests() {
+  const std::string traceName = "btree_replay_test";
+  try{ File::remove(indexName); }
+  catch(FileNotFoundException e){}
+  long numScanned = 0;
+  {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+    char key[32], highKey[32];
+    RecordId rid;
+    index.startTrace(traceName);
+    for (int i = 0; i < 50; i++) { // every other entry expires in an hour
+      sprintf(key, "%05d string record", relationSize + i);
+      rid.page_number = 9000;
+      rid.slot_number = i + 1;
+      index.insertEntry(key, rid, i % 2 == 0 ? expiryClock() + 3600 : NO_EXPIRY);
+    }
+    for (int i = 100; i < 140; i++) { // half of them are not in the index
+      sprintf(key, "%05d string record", i % 2 == 0 ? i : relationSize + 1000 + i);
+      if (!index.lookup(key, rid)) { rid.page_number = 9000; }
+      index.deleteEntry(key, rid);
+    }
+    for (int i = 90; i < 150; i++) {
+      sprintf(key, "%05d string record", i);
+      index.lookup(key, rid);
+    }
+    RecordId existingRid;
+    rid.page_number = 9000;
+    for (int i = 0; i < 2; i++) { // the second call of each finds the entry
+      rid.slot_number = 200 + i;
+      sprintf(key, "%05d string record", relationSize + 100);
+      index.insertUnique(key, rid, existingRid);
+      sprintf(key, "%05d string record", relationSize + 101);
+      index.upsert(key, rid, existingRid);
+    }
+    sprintf(highKey, "%05d string record", relationSize + 102);
+    index.updateKey(key, highKey, rid);
+    index.updateKey(key, highKey, rid); // already moved
+    sprintf(key, "%05d string record", 80);
+    sprintf(highKey, "%05d string record", relationSize + 20);
+    index.startScan(key, GTE, highKey, LT);
+    while (index.tryScanNext(rid) == SCAN_OK) { numScanned++; }
+    index.startScan(key, GTE, highKey, LT, keyBytesPredicate(4, "7", 1)); // replayed filtered
+    while (index.tryScanNext(rid) == SCAN_OK) { numScanned++; }
+    index.startScan(key, GTE, highKey, LT);
+    index.endScan();
+    try { // completing or ending a scan ends it
+      index.endScan();
+    } catch(ScanNotInitializedException e) {}
+    index.stopTrace();
+  }
+  File::remove(indexName);
+
+  FILE* trace = fopen(traceName.c_str(), "rb");
+  TraceHeader header;
+  checkPassFail(fread(&header, sizeof(TraceHeader), 1, trace), 1);
+  TraceRecord record;
+  TraceEntry entry;
+  bool relative = fread(&record, sizeof(TraceRecord), 1, trace) == 1
+    && fread(&entry, sizeof(TraceEntry), 1, trace) == 1
+    && record.op == TRACE_INSERT && record.result == 1
+    && entry.expiry >= 3599 && entry.expiry <= 3600;
+  checkPassFail(relative, true);
+  fseek(trace, sizeof(TraceHeader), SEEK_SET);
+  OpStats stats[TRACE_NUM_OPS];
+  long numRids = 0;
+  uint64_t elapsedNanos = 0;
+  checkPassFail(replayTrace(trace, header, bufMgr, true, stats, numRids, elapsedNanos), true);
+  fclose(trace);
+  remove(traceName.c_str());
+  checkPassFail(File::exists(indexName), false);
+  long numMismatches = 0;
+  for (int op = TRACE_INSERT; op < TRACE_NUM_OPS; op++) { numMismatches += stats[op].mismatches; }
+  checkPassFail(numMismatches, 0);
+  checkPassFail(stats[TRACE_INSERT].count, 50);
+  checkPassFail(stats[TRACE_DELETE].count, 40);
+  checkPassFail(stats[TRACE_LOOKUP].count, 100);
+  checkPassFail(stats[TRACE_START_SCAN].count, 2);
+  checkPassFail(stats[TRACE_START_FILTER_SCAN].count, 1);
+  checkPassFail(stats[TRACE_END_SCAN].count, 2);
+  checkPassFail(stats[TRACE_INSERT_UNIQUE].count, 2);
+  checkPassFail(stats[TRACE_UPSERT].count, 2);
+  checkPassFail(stats[TRACE_UPDATE_KEY].count, 2);
+  checkPassFail(numRids, numScanned);
+  printf("===Passed traceReplayTests===\n");
+}
+
+/**
+ * samplingTests - Draws a random sample from the index and checks that
+ * exactly the requested number comes back, that every sampled rid points at
+ * a heap record carrying the sampled key, and that the samples spread
+ * evenly over the key range
+ */
+void samplingTests() {
+  BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+  std::vector<RIDKeyPair> samples;
+  checkPassFail(index.sampleEntries(200, samples), 200);
+  checkPassFail((int) samples.size(), 200);
+  int numMatching = 0;
+  Page* curPage;
+  for (size_t i = 0; i < samples.size(); i++) {
+    bufMgr->readPage(file1, samples[i].rid.page_number, curPage);
+    RECORD myRec = *(RECORD*)(curPage->getRecord(samples[i].rid).c_str());
+    bufMgr->unPinPage(file1, samples[i].rid.page_number, false);
+    if (strncmp(myRec.s, samples[i].key, STRINGSIZE) == 0) { numMatching++; }
+  }
+  checkPassFail(numMatching, 200);
+  // keys are spread evenly over the leaves, so each tenth of the key range
+  // should get about a tenth of the samples (expected 200, sd about 13)
+  const int numBuckets = 10, numDrawn = 2000;
+  int buckets[numBuckets] = { 0 };
+  samples.clear();
+  checkPassFail(index.sampleEntries(numDrawn, samples), numDrawn);
+  for (size_t i = 0; i < samples.size(); i++) {
+    buckets[atoi(samples[i].key) * numBuckets / relationSize]++;
+  }
+  int numEven = 0;
+  for (int b = 0; b < numBuckets; b++) {
+    if (buckets[b] > numDrawn / numBuckets / 2 && buckets[b] < numDrawn / numBuckets * 3 / 2) { numEven++; }
+  }
+  checkPassFail(numEven, numBuckets);
+  printf("===Passed samplingTests===\n");
+}
+
+/**
+ * exportImportTests - Exports the index to a sorted run, rebuilds it from the
+ * run with the bulk loader, fully packed and half full, and checks scans and
+ * inserts on the rebuilt index, then that truncated or unsorted runs are
+ * refused
+ */
+void exportImportTests() {
+  const std::string runName = relationName + ".run";
+  BTreeIndex* index = new BTreeIndex(relationName, indexName, bufMgr, offsetof(tuple,s));
+  index->exportSorted(runName);
+  try { // writes fail on a full disk
+    index->exportSorted("/dev/full");
+    PRINT_ERROR("exporting to a full disk didn't throw BadIndexInfoException");
+  } catch (BadIndexInfoException e) {}
+  delete index;
+  File::remove(indexName);
+  IndexOptions options;
+  options.leafFillPercent = 101;
+  try {
+    BTreeIndex overfull(runName, indexName, bufMgr, options);
+    PRINT_ERROR("importing with a fill percentage over 100 didn't throw BadIndexInfoException");
+  } catch (BadIndexInfoException e) {}
+  std::vector<PageId> noPages;
+  options.leafFillPercent = 50;
+  index = new BTreeIndex(runName, indexName, bufMgr, options);
+  int halfFullLeaves = index->warmUp(false, relationSize, noPages);
+  checkPassFail(stringScan(index, 0, GTE, relationSize, LT), relationSize);
+  delete index;
+  File::remove(indexName);
+  index = new BTreeIndex(runName, indexName, bufMgr);
+  int fullLeaves = index->warmUp(false, relationSize, noPages);
+  bool halfFull = halfFullLeaves >= 2 * fullLeaves - 1;
+  checkPassFail(halfFull, true);
+  checkPassFail(stringScan(index, 0, GTE, relationSize, LT), relationSize);
+  checkPassFail(stringScan(index, 25, GT, 40, LT), 14);
+  checkPassFail(stringScan(index, 10, GTE, 10, LTE), 1);
+  try {
+    BTreeIndex duplicate(runName, indexName, bufMgr);
+    PRINT_ERROR("importing over an existing index didn't throw FileExistsException");
+  } catch (FileExistsException e) {}
+  // the packed tree must keep splitting correctly on later inserts
+  char key[STRINGSIZE + 1];
+  RecordId newRid;
+  newRid.page_number = 1;
+  newRid.slot_number = 1;
+  for (int i = 0; i < 100; i++) {
+    sprintf(key, "%05d%s", i * 7, "zzzz");
+    index->insertEntry(key, newRid);
+  }
+  checkPassFail(stringScan(index, 0, GTE, relationSize, LT), relationSize + 100);
+  delete index;
+  File::remove(indexName);
+
+  // the run is little-endian fixed-width fields; damaged runs are refused
+  std::string runBytes;
+  FILE* run = fopen(runName.c_str(), "rb");
+  char buffer[4096];
+  size_t numRead;
+  while ((numRead = fread(buffer, 1, sizeof(buffer), run)) > 0) { runBytes.append(buffer, numRead); }
+  fclose(run);
+  checkPassFail(runBytes.size(), (size_t) RUN_HEADER_BYTES + relationSize * RUN_RECORD_BYTES);
+  bool littleEndian = runBytes[8] == (char) RUN_FILE_VERSION && runBytes[11] == 0
+    && (unsigned char) runBytes[42] == (relationSize & 0xff) && runBytes[49] == 0;
+  checkPassFail(littleEndian, true);
+  std::string truncated = runBytes.substr(0, runBytes.size() - RUN_RECORD_BYTES);
+  std::string unsorted = runBytes;
+  unsorted.replace(RUN_HEADER_BYTES, STRINGSIZE, STRINGSIZE, 'z'); // first key sorts last
+  const std::string* damagedRuns[2] = { &truncated, &unsorted };
+  for (int i = 0; i < 2; i++) {
+    run = fopen(runName.c_str(), "wb");
+    fwrite(damagedRuns[i]->data(), 1, damagedRuns[i]->size(), run);
+    fclose(run);
+    try {
+      BTreeIndex damaged(runName, indexName, bufMgr);
+      PRINT_ERROR("importing a damaged run didn't throw BadIndexInfoException");
+    } catch (BadIndexInfoException e) {}
+    bool leftBehind = File::exists(indexName);
+    checkPassFail(leftBehind, false);
+  }
+  remove(runName.c_str());
+  printf("===Passed exportImportTests===\n");
+}
+
+/**
+ * mergeTests - Merges the index with itself by leaf-chain merge and checks
+ * that every entry shows up twice in the merged index, then that indexes of
+ * two relations are not merged
+ */
+void mergeTests() {
+  const std::string mergedName = indexName + ".merged";
+  try { File::remove(mergedName); }
+  catch(FileNotFoundException e) {}
+  {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+    BTreeIndex merged(index, index, mergedName, bufMgr);
+    checkPassFail(stringScan(&merged, 0, GTE, relationSize, LT), 2 * relationSize);
+    checkPassFail(stringScan(&merged, 25, GT, 40, LT), 28);
+    checkPassFail(stringScan(&merged, 10, GTE, 10, LTE), 2);
+    try {
+      BTreeIndex duplicate(index, index, mergedName, bufMgr);
+      PRINT_ERROR("merging into an existing index didn't throw FileExistsException");
+    } catch (FileExistsException e) {}
+  }
+  File::remove(mergedName);
+  const std::string otherRelationName = relationName + "b";
+  PageFile::create(otherRelationName); // empty, but on the same attribute
+  std::string otherIndexName;
+  {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+    BTreeIndex other(otherRelationName, otherIndexName, bufMgr, offsetof(tuple,s));
+    try {
+      BTreeIndex mixed(index, other, mergedName, bufMgr);
+      PRINT_ERROR("merging indexes of two relations didn't throw BadIndexInfoException");
+    } catch (BadIndexInfoException e) {}
+    bool created = File::exists(mergedName);
+    checkPassFail(created, false);
+  }
+  File::remove(otherIndexName);
+  File::remove(otherRelationName);
+  printf("===Passed mergeTests===\n");
+}
+
+/**
+ * lookupTests - Looks up present and absent keys one at a time and in a
+ * batch, and checks both agree on whether and where each key was found
+ */
+void lookupTests() {
+  BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+  const int numKeys = 200;
+  char keyStore[numKeys][32];
+  const char* keys[numKeys];
+  RecordId rids[numKeys];
+  bool found[numKeys];
+  for (int i = 0; i < numKeys; i++) { // keys past relationSize are misses
+    sprintf(keyStore[i], "%05d string record", (i * 37) % (relationSize + 500));
+    keys[i] = keyStore[i];
+  }
+  index.lookupBatch(keys, numKeys, rids, found);
+  int numMatching = 0;
+  for (int i = 0; i < numKeys; i++) {
+    RecordId rid;
+    bool expected = (i * 37) % (relationSize + 500) < relationSize;
+    bool foundOne = index.lookup(keys[i], rid);
+    if (foundOne == expected && found[i] == expected && (!expected
+        || (rid.page_number == rids[i].page_number && rid.slot_number == rids[i].slot_number))) {
+      numMatching++;
+    }
+  }
+  checkPassFail(numMatching, numKeys);
+  printf("===Passed lookupTests===\n");
+}
+
+/**
+ * uniqueTests - Builds a unique index and checks insertUnique, upsert and
+ * duplicate inserts, then that the uniqueness flag is checked on reopen
+ */
+void uniqueTests() {
+  try{ File::remove(indexName); }
+  catch(FileNotFoundException e){}
+  IndexOptions options;
+  options.unique = true;
+  char key[32];
+  RecordId rid, conflictRid, oldRid, newRid;
+  newRid.page_number = 1;
+  newRid.slot_number = 1;
+  {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s), options);
+    sprintf(key, "%05d string record", 42);
+    index.lookup(key, rid);
+    checkPassFail(index.insertUnique(key, newRid, conflictRid), false);
+    bool sameRid = conflictRid.page_number == rid.page_number && conflictRid.slot_number == rid.slot_number;
+    checkPassFail(sameRid, true);
+    index.insertEntry(key, newRid); // silently keeps the existing entry
+    checkPassFail(stringScan(&index, 42, GTE, 42, LTE), 1);
+    sprintf(key, "%05d extra record", 42);
+    checkPassFail(index.insertUnique(key, newRid, conflictRid), true);
+    checkPassFail(stringScan(&index, 0, GTE, relationSize, LT), relationSize + 1);
+    sprintf(key, "%05d string record", 43);
+    checkPassFail(index.upsert(key, newRid, oldRid), true);
+    index.lookup(key, rid);
+    sameRid = rid.page_number == newRid.page_number && rid.slot_number == newRid.slot_number;
+    checkPassFail(sameRid, true);
+    checkPassFail(stringScan(&index, 0, GTE, relationSize, LT), relationSize + 1);
+  }
+  try {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+    PRINT_ERROR("opening a unique index as non-unique didn't throw BadIndexInfoException");
+  } catch (BadIndexInfoException e) {}
+  File::remove(indexName);
+  printf("===Passed uniqueTests===\n");
+}
+
+/**
+ * deleteUpdateTests - Deletes a run of keys, checks scans across the emptied
+ * leaves, then moves entries with updateKey within and across leaves
+ */
+void deleteUpdateTests() {
+  {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+    char key[32], newKey[32];
+    RecordId rid;
+    int numDeleted = 0;
+    for (int i = 100; i < 200; i++) {
+      sprintf(key, "%05d string record", i);
+      if (index.lookup(key, rid) && index.deleteEntry(key, rid)) { numDeleted++; }
+    }
+    checkPassFail(numDeleted, 100);
+    checkPassFail(index.deleteEntry(key, rid), false);
+    checkPassFail(stringScan(&index, 50, GT, 250, LT), 99);
+    checkPassFail(stringScan(&index, 100, GTE, 199, LTE), 0);
+    // stays within its leaf: "00010 stri" -> "00010 strj"
+    sprintf(key, "%05d string record", 10);
+    sprintf(newKey, "%05d strj", 10);
+    index.lookup(key, rid);
+    checkPassFail(index.updateKey(key, newKey, rid), true);
+    checkPassFail(stringScan(&index, 10, GTE, 10, LTE), 0);
+    checkPassFail(stringScan(&index, 0, GTE, relationSize, LT), relationSize - 100);
+    RecordId movedRid;
+    checkPassFail(index.lookup(newKey, movedRid), true);
+    // moves to another leaf
+    sprintf(key, "%05d string record", 20);
+    sprintf(newKey, "%05d string record", 4000);
+    index.lookup(key, rid);
+    checkPassFail(index.updateKey(key, newKey, rid), true);
+    checkPassFail(stringScan(&index, 20, GTE, 20, LTE), 0);
+    checkPassFail(stringScan(&index, 4000, GTE, 4000, LTE), 2);
+    checkPassFail(index.updateKey(key, newKey, rid), false);
+    checkPassFail(stringScan(&index, 0, GTE, relationSize, LT), relationSize - 100);
+    // duplicates of one key split across leaves; each entry can be reached
+    sprintf(key, "%05d string record", 300);
+    sprintf(newKey, "%05d string record", 301);
+    RecordId dupRid;
+    for (int j = 0; j < 40; j++) {
+      dupRid.page_number = 9000 + j;
+      dupRid.slot_number = 1;
+      index.insertEntry(key, dupRid);
+    }
+    int numMoved = 0;
+    for (int j = 0; j < 40; j += 2) {
+      dupRid.page_number = 9000 + j;
+      dupRid.slot_number = 1;
+      if (index.updateKey(key, newKey, dupRid)) { numMoved++; }
+    }
+    checkPassFail(numMoved, 20);
+    numDeleted = 0;
+    for (int j = 0; j < 40; j++) {
+      dupRid.page_number = 9000 + j;
+      dupRid.slot_number = 1;
+      if (index.deleteEntry(j % 2 == 0 ? newKey : key, dupRid)) { numDeleted++; }
+    }
+    checkPassFail(numDeleted, 40);
+    checkPassFail(stringScan(&index, 300, GTE, 301, LTE), 2);
+  }
+  File::remove(indexName);
+  printf("===Passed deleteUpdateTests===\n");
+}
+
+/**
+ * lazyDeleteTests - Deletes entries lazily, checks that lookups and scans
+ * skip them (also after reopening without lazy deletes), then collects
+ * the garbage and checks that nothing live was lost
+ */
+void lazyDeleteTests() {
+  try{ File::remove(indexName); }
+  catch(FileNotFoundException e){}
+  IndexOptions options;
+  options.lazyDeletes = true;
+  char key[32];
+  RecordId rid;
+  {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s), options);
+    int numDeleted = 0;
+    for (int i = 0; i < 3000; i += 3) {
+      sprintf(key, "%05d string record", i);
+      if (index.lookup(key, rid) && index.deleteEntry(key, rid)) { numDeleted++; }
+    }
+    checkPassFail(numDeleted, 1000);
+    checkPassFail(index.deleteEntry(key, rid), false);
+    checkPassFail(index.lookup(key, rid), false);
+    checkPassFail(stringScan(&index, 0, GTE, 30, LT), 20);
+    checkPassFail(stringScan(&index, 0, GTE, relationSize, LT), relationSize - 1000);
+    sprintf(key, "%05d string record", 3);
+    bool noneLive = index.tryStartScan(key, GTE, key, LTE) == SCAN_NO_SUCH_KEY; // a tombstone only
+    checkPassFail(noneLive, true);
+    index.insertEntry(key, rid); // lands in a leaf holding tombstones
+    checkPassFail(stringScan(&index, 0, GTE, 30, LT), 21);
+  }
+  {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+    checkPassFail(stringScan(&index, 0, GTE, relationSize, LT), relationSize - 999);
+    bool merged = index.collectGarbage() > 0;
+    checkPassFail(merged, true);
+    checkPassFail(stringScan(&index, 0, GTE, relationSize, LT), relationSize - 999);
+    checkPassFail(stringScan(&index, 2990, GT, 3010, LTE), 17);
+    sprintf(key, "%05d string record", 2999);
+    checkPassFail(index.lookup(key, rid), true);
+  }
+  File::remove(indexName);
+  printf("===Passed lazyDeleteTests===\n");
+}
+
+/**
+ * ttlTests - Adds entries past the end of the relation's keys that have
+ * already expired and some that expire in an hour, checks that lookups and
+ * scans only see the live ones, then sweeps and checks that whole leaves
+ * were dropped and nothing live was lost
+ */
+void ttlTests() {
+  try{ File::remove(indexName); }
+  catch(FileNotFoundException e){}
+  char key[32];
+  RecordId rid;
+  {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+    sprintf(key, "%05d string record", 0);
+    index.lookup(key, rid); // a real record for the scans to read
+    uint32_t now = expiryClock();
+    for (int i = relationSize; i < relationSize + 1020; i++) {
+      sprintf(key, "%05d string record", i);
+      index.insertEntry(key, rid, i < relationSize + 1000 ? now - 1 : now + 3600);
+    }
+    sprintf(key, "%05d string record", 10);
+    index.insertEntry(key, rid, now - 1); // an expired duplicate among live keys
+    checkPassFail(stringScan(&index, 0, GTE, relationSize + 1020, LT), relationSize + 20);
+    checkPassFail(stringScan(&index, 10, GTE, 10, LTE), 1);
+    sprintf(key, "%05d string record", relationSize + 5);
+    checkPassFail(index.lookup(key, rid), false);
+    sprintf(key, "%05d string record", relationSize + 1010);
+    checkPassFail(index.lookup(key, rid), true);
+    char lowKey[32], highKey[32]; // a range holding only expired entries is empty
+    sprintf(lowKey, "%05d string record", relationSize);
+    sprintf(highKey, "%05d string record", relationSize + 1000);
+    bool noneLive = index.tryStartScan(lowKey, GTE, highKey, LT) == SCAN_NO_SUCH_KEY;
+    checkPassFail(noneLive, true);
+    bool swept = index.sweepExpired() > 0;
+    checkPassFail(swept, true);
+    checkPassFail(index.sweepExpired(), 0);
+    checkPassFail(stringScan(&index, 0, GTE, relationSize + 1020, LT), relationSize + 20);
+    checkPassFail(stringScan(&index, relationSize + 900, GTE, relationSize + 1020, LT), 20);
+    checkPassFail(index.lookup(key, rid), true);
+    sprintf(key, "%05d string record", relationSize + 5);
+    index.insertEntry(key, rid); // lands where a swept leaf used to be
+    checkPassFail(stringScan(&index, 0, GTE, relationSize + 1020, LT), relationSize + 21);
+    // new entries go in front of expired duplicates, so splits can leave the
+    // one live entry left of a separator equal to its key
+    sprintf(key, "%05d string record", relationSize + 2000);
+    RecordId liveRid = rid, deadRid, foundRid;
+    deadRid.page_number = 9000;
+    deadRid.slot_number = 1;
+    for (int i = 0; i < 10; i++) { index.insertEntry(key, deadRid, now - 1); }
+    checkPassFail(index.insertUnique(key, liveRid, foundRid), true);
+    for (int i = 0; i < 30; i++) { index.insertEntry(key, deadRid, now - 1); }
+    bool found = index.lookup(key, foundRid) && foundRid.page_number == liveRid.page_number;
+    checkPassFail(found, true);
+    bool conflict = !index.insertUnique(key, deadRid, foundRid) && foundRid.page_number == liveRid.page_number;
+    checkPassFail(conflict, true);
+    const char* keys[1] = { key };
+    bool batchFound[1];
+    index.lookupBatch(keys, 1, &foundRid, batchFound);
+    checkPassFail(batchFound[0], true);
+    checkPassFail(stringScan(&index, relationSize + 2000, GTE, relationSize + 2000, LTE), 1);
+  }
+  File::remove(indexName);
+  printf("===Passed ttlTests===\n");
+}
+
+/**
+ * prefixScanTests - Runs prefix scans of several lengths and checks the
+ * number of returned items is correct
+ */
+void prefixScanTests() {
+  BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+  checkPassFail(prefixScan(&index, "0001", 4), 10);
+  checkPassFail(prefixScan(&index, "00", 2), 1000);
+  checkPassFail(prefixScan(&index, "049", 3), 100);
+  checkPassFail(prefixScan(&index, "00010 string record", 10), 1);
+  checkPassFail(prefixScan(&index, "00010 string record", 50), 1);
+  checkPassFail(prefixScan(&index, "9", 1), 0); // no such key, 0 keys found
+  checkPassFail(prefixScan(&index, "", 0), relationSize);
+  printf("===Passed prefixScanTests===\n");
+}
+
+/**
+ * prefixScan - Runs a prefix scan and counts the returned items
+ * @param index - pointer to BTreeIndex to run scan on
+ * @param prefix - prefix to match
+ * @param len - number of leading bytes of prefix to match
+ * @return returns number of matching keys (results) found
+ */
+int prefixScan(BTreeIndex * index, const char* prefix, int len) {
+  int numResults = 0;
+  std::cout << "Prefix scan for " << std::string(prefix, std::min((int) strlen(prefix), len)) << std::endl;
+  try {
+    index->startPrefixScan(prefix, len);
+  } catch(NoSuchKeyFoundException e) { // if no matches found, return 0
+    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+    return 0;
+  }
+  try {
+    while(true) {
+      RecordId rid;
+      index->scanNext(rid);
+      numResults++;
+    }
+  } catch(IndexScanCompletedException e){}
+  return numResults;
+}
+
+/**
+ * collationTests - Builds a case-insensitive index and checks that lookups,
+ * scans and prefix scans match keys regardless of case, and that it cannot
+ * be reopened with other options or by another format version
+ */
+void collationTests() {
+  try{ File::remove(indexName); }
+  catch(FileNotFoundException e){}
+  IndexOptions options;
+  options.collation = NOCASE;
+  {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s), options);
+    RecordId rid;
+    checkPassFail(index.lookup("00010 STRING RECORD", rid), true);
+    checkPassFail(index.lookup("00010 StRiNg", rid), true);
+    checkPassFail(stringScan(&index, 5, GT, 15, LT), 9);
+    checkPassFail(prefixScan(&index, "00010 STR", 9), 1);
+    char key[32];
+    RecordId newRid;
+    newRid.page_number = 1;
+    newRid.slot_number = 1;
+    sprintf(key, "%05d STRING RECORD", 10);
+    index.insertEntry(key, newRid);
+    checkPassFail(stringScan(&index, 10, GTE, 10, LTE), 2);
+  }
+  try {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+    PRINT_ERROR("opening a NOCASE index as BINARY didn't throw BadIndexInfoException");
+  } catch (BadIndexInfoException e) {}
+  {
+    RawFile indexFile(indexName, false); // as if written by another build
+    Page* headerPage;
+    bufMgr->readPage(&indexFile, 1, headerPage);
+    ((IndexMetaInfo*) headerPage)->formatVersion = INDEX_FORMAT_VERSION + 1;
+    bufMgr->unPinPage(&indexFile, 1, true);
+    bufMgr->flushFile(&indexFile);
+  }
+  try {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s), options);
+    PRINT_ERROR("opening an index of another format version didn't throw BadIndexInfoException");
+  } catch (BadIndexInfoException e) {}
+  File::remove(indexName);
+  options.collation = LOCALE;
+  options.unique = true;
+  try {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s), options);
+    PRINT_ERROR("creating a unique LOCALE index didn't throw BadIndexInfoException");
+  } catch (BadIndexInfoException e) {}
+  bool created = File::exists(indexName);
+  checkPassFail(created, false);
+  printf("===Passed collationTests===\n");
+}
+
+/**
+ * sharedIndexTests - Shares an index through shared memory and checks that
+ * a reader sees the same entries, including ones inserted after sharing
+ */
+void sharedIndexTests() {
+  try{ File::remove(indexName); }
+  catch(FileNotFoundException e){}
+  const std::string segmentName = "/btree_shared_test";
+  char key[32];
+  RecordId rid, sharedRid, newRid;
+  newRid.page_number = 1;
+  newRid.slot_number = 1;
+  {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+    index.shareIndex(segmentName, 4096);
+    SharedIndexReader reader(segmentName);
+    int numMatching = 0;
+    for (int i = 0; i < relationSize; i += 7) {
+      sprintf(key, "%05d string record", i);
+      index.lookup(key, rid);
+      if (reader.lookup(key, sharedRid) && sharedRid.page_number == rid.page_number
+          && sharedRid.slot_number == rid.slot_number) {
+        numMatching++;
+      }
+    }
+    checkPassFail(numMatching, (relationSize + 6) / 7);
+    // inserts, and the splits they cause, are copied in as they happen
+    for (int i = 0; i < 200; i++) {
+      sprintf(key, "%05d extra record", i * 3 + 1);
+      index.insertEntry(key, newRid);
+    }
+    bool found = reader.lookup(key, sharedRid) && sharedRid.page_number == newRid.page_number;
+    checkPassFail(found, true);
+    int numScanned = 0;
+    char lowVal[32], highVal[32];
+    sprintf(lowVal, "%05d string record", 0);
+    sprintf(highVal, "%05d string record", relationSize);
+    reader.startScan(lowVal, GTE, highVal, LT);
+    try {
+      while (true) {
+        reader.scanNext(sharedRid);
+        numScanned++;
+      }
+    } catch(IndexScanCompletedException e) {}
+    checkPassFail(numScanned, relationSize + 200);
+    // a live entry left of a separator equal to its key, behind expired
+    // duplicates (see ttlTests), is found by readers too
+    sprintf(key, "%05d string record", relationSize + 2000);
+    RecordId deadRid;
+    deadRid.page_number = 9000;
+    deadRid.slot_number = 1;
+    for (int i = 0; i < 10; i++) { index.insertEntry(key, deadRid, expiryClock() - 1); }
+    index.insertEntry(key, newRid);
+    for (int i = 0; i < 30; i++) { index.insertEntry(key, deadRid, expiryClock() - 1); }
+    found = reader.lookup(key, sharedRid) && sharedRid.page_number == newRid.page_number;
+    checkPassFail(found, true);
+    numScanned = 0;
+    reader.startScan(key, GTE, key, LTE);
+    try {
+      while (true) {
+        reader.scanNext(sharedRid);
+        numScanned++;
+      }
+    } catch(IndexScanCompletedException e) {}
+    checkPassFail(numScanned, 1);
+    // leaves swept while shared are retired, not reused under the readers
+    index.sweepExpired();
+    found = reader.lookup(key, sharedRid) && sharedRid.page_number == newRid.page_number;
+    checkPassFail(found, true);
+  }
+  try {
+    SharedIndexReader reader(segmentName);
+    PRINT_ERROR("opening a segment removed with its index didn't throw BadIndexInfoException");
+  } catch(BadIndexInfoException e) {}
+  {
+    // a segment with no slots to spare: the write that outgrows it still
+    // goes into the index, and readers are cut off instead
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+    PageId maxPages = 1;
+    while (true) {
+      try {
+        index.shareIndex(segmentName, maxPages);
+        break;
+      } catch(BadIndexInfoException e) {
+        maxPages++;
+      }
+    }
+    bool outgrown = maxPages > 1;
+    checkPassFail(outgrown, true);
+    SharedIndexReader reader(segmentName);
+    sprintf(key, "%05d string record", 7);
+    bool found = reader.lookup(key, sharedRid);
+    checkPassFail(found, true);
+    for (int i = 0; i < relationSize && index.isShared(); i++) {
+      sprintf(key, "%05d more record", i * 3 + 2);
+      index.insertEntry(key, newRid);
+    }
+    bool shared = index.isShared();
+    checkPassFail(shared, false);
+    found = index.lookup(key, rid) && rid.page_number == newRid.page_number;
+    checkPassFail(found, true);
+    try {
+      reader.lookup(key, sharedRid);
+      PRINT_ERROR("reading a segment the index outgrew didn't throw BadIndexInfoException");
+    } catch(BadIndexInfoException e) {}
+  }
+  File::remove(indexName);
+  printf("===Passed sharedIndexTests===\n");
+}
+
 /**
  * testFileload - Tests if index can be deleted and re-opened correctly 
  * (including all header metadata), then tests BadIndexException cases
@@ -589,3 +1456,643 @@ void showInsertBackward() {
   delete index;
   return;
 }
+
+/**
+ * warmUpTests - Reopens the index with warm-up and checks the pages each
+ * kind of warm-up reads: the leaves counted under the non-leaf levels must
+ * match the leaves on the leaf chain
+ */
+void warmUpTests() {
+  std::vector<PageId> noPages;
+  int numInternal, numWithLeaves, numAllLeaves, numChain, numExtra;
+  {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+    numInternal = index.warmUp(true, 0, noPages);
+    numWithLeaves = index.warmUp(true, 3, noPages);
+    numAllLeaves = index.warmUp(true, relationSize, noPages) - numInternal;
+    numChain = index.warmUp(false, relationSize, noPages);
+    std::vector<PageId> extraPages;
+    extraPages.push_back(2);
+    extraPages.push_back((PageId) Page::INVALID_NUMBER);
+    extraPages.push_back(2);
+    numExtra = index.warmUp(false, 0, extraPages);
+  }
+  bool hasInternal = numInternal > 0;
+  checkPassFail(hasInternal, true);
+  checkPassFail(numWithLeaves, numInternal + 3);
+  checkPassFail(numChain, numAllLeaves);
+  checkPassFail(numExtra, 1);
+
+  IndexOptions options;
+  options.warmUpInternal = true;
+  options.warmUpLeaves = 10;
+  options.warmUpPages.push_back(2);
+  BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s), options);
+  RecordId rid;
+  checkPassFail(index.lookup("00042 string record", rid), true);
+  checkPassFail(stringScan(&index,25,GT,40,LT), 14);
+  printf("===Passed warmUpTests===\n");
+}
+
+/**
+ * hotSetTests - Reads part of an index with a hot set, then reopens it and
+ * checks that the recorded pages are read back a few per call
+ */
+void hotSetTests() {
+  try{ File::remove(indexName); }
+  catch(FileNotFoundException e){}
+  IndexOptions options;
+  options.hotSet = true;
+  RecordId rid;
+  char key[32];
+  {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s), options);
+    for (int i = 0; i < relationSize; i++) { // every leaf once, then some of them often
+      sprintf(key, "%05d string record", i);
+      index.lookup(key, rid);
+    }
+    for (int round = 0; round < 10; round++) {
+      for (int i = 1000; i < 1100; i++) {
+        sprintf(key, "%05d string record", i);
+        index.lookup(key, rid);
+      }
+    }
+  }
+  std::string hotSetName = indexName + ".hot";
+  HotSetHeader header;
+  FILE* hotSetFile = fopen(hotSetName.c_str(), "rb");
+  bool recorded = hotSetFile != NULL && fread(&header, sizeof(HotSetHeader), 1, hotSetFile) == 1
+    && memcmp(header.magic, HOT_SET_MAGIC, sizeof(header.magic)) == 0 && header.numPages > 0;
+  if (hotSetFile != NULL) { fclose(hotSetFile); }
+  checkPassFail(recorded, true);
+  {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s), options);
+    int numPending = index.loadHotSetPages(0);
+    bool somePending = numPending > HOT_SET_PAGES_PER_CALL && numPending <= (int) header.numPages;
+    checkPassFail(somePending, true);
+    checkPassFail(index.lookup("01042 string record", rid), true);
+    checkPassFail(index.loadHotSetPages(0), numPending - HOT_SET_PAGES_PER_CALL);
+    checkPassFail(index.loadHotSetPages(HOT_SET_MAX_PAGES), 0);
+    checkPassFail(stringScan(&index,1000,GTE,1100,LT), 100);
+    bool saved = index.saveHotSet() > 0;
+    checkPassFail(saved, true);
+  }
+  // a stale hot set naming a page past the end of the file is dropped
+  hotSetFile = fopen(hotSetName.c_str(), "r+b");
+  HotSetEntry staleEntry;
+  staleEntry.pageNo = 1000000;
+  staleEntry.accesses = 1000;
+  bool appended = hotSetFile != NULL && fread(&header, sizeof(HotSetHeader), 1, hotSetFile) == 1
+    && fseek(hotSetFile, 0, SEEK_END) == 0 && fwrite(&staleEntry, sizeof(HotSetEntry), 1, hotSetFile) == 1;
+  if (appended) {
+    header.numPages++;
+    appended = fseek(hotSetFile, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(HotSetHeader), 1, hotSetFile) == 1;
+  }
+  if (hotSetFile != NULL) { fclose(hotSetFile); }
+  checkPassFail(appended, true);
+  {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s), options);
+    checkPassFail(index.loadHotSetPages(HOT_SET_MAX_PAGES), 0);
+    checkPassFail(index.lookup("01042 string record", rid), true);
+  }
+  try{ File::remove(indexName); }
+  catch(FileNotFoundException e){}
+  remove(hotSetName.c_str());
+  printf("===Passed hotSetTests===\n");
+}
+
+/**
+ * catalogTests - Registers four indexes (on suffixes of the string field) in
+ * a catalog keeping two open, and checks they are opened on first use, that
+ * the least recently used unheld ones are closed, and that closed indexes
+ * reopen
+ */
+void catalogTests() {
+  std::vector<std::string> names;
+  RecordId rid;
+  {
+    IndexCatalog catalog(bufMgr, 2);
+    for (int i = 0; i < 4; i++) {
+      names.push_back(catalog.registerIndex(relationName, offsetof(tuple,s) + i));
+      try{ File::remove(names[i]); }
+      catch(FileNotFoundException e){}
+    }
+    checkPassFail(catalog.numRegistered(), 4);
+    checkPassFail(catalog.numOpen(), 0);
+    checkPassFail(File::exists(names[0]), false);
+
+    checkPassFail(catalog.acquire(names[0])->lookup("01042 string record", rid), true);
+    catalog.release(names[0]);
+    BTreeIndex* held = catalog.acquire(names[1]);
+    catalog.acquire(names[2]);
+    catalog.release(names[2]); // index 0 is the least recently used
+    checkPassFail(catalog.numOpen(), 2);
+    bool closed = catalog.entry(names[0])->index == NULL;
+    checkPassFail(closed, true);
+    checkPassFail(catalog.acquire(names[3])->lookup("42 string record", rid), true);
+    catalog.release(names[3]); // index 2 is closed, held index 1 stays open
+    closed = catalog.entry(names[2])->index == NULL;
+    checkPassFail(closed, true);
+    bool stillOpen = catalog.entry(names[1])->index == held;
+    checkPassFail(stillOpen, true);
+    checkPassFail(held->lookup("1042 string record", rid), true);
+
+    checkPassFail(catalog.acquire(names[0])->lookup("01042 string record", rid), true);
+    catalog.release(names[0]);
+    checkPassFail(catalog.entry(names[0])->numOpens, 2);
+    checkPassFail(catalog.closeIdle(0), 1);
+    catalog.release(names[1]);
+    checkPassFail(catalog.closeIdle(0), 1);
+    checkPassFail(catalog.numOpen(), 0);
+    // closed indexes keep their header
+    const CatalogEntry* closedEntry = catalog.entry(names[3]);
+    bool headerKept = closedEntry->hasHeader && closedEntry->index == NULL
+      && closedEntry->header.attrByteOffset == (int) offsetof(tuple,s) + 3
+      && closedEntry->header.rootPageNo != Page::INVALID_NUMBER;
+    checkPassFail(headerKept, true);
+
+    // a release makes an index the most recently used
+    catalog.acquire(names[0]);
+    catalog.acquire(names[1]);
+    catalog.release(names[1]);
+    catalog.release(names[0]); // index 1 is the least recently used
+    catalog.acquire(names[2]);
+    catalog.release(names[2]);
+    closed = catalog.entry(names[1])->index == NULL;
+    checkPassFail(closed, true);
+    stillOpen = catalog.entry(names[0])->index != NULL;
+    checkPassFail(stillOpen, true);
+    checkPassFail(catalog.closeIdle(0), 2);
+
+    bool thrown = false;
+    try {
+      catalog.acquire("missing.0");
+    } catch(BadIndexInfoException e) {
+      thrown = true;
+    }
+    checkPassFail(thrown, true);
+  }
+  for (size_t i = 0; i < names.size(); i++) {
+    try{ File::remove(names[i]); }
+    catch(FileNotFoundException e){}
+  }
+  printf("===Passed catalogTests===\n");
+}
+
+/**
+ * quotaTests - Checks that an index keeps its upper levels pinned and
+ * releases them when closed, that it reports the pages it brought into the
+ * buffer pool, and that catalog groups with quotas get private pools
+ */
+void quotaTests() {
+  try{ File::remove(indexName); }
+  catch(FileNotFoundException e){}
+  IndexOptions options;
+  options.reservedFrames = 2;
+  RecordId rid;
+  char key[32];
+  {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s), options);
+    bool reserved = index.numReservedFrames() > 0 && index.numReservedFrames() <= 2;
+    checkPassFail(reserved, true);
+    for (int i = relationSize; i < 2 * relationSize; i++) { // splits pin new upper nodes in place of lower ones
+      sprintf(key, "%05d string record", i);
+      index.insertEntry(key, rid);
+    }
+    reserved = index.numReservedFrames() > 0 && index.numReservedFrames() <= 2;
+    checkPassFail(reserved, true);
+  } // closing must unpin the reserved pages before flushing the file
+  {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s), options);
+    checkPassFail(index.numPagesTouched(), index.numReservedFrames() + 1); // the header too
+    checkPassFail(index.reserveInternalLevels(0), 0);
+    checkPassFail(stringScan(&index,1000,GTE,1100,LT), 100);
+    bool touched = index.numPagesTouched() > index.numReservedFrames() + 1;
+    checkPassFail(touched, true);
+  }
+  try{ File::remove(indexName); }
+  catch(FileNotFoundException e){}
+
+  std::string name, otherName;
+  {
+    IndexCatalog catalog(bufMgr, 8);
+    catalog.setGroupQuota("hot", 100);
+    catalog.setGroupQuotaBytes("cold", 10 * Page::SIZE + 1);
+    options.reservedFrames = 1000; // at most half the quota
+    name = catalog.registerIndex(relationName, offsetof(tuple,s), options, "hot");
+    BTreeIndex* index = catalog.acquire(name);
+    bool reserved = index->numReservedFrames() > 0 && index->numReservedFrames() <= 50;
+    checkPassFail(reserved, true);
+    checkPassFail(index->lookup("01042 string record", rid), true);
+    GroupUsage usage = catalog.usage("hot");
+    checkPassFail(usage.quotaFrames, 100);
+    checkPassFail(usage.numOpen, 1);
+    checkPassFail(usage.reservedFrames, index->numReservedFrames());
+    checkPassFail(usage.pagesTouched, index->numPagesTouched());
+    checkPassFail(catalog.usage("cold").quotaFrames, 10);
+    checkPassFail(catalog.usage("").numOpen, 0);
+    bool thrown = false;
+    try {
+      catalog.setGroupQuota("hot", 200);
+    } catch(BadIndexInfoException e) {
+      thrown = true;
+    }
+    checkPassFail(thrown, true);
+    // the group's indexes share half the quota between them
+    otherName = catalog.registerIndex(relationName, offsetof(tuple,s) + 1, options, "hot");
+    try{ File::remove(otherName); }
+    catch(FileNotFoundException e){}
+    BTreeIndex* other = catalog.acquire(otherName);
+    checkPassFail(other->lookup("1042 string record", rid), true);
+    bool capped = catalog.usage("hot").reservedFrames <= 50;
+    checkPassFail(capped, true);
+    catalog.release(name);
+    catalog.release(otherName);
+  }
+  try{ File::remove(name); }
+  catch(FileNotFoundException e){}
+  try{ File::remove(otherName); }
+  catch(FileNotFoundException e){}
+  printf("===Passed quotaTests===\n");
+}
+
+/**
+ * sharedScanTests - Runs overlapping ranges through one SharedScan, with
+ * cursors joining while the pass is under way, and checks every cursor gets
+ * each entry of its range once, with fewer leaf reads than separate passes
+ */
+void sharedScanTests() {
+  BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+  const char* bounds[3][2] = { { "01000", "03000" }, { "00500", "02000" }, { "02500", "02600" } };
+  int expected[3] = { 2000, 1500, 100 };
+  std::vector<RecordId> rids[3];
+  int separateReads = 0;
+  for (int i = 0; i < 3; i++) {
+    SharedScan scan(index);
+    int cursor = scan.attach(bounds[i][0], GTE, bounds[i][1], LT);
+    checkPassFail(drainCursor(scan, cursor, relationSize, rids[i]), expected[i]);
+    separateReads += scan.numLeafReads();
+  }
+  {
+    SharedScan scan(index);
+    std::vector<RecordId> sharedRids[3];
+    int cursors[3];
+    cursors[0] = scan.attach(bounds[0][0], GTE, bounds[0][1], LT);
+    drainCursor(scan, cursors[0], 500, sharedRids[0]);
+    cursors[1] = scan.attach(bounds[1][0], GTE, bounds[1][1], LT); // joins past its low bound
+    cursors[2] = scan.attach(bounds[2][0], GTE, bounds[2][1], LT); // joins before its range
+    int numMatching = 0;
+    for (int i = 0; i < 3; i++) {
+      drainCursor(scan, cursors[i], relationSize, sharedRids[i]);
+      std::vector<RecordId> got(sharedRids[i]), want(rids[i]); // the catch-up changes the order
+      std::sort(got.begin(), got.end(), lowerRid);
+      std::sort(want.begin(), want.end(), lowerRid);
+      if (got == want) { numMatching++; }
+    }
+    checkPassFail(numMatching, 3);
+    bool fewerReads = scan.numLeafReads() < separateReads;
+    checkPassFail(fewerReads, true);
+    RecordId rid;
+    checkPassFail(scan.next(cursors[1], rid), SCAN_COMPLETED);
+    scan.detach(cursors[1]);
+    checkPassFail(scan.next(cursors[1], rid), SCAN_NOT_INITIALIZED);
+    checkPassFail(scan.next(7, rid), SCAN_NOT_INITIALIZED);
+  }
+  SharedScan scan(index);
+  bool thrown = false;
+  try {
+    scan.attach("02000", GTE, "01000", LT);
+  } catch(BadScanrangeException e) {
+    thrown = true;
+  }
+  checkPassFail(thrown, true);
+  thrown = false;
+  try {
+    scan.attach("01000", LT, "02000", LT);
+  } catch(BadOpcodesException e) {
+    thrown = true;
+  }
+  checkPassFail(thrown, true);
+  printf("===Passed sharedScanTests===\n");
+}
+
+/**
+ * rangeCacheTests - Repeats scans on an index with a range cache and checks
+ * they are served from it until a leaf they read changes, and that partial
+ * and oversized results are not cached
+ */
+void rangeCacheTests() {
+  try{ File::remove(indexName); }
+  catch(FileNotFoundException e){}
+  IndexOptions options;
+  options.rangeCacheRids = 1000;
+  RecordId rid;
+  BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s), options);
+  checkPassFail(stringScan(&index,1000,GTE,1100,LT), 100);
+  checkPassFail(stringScan(&index,1000,GTE,1100,LT), 100);
+  checkPassFail(index.numRangeCacheMisses(), 1);
+  checkPassFail(index.numRangeCacheHits(), 1);
+  checkPassFail(stringScan(&index,6000,GTE,6100,LT), 0); // empty results are cached too
+  checkPassFail(stringScan(&index,6000,GTE,6100,LT), 0);
+  checkPassFail(index.numRangeCacheHits(), 2);
+
+  index.lookup("04000 string record", rid);
+  index.insertEntry("01050 new!", rid); // lands on a leaf the cached scan read
+  checkPassFail(stringScan(&index,1000,GTE,1100,LT), 101);
+  checkPassFail(index.numRangeCacheMisses(), 3);
+  checkPassFail(stringScan(&index,1000,GTE,1100,LT), 101);
+  checkPassFail(index.numRangeCacheHits(), 3);
+
+  index.startScan("01000", GTE, "01100", LT); // ended early: not cached
+  index.scanNext(rid);
+  index.endScan();
+  index.setRangeCache(0);
+  index.setRangeCache(50); // the result no longer fits
+  checkPassFail(stringScan(&index,1000,GTE,1100,LT), 101);
+  checkPassFail(stringScan(&index,1000,GTE,1100,LT), 101);
+  checkPassFail(index.numRangeCacheHits(), 0);
+  checkPassFail(stringScan(&index,1000,GTE,1010,LT), 10);
+  checkPassFail(stringScan(&index,1000,GTE,1010,LT), 10);
+  checkPassFail(index.numRangeCacheHits(), 1);
+  try{ File::remove(indexName); }
+  catch(FileNotFoundException e){}
+  printf("===Passed rangeCacheTests===\n");
+}
+
+/**
+ * predicateScanTests - Runs range scans with key predicates and checks only
+ * the keys passing the predicate are returned
+ */
+void predicateScanTests() {
+  BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+  checkPassFail(predicateScan(&index, 0, 1000, keyBytesPredicate(4, "7", 1)), 100);
+  KeyPredicate notSeven = keyBytesPredicate(4, "7", 1);
+  notSeven.negate = true;
+  checkPassFail(predicateScan(&index, 0, 1000, notSeven), 900);
+  checkPassFail(predicateScan(&index, 0, 1000, keyContainsPredicate("77", 2)), 19);
+  checkPassFail(predicateScan(&index, 0, 5000, keyContainsPredicate("0 s", 3)), 500);
+  checkPassFail(predicateScan(&index, 0, 5000, keyBytesPredicate(6, "stri", 4)), relationSize);
+  checkPassFail(predicateScan(&index, 0, 5000, keyBytesPredicate(6, "STRI", 4)), 0);
+  checkPassFail(predicateScan(&index, 1000, 1010, keyBytesPredicate(0, "9", 1)), 0);
+  bool noneMatch = index.tryStartScan("01000", GTE, "01010", LT, keyBytesPredicate(0, "9", 1))
+    == SCAN_NO_SUCH_KEY;
+  checkPassFail(noneMatch, true);
+  KeyPredicate lowBits = keyBytesPredicate(4, "1", 1); // odd last digits: '1' & 0x01
+  lowBits.mask[4] = 0x01;
+  checkPassFail(predicateScan(&index, 0, 1000, lowBits), 500);
+  printf("===Passed predicateScanTests===\n");
+}
+
+/**
+ * predicateScan - Runs a range scan with a key predicate and counts the
+ * returned items
+ * @param index - pointer to BTreeIndex to run scan on
+ * @param lowVal - low end of the range (inclusive)
+ * @param highVal - high end of the range (exclusive)
+ * @param predicate - key predicate of the scan
+ * @return returns number of keys in the range passing the predicate
+ */
+int predicateScan(BTreeIndex * index, int lowVal, int highVal, const KeyPredicate& predicate) {
+  char lowValStr[100];
+  sprintf(lowValStr,"%05d string record",lowVal);
+  char highValStr[100];
+  sprintf(highValStr,"%05d string record",highVal);
+  int numResults = 0;
+  try {
+    index->startScan(lowValStr, GTE, highValStr, LT, predicate);
+  } catch(NoSuchKeyFoundException e) {
+    return 0;
+  }
+  try {
+    while(true) {
+      RecordId rid;
+      index->scanNext(rid);
+      numResults++;
+    }
+  } catch(IndexScanCompletedException e){}
+  return numResults;
+}
+
+/**
+ * aggregateTests - Builds an INTEGER index over the int field and checks
+ * aggregate scans over several ranges, including negative keys and keys
+ * deleted from the range
+ */
+void aggregateTests() {
+  const std::string traceName = "btree_aggregate_trace";
+  IndexOptions options;
+  options.collation = INTEGER;
+  std::string intIndexName;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), options);
+    RecordId rid;
+    int key = 1050;
+    checkPassFail(index.lookup((const char*) &key, rid), true);
+    index.startTrace(traceName);
+    KeyAggregate aggregate = index.aggregateScan(1000, GTE, 1100, LT);
+    index.stopTrace();
+    checkPassFail(aggregate.count, 100);
+    checkPassFail(aggregate.sum, 104950);
+    checkPassFail(aggregate.min, 1000);
+    checkPassFail(aggregate.max, 1099);
+    aggregate = index.aggregateScan(0, GTE, relationSize, LT);
+    checkPassFail(aggregate.count, relationSize);
+    checkPassFail(aggregate.sum, (int64_t) relationSize * (relationSize - 1) / 2);
+    checkPassFail(index.aggregateScan(relationSize - 1, GT, relationSize, LTE).count, 0);
+
+    index.deleteEntry((const char*) &key, rid);
+    key = -5;
+    index.insertEntry((const char*) &key, rid);
+    aggregate = index.aggregateScan(-10, GTE, 1100, LT);
+    checkPassFail(aggregate.count, 1100);
+    checkPassFail(aggregate.sum, 1100 * 1099 / 2 - 1050 - 5);
+    checkPassFail(aggregate.min, -5);
+    aggregate = index.aggregateScan(1000, GT, 1100, LTE);
+    checkPassFail(aggregate.count, 99);
+    checkPassFail(aggregate.max, 1100);
+  }
+  try {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+    index.aggregateScan(0, GTE, 10, LT);
+    PRINT_ERROR("aggregate scan of a BINARY index didn't throw BadOpcodesException");
+  } catch (BadOpcodesException e) {}
+  File::remove(intIndexName);
+
+  // the traced aggregate scan replays with the same count
+  FILE* trace = fopen(traceName.c_str(), "rb");
+  TraceHeader header;
+  TraceRecord record;
+  int bounds[2 * STRINGSIZE / sizeof(int)];
+  bool traced = fread(&header, sizeof(TraceHeader), 1, trace) == 1
+    && fread(&record, sizeof(TraceRecord), 1, trace) == 1
+    && fread(bounds, 2 * STRINGSIZE, 1, trace) == 1
+    && record.op == TRACE_AGGREGATE_SCAN && record.result == 100
+    && record.lowOp == GTE && record.highOp == LT;
+  checkPassFail(traced, true);
+  checkPassFail(bounds[0], 1000);
+  fseek(trace, sizeof(TraceHeader), SEEK_SET);
+  OpStats stats[TRACE_NUM_OPS];
+  long numRids = 0;
+  uint64_t elapsedNanos = 0;
+  checkPassFail(replayTrace(trace, header, bufMgr, true, stats, numRids, elapsedNanos), true);
+  fclose(trace);
+  remove(traceName.c_str());
+  checkPassFail(stats[TRACE_AGGREGATE_SCAN].count, 1);
+  checkPassFail(stats[TRACE_AGGREGATE_SCAN].mismatches, 0);
+  printf("===Passed aggregateTests===\n");
+}
+
+/**
+ * drainCursor - Fetches up to maxRids entries of a shared scan cursor
+ * @return the number of entries fetched
+ */
+int drainCursor(SharedScan& scan, int cursor, int maxRids, std::vector<RecordId>& rids) {
+  RecordId rid;
+  int numRids = 0;
+  while (numRids < maxRids && scan.next(cursor, rid) == SCAN_OK) {
+    rids.push_back(rid);
+    numRids++;
+  }
+  return numRids;
+}
+
+bool lowerRid(const RecordId& a, const RecordId& b) {
+  return a.page_number < b.page_number
+    || (a.page_number == b.page_number && a.slot_number < b.slot_number);
+}
+
+// -----------------------------------------------------------------------------
+//  Benchmarks
+// -----------------------------------------------------------------------------
+
+/**
+ * runBenchmarks - Runs each benchmark once on a fresh forward relation
+ */
+void runBenchmarks() {
+  printf("---------------------\n");
+  printf("BENCHMARKS (%s build)\n", BTREE_BUILD);
+  printf("---------------------\n");
+  createRelationForward();
+  try{ File::remove(indexName); }
+  catch(FileNotFoundException e){}
+  lookupBenchmark();
+  shortScanBenchmark();
+  try{ File::remove(indexName); }
+  catch(FileNotFoundException e){}
+  insertBenchmark();
+  try{ File::remove(indexName); }
+  catch(FileNotFoundException e){}
+  deleteRelation();
+}
+
+/**
+ * lookupBenchmark - Compares the throughput of random point lookups made
+ * one at a time with lookup() against lookupBatch() at batch sizes 1 to 64
+ */
+void lookupBenchmark() {
+  BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+  const int numLookups = 200000;
+  std::vector<std::string> keyStore(numLookups);
+  std::vector<const char*> keys(numLookups);
+  std::vector<RecordId> rids(numLookups);
+  bool* found = new bool[numLookups];
+  char key[32];
+  srand(1);
+  for (int i = 0; i < numLookups; i++) {
+    sprintf(key, "%05d string record", rand() % relationSize);
+    keyStore[i] = key;
+  }
+  for (int i = 0; i < numLookups; i++) { keys[i] = keyStore[i].c_str(); }
+
+  clock_t start = clock();
+  for (int i = 0; i < numLookups; i++) {
+    found[i] = index.lookup(keys[i], rids[i]);
+  }
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  printf("lookup():           %10.0f lookups/s\n", numLookups / seconds);
+  for (int batch = 1; batch <= 64; batch *= 2) {
+    start = clock();
+    for (int i = 0; i < numLookups; i += batch) {
+      int n = std::min(batch, numLookups - i);
+      index.lookupBatch(&keys[i], n, &rids[i], &found[i]);
+    }
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("lookupBatch(%2d):    %10.0f lookups/s\n", batch, numLookups / seconds);
+  }
+  delete[] found;
+}
+
+/**
+ * shortScanBenchmark - Compares short range scans run through the throwing
+ * calls, which end every scan with IndexScanCompletedException and every
+ * empty range with NoSuchKeyFoundException, against the same scans run
+ * through tryStartScan() and tryScanNext(). One scan in four is past the
+ * last key and finds nothing.
+ */
+void shortScanBenchmark() {
+  BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+  const int numScans = 200000;
+  const int rangeSize = 4;
+  std::vector<int> lows(numScans);
+  srand(1);
+  for (int i = 0; i < numScans; i++) {
+    lows[i] = rand() % 4 == 0 ? relationSize + rand() % relationSize : rand() % relationSize;
+  }
+  char lowKey[32], highKey[32];
+  RecordId rid;
+  long numRids = 0;
+  clock_t start = clock();
+  for (int i = 0; i < numScans; i++) {
+    sprintf(lowKey, "%05d string record", lows[i]);
+    sprintf(highKey, "%05d string record", lows[i] + rangeSize);
+    try {
+      index.startScan(lowKey, GTE, highKey, LT);
+      while (true) {
+        index.scanNext(rid);
+        numRids++;
+      }
+    } catch (NoSuchKeyFoundException e) {
+    } catch (IndexScanCompletedException e) {}
+  }
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  printf("startScan/scanNext:       %10.0f scans/s (%ld rids)\n", numScans / seconds, numRids);
+  numRids = 0;
+  start = clock();
+  for (int i = 0; i < numScans; i++) {
+    sprintf(lowKey, "%05d string record", lows[i]);
+    sprintf(highKey, "%05d string record", lows[i] + rangeSize);
+    if (index.tryStartScan(lowKey, GTE, highKey, LT) != SCAN_OK) { continue; }
+    while (index.tryScanNext(rid) == SCAN_OK) { numRids++; }
+  }
+  seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  printf("tryStartScan/tryScanNext: %10.0f scans/s (%ld rids)\n", numScans / seconds, numRids);
+}
+
+/**
+ * insertBenchmark - Times building the index from the relation, which
+ * inserts the keys in relation order, and then inserting random keys into
+ * it, which splits leaves all over the tree
+ */
+void insertBenchmark() {
+  clock_t start = clock();
+  BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple,s));
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  printf("index build:        %10.0f inserts/s\n", relationSize / seconds);
+  const int numInserts = 100000;
+  std::vector<std::string> keys(numInserts);
+  char key[32];
+  srand(1);
+  for (int i = 0; i < numInserts; i++) {
+    sprintf(key, "%05d+%04d", rand() % relationSize, rand() % 10000);
+    keys[i] = key;
+  }
+  RecordId rid;
+  start = clock();
+  for (int i = 0; i < numInserts; i++) {
+    rid.page_number = i / 100 + 1;
+    rid.slot_number = i % 100;
+    index.insertEntry(keys[i].c_str(), rid);
+  }
+  seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  printf("insertEntry():      %10.0f inserts/s\n", numInserts / seconds);
+}
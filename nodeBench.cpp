@@ -0,0 +1,442 @@
+/**
+ * nodeBench.cpp
+ * Microbenchmarks of the node-level helpers of BTreeIndex: getLeafLength,
+ * getNonLeafLength, insertInRoomyLeaf, insertInRoomyNonLeaf, findKeyInLeaf,
+ * findChildIndex, the range check of matchRange and both splits. Nodes are
+ * built in memory, so no heap file or buffer pool is involved, and each
+ * helper is run over several key distributions. Reports ns per call, the
+ * best of several repetitions, so numbers are stable enough to compare node
+ * layouts.
+ *
+ * The fanout is that of btree.h: the DEBUG fanout by default, the
+ * full-page one when compiled with -DPRODUCTION_FANOUT. Build both to see
+ * a layout change at either size. This file includes btree.cpp itself, so
+ * btree.cpp is not linked in separately:
+ *   g++ -std=c++11 -O2 nodeBench.cpp sharedIndex.cpp <wiscdb sources> -o nodeBench
+ *   g++ -std=c++11 -O2 -DPRODUCTION_FANOUT nodeBench.cpp ... -o nodeBenchProd
+ *
+ * Compiled with -DBENCH_COUNT_COMPARES, strncmp in btree.cpp is wrapped to
+ * count key comparisons, and the benchmark reports comparisons per call
+ * instead of timings, which the counting would skew:
+ *   g++ -std=c++11 -O2 -DBENCH_COUNT_COMPARES nodeBench.cpp ... -o nodeBenchCompares
+ *
+ * Usage: nodeBench [repetitions]
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department,
+ * University of Wisconsin-Madison.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cstring>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/**
+ * Key comparisons made by the node helpers; with BENCH_COUNT_COMPARES
+ * every strncmp in btree.cpp counts one, otherwise it stays 0.
+ */
+static uint64_t numCompares = 0;
+
+#ifdef BENCH_COUNT_COMPARES
+#define strncmp(a, b, n) (numCompares++, ::strncmp((a), (b), (n)))
+#include "btree.cpp"
+#undef strncmp
+#else
+#include "btree.cpp"
+#endif
+
+namespace wiscdb
+{
+
+/**
+ * @brief Keys a benchmark fills nodes with and probes them for.
+ */
+enum KeyDistribution
+{
+  SEQUENTIAL,   /* ascending keys, so inserts append */
+  REVERSE,      /* descending keys, so inserts shift the whole node */
+  UNIFORM,      /* uniformly random keys */
+  FEW_DISTINCT  /* random keys from 16 values, so most keys are duplicates */
+};
+
+const int NUM_DISTRIBUTIONS = 4;
+const char* distributionNames[NUM_DISTRIBUTIONS] = { "sequential", "reverse", "uniform", "few-distinct" };
+
+/**
+ * Nodes each benchmark works on, enough to defeat branch history yet
+ * small enough to stay in cache.
+ */
+const int BENCH_NODES = 64;
+
+/**
+ * Calls per timed repetition of the helpers that do not modify nodes.
+ */
+const int BENCH_PROBES = 1 << 18;
+
+/**
+ * @brief Times the node helpers of BTreeIndex, whose private members it
+ * may call.
+ */
+class NodeBench {
+ public:
+  NodeBench(const int repetitions);
+  ~NodeBench();
+
+  /**
+   * Runs every benchmark over every key distribution and prints a line
+   * per pair.
+   */
+  void run();
+
+ private:
+  int repetitions;
+  LeafNode* leaves;
+  LeafNode* spareLeaves;
+  NonLeafNode* nodes;
+  NonLeafNode* spareNodes;
+  std::vector<std::string> keys;
+  std::vector<std::string> probes;
+
+  /**
+   * Fills keys with at least count keys, and probes with BENCH_PROBES keys,
+   * from a distribution
+   */
+  void makeKeys(const KeyDistribution dist, const int count);
+  std::string makeKey(const KeyDistribution dist, const int i, const int count);
+
+  /**
+   * Empties the benchmark nodes, then fills each with numKeys keys taken in
+   * order from keys, starting with node i at key i * numKeys
+   */
+  void fillLeaves(LeafNode* target, const int numKeys);
+  void fillNonLeaves(NonLeafNode* target, const int numKeys);
+
+  void benchLength(const KeyDistribution dist);
+  void benchInsertLeaf(const KeyDistribution dist);
+  void benchInsertNonLeaf(const KeyDistribution dist);
+  void benchFindKeyInLeaf(const KeyDistribution dist);
+  void benchFindChildIndex(const KeyDistribution dist);
+  void benchKeyInRange(const KeyDistribution dist);
+  void benchSplitLeaf(const KeyDistribution dist);
+  void benchSplitNonLeaf(const KeyDistribution dist);
+
+  static uint64_t nowNanos();
+
+  /**
+   * Prints one result line: the time per call, or with BENCH_COUNT_COMPARES
+   * the key comparisons per call
+   */
+  static void report(const char* helper, const KeyDistribution dist, const uint64_t bestNanos,
+                     const long ops, const uint64_t compares);
+};
+
+NodeBench::NodeBench(const int repetitions) : repetitions(repetitions) {
+  leaves = new LeafNode[BENCH_NODES];
+  spareLeaves = new LeafNode[BENCH_NODES];
+  nodes = new NonLeafNode[BENCH_NODES];
+  spareNodes = new NonLeafNode[BENCH_NODES];
+}
+
+NodeBench::~NodeBench() {
+  delete[] leaves;
+  delete[] spareLeaves;
+  delete[] nodes;
+  delete[] spareNodes;
+}
+
+void NodeBench::run() {
+#ifdef BENCH_COUNT_COMPARES
+  printf("leaf size:%d non-leaf size:%d, %d nodes, counting key comparisons\n",
+         LEAF_NUM_KEYS, NON_LEAF_NUM_KEYS, BENCH_NODES);
+  printf("%-22s %-13s %10s\n", "helper", "keys", "cmp/op");
+#else
+  printf("leaf size:%d non-leaf size:%d, %d nodes, best of %d runs\n",
+         LEAF_NUM_KEYS, NON_LEAF_NUM_KEYS, BENCH_NODES, repetitions);
+  printf("%-22s %-13s %10s\n", "helper", "keys", "ns/op");
+#endif
+  for(int d = 0; d < NUM_DISTRIBUTIONS; d++) {
+    KeyDistribution dist = (KeyDistribution) d;
+    makeKeys(dist, BENCH_NODES * (std::max(LEAF_NUM_KEYS, NON_LEAF_NUM_KEYS) + 1));
+    benchLength(dist);
+    benchInsertLeaf(dist);
+    benchInsertNonLeaf(dist);
+    benchFindKeyInLeaf(dist);
+    benchFindChildIndex(dist);
+    benchKeyInRange(dist);
+    benchSplitLeaf(dist);
+    benchSplitNonLeaf(dist);
+  }
+}
+
+std::string NodeBench::makeKey(const KeyDistribution dist, const int i, const int count) {
+  char key[STRINGSIZE + 1];
+  int value;
+  switch(dist) {
+    case SEQUENTIAL: value = i; break;
+    case REVERSE: value = count - i; break;
+    case UNIFORM: value = rand(); break;
+    default: value = rand() % 16; break;
+  }
+  snprintf(key, sizeof(key), "%0*d", STRINGSIZE, value);
+  return std::string(key, STRINGSIZE);
+}
+
+void NodeBench::makeKeys(const KeyDistribution dist, const int count) {
+  srand(1);
+  keys.resize(count);
+  for(int i = 0; i < count; i++) { keys[i] = makeKey(dist, i, count); }
+  probes.resize(BENCH_PROBES);
+  for(int i = 0; i < BENCH_PROBES; i++) { //probe keys of the same distribution, in random order
+    probes[i] = dist == UNIFORM || dist == FEW_DISTINCT ? makeKey(dist, i, count) : keys[rand() % count];
+  }
+}
+
+void NodeBench::fillLeaves(LeafNode* target, const int numKeys) {
+  memset(target, 0, sizeof(LeafNode) * BENCH_NODES);
+  for(int n = 0; n < BENCH_NODES; n++) {
+    for(int i = 0; i < numKeys; i++) {
+      RIDKeyPair krid;
+      krid.set(RecordId(), keys[n * numKeys + i].c_str(), NO_EXPIRY);
+      krid.rid.page_number = n + 1;
+      krid.rid.slot_number = i + 1;
+      BTreeIndex::insertInRoomyLeaf(&target[n], krid);
+    }
+  }
+}
+
+void NodeBench::fillNonLeaves(NonLeafNode* target, const int numKeys) {
+  memset(target, 0, sizeof(NonLeafNode) * BENCH_NODES);
+  for(int n = 0; n < BENCH_NODES; n++) {
+    target[n].level = 1;
+    target[n].pageNoArray[0] = 1;
+    for(int i = 0; i < numKeys; i++) {
+      PageKeyPair pageKey;
+      pageKey.set(i + 2, keys[n * numKeys + i].c_str());
+      BTreeIndex::insertInRoomyNonLeaf(&target[n], pageKey);
+    }
+  }
+}
+
+void NodeBench::benchLength(const KeyDistribution dist) {
+  //fill levels vary from node to node so the length loops exit at different slots
+  memset(leaves, 0, sizeof(LeafNode) * BENCH_NODES);
+  memset(nodes, 0, sizeof(NonLeafNode) * BENCH_NODES);
+  for(int n = 0; n < BENCH_NODES; n++) {
+    int leafLength = rand() % (LEAF_NUM_KEYS + 1);
+    for(int i = 0; i < leafLength; i++) {
+      RIDKeyPair krid;
+      krid.set(RecordId(), keys[i].c_str(), NO_EXPIRY);
+      krid.rid.page_number = 1;
+      BTreeIndex::insertInRoomyLeaf(&leaves[n], krid);
+    }
+    int nodeLength = rand() % (NON_LEAF_NUM_KEYS + 1);
+    nodes[n].pageNoArray[0] = 1;
+    for(int i = 0; i < nodeLength; i++) {
+      PageKeyPair pageKey;
+      pageKey.set(i + 2, keys[i].c_str());
+      BTreeIndex::insertInRoomyNonLeaf(&nodes[n], pageKey);
+    }
+  }
+  volatile int sink = 0;
+  uint64_t bestLeaf = UINT64_MAX, bestNonLeaf = UINT64_MAX;
+  for(int r = 0; r < repetitions; r++) {
+    uint64_t start = nowNanos();
+    int total = 0;
+    for(int i = 0; i < BENCH_PROBES; i++) { total += BTreeIndex::getLeafLength(&leaves[i % BENCH_NODES]); }
+    bestLeaf = std::min(bestLeaf, nowNanos() - start);
+    start = nowNanos();
+    for(int i = 0; i < BENCH_PROBES; i++) { total += BTreeIndex::getNonLeafLength(&nodes[i % BENCH_NODES]); }
+    bestNonLeaf = std::min(bestNonLeaf, nowNanos() - start);
+    sink += total;
+  }
+  report("getLeafLength", dist, bestLeaf, BENCH_PROBES, 0);
+  report("getNonLeafLength", dist, bestNonLeaf, BENCH_PROBES, 0);
+}
+
+void NodeBench::benchInsertLeaf(const KeyDistribution dist) {
+  std::vector<RIDKeyPair> pairs(BENCH_NODES * LEAF_NUM_KEYS);
+  for(size_t i = 0; i < pairs.size(); i++) {
+    pairs[i].set(RecordId(), keys[i].c_str(), NO_EXPIRY);
+    pairs[i].rid.page_number = i + 1;
+  }
+  uint64_t best = UINT64_MAX, compares = 0;
+  for(int r = 0; r < repetitions; r++) {
+    memset(leaves, 0, sizeof(LeafNode) * BENCH_NODES);
+    numCompares = 0;
+    uint64_t start = nowNanos();
+    for(int n = 0; n < BENCH_NODES; n++) { //fill each leaf from empty to full
+      for(int i = 0; i < LEAF_NUM_KEYS; i++) {
+        BTreeIndex::insertInRoomyLeaf(&leaves[n], pairs[n * LEAF_NUM_KEYS + i]);
+      }
+    }
+    best = std::min(best, nowNanos() - start);
+    compares = numCompares;
+  }
+  report("insertInRoomyLeaf", dist, best, pairs.size(), compares);
+}
+
+void NodeBench::benchInsertNonLeaf(const KeyDistribution dist) {
+  std::vector<PageKeyPair> pairs(BENCH_NODES * NON_LEAF_NUM_KEYS);
+  for(size_t i = 0; i < pairs.size(); i++) { pairs[i].set(i + 2, keys[i].c_str()); }
+  uint64_t best = UINT64_MAX, compares = 0;
+  for(int r = 0; r < repetitions; r++) {
+    memset(nodes, 0, sizeof(NonLeafNode) * BENCH_NODES);
+    for(int n = 0; n < BENCH_NODES; n++) { nodes[n].pageNoArray[0] = 1; }
+    numCompares = 0;
+    uint64_t start = nowNanos();
+    for(int n = 0; n < BENCH_NODES; n++) {
+      for(int i = 0; i < NON_LEAF_NUM_KEYS; i++) {
+        BTreeIndex::insertInRoomyNonLeaf(&nodes[n], pairs[n * NON_LEAF_NUM_KEYS + i]);
+      }
+    }
+    best = std::min(best, nowNanos() - start);
+    compares = numCompares;
+  }
+  report("insertInRoomyNonLeaf", dist, best, pairs.size(), compares);
+}
+
+void NodeBench::benchFindKeyInLeaf(const KeyDistribution dist) {
+  fillLeaves(leaves, LEAF_NUM_KEYS);
+  volatile int sink = 0;
+  uint64_t best = UINT64_MAX, compares = 0;
+  for(int r = 0; r < repetitions; r++) {
+    numCompares = 0;
+    int total = 0;
+    uint64_t start = nowNanos();
+    for(int i = 0; i < BENCH_PROBES; i++) {
+      total += BTreeIndex::findKeyInLeaf(&leaves[i % BENCH_NODES], probes[i].c_str(), 0);
+    }
+    best = std::min(best, nowNanos() - start);
+    compares = numCompares;
+    sink += total;
+  }
+  report("findKeyInLeaf", dist, best, BENCH_PROBES, compares);
+}
+
+void NodeBench::benchFindChildIndex(const KeyDistribution dist) {
+  fillNonLeaves(nodes, NON_LEAF_NUM_KEYS);
+  volatile int sink = 0;
+  uint64_t best = UINT64_MAX, compares = 0;
+  for(int r = 0; r < repetitions; r++) {
+    numCompares = 0;
+    int total = 0;
+    uint64_t start = nowNanos();
+    for(int i = 0; i < BENCH_PROBES; i++) {
+      total += BTreeIndex::findChildIndex(&nodes[i % BENCH_NODES], probes[i].c_str());
+    }
+    best = std::min(best, nowNanos() - start);
+    compares = numCompares;
+    sink += total;
+  }
+  report("findChildIndex", dist, best, BENCH_PROBES, compares);
+}
+
+void NodeBench::benchKeyInRange(const KeyDistribution dist) {
+  //ranges between two keys of the distribution, checked against leaf keys as a scan would
+  fillLeaves(leaves, LEAF_NUM_KEYS);
+  std::vector<std::string> lows(BENCH_NODES), highs(BENCH_NODES);
+  for(int n = 0; n < BENCH_NODES; n++) {
+    lows[n] = probes[2 * n];
+    highs[n] = probes[2 * n + 1];
+    if(lows[n] > highs[n]) { std::swap(lows[n], highs[n]); }
+  }
+  volatile int sink = 0;
+  uint64_t best = UINT64_MAX, compares = 0;
+  long ops = (long) BENCH_NODES * LEAF_NUM_KEYS * std::max(1, BENCH_PROBES / (BENCH_NODES * LEAF_NUM_KEYS));
+  for(int r = 0; r < repetitions; r++) {
+    numCompares = 0;
+    int total = 0;
+    uint64_t start = nowNanos();
+    for(long op = 0; op < ops; ) {
+      for(int n = 0; n < BENCH_NODES; n++) {
+        for(int i = 0; i < LEAF_NUM_KEYS; i++, op++) {
+          total += BTreeIndex::keyInRange(leaves[n].keyArray[i], lows[n].c_str(), GTE,
+                                          highs[n].c_str(), LT);
+        }
+      }
+    }
+    best = std::min(best, nowNanos() - start);
+    compares = numCompares;
+    sink += total;
+  }
+  report("matchRange", dist, best, ops, compares);
+}
+
+void NodeBench::benchSplitLeaf(const KeyDistribution dist) {
+  fillLeaves(spareLeaves, LEAF_NUM_KEYS);
+  std::vector<RIDKeyPair> pairs(BENCH_NODES);
+  for(int n = 0; n < BENCH_NODES; n++) {
+    pairs[n].set(RecordId(), probes[n].c_str(), NO_EXPIRY);
+    pairs[n].rid.page_number = 1;
+  }
+  LeafNode* newLeaves = new LeafNode[BENCH_NODES];
+  uint64_t best = UINT64_MAX, compares = 0;
+  for(int r = 0; r < repetitions; r++) {
+    memcpy(leaves, spareLeaves, sizeof(LeafNode) * BENCH_NODES);
+    memset(newLeaves, 0, sizeof(LeafNode) * BENCH_NODES);
+    numCompares = 0;
+    uint64_t start = nowNanos();
+    for(int n = 0; n < BENCH_NODES; n++) { BTreeIndex::splitLeaf(&leaves[n], &newLeaves[n], pairs[n]); }
+    best = std::min(best, nowNanos() - start);
+    compares = numCompares;
+  }
+  delete[] newLeaves;
+  report("splitLeaf", dist, best, BENCH_NODES, compares);
+}
+
+void NodeBench::benchSplitNonLeaf(const KeyDistribution dist) {
+  fillNonLeaves(spareNodes, NON_LEAF_NUM_KEYS);
+  std::vector<PageKeyPair> pairs(BENCH_NODES);
+  for(int n = 0; n < BENCH_NODES; n++) { pairs[n].set(NON_LEAF_NUM_KEYS + 2, probes[n].c_str()); }
+  NonLeafNode* newNodes = new NonLeafNode[BENCH_NODES];
+  char midKey[STRINGSIZE];
+  uint64_t best = UINT64_MAX, compares = 0;
+  for(int r = 0; r < repetitions; r++) {
+    memcpy(nodes, spareNodes, sizeof(NonLeafNode) * BENCH_NODES);
+    memset(newNodes, 0, sizeof(NonLeafNode) * BENCH_NODES);
+    numCompares = 0;
+    uint64_t start = nowNanos();
+    for(int n = 0; n < BENCH_NODES; n++) {
+      BTreeIndex::splitNonLeaf(&nodes[n], &newNodes[n], pairs[n], midKey);
+    }
+    best = std::min(best, nowNanos() - start);
+    compares = numCompares;
+  }
+  delete[] newNodes;
+  report("splitNonLeaf", dist, best, BENCH_NODES, compares);
+}
+
+uint64_t NodeBench::nowNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void NodeBench::report(const char* helper, const KeyDistribution dist, const uint64_t bestNanos,
+                       const long ops, const uint64_t compares) {
+#ifdef BENCH_COUNT_COMPARES
+  printf("%-22s %-13s %10.2f\n", helper, distributionNames[dist], (double) compares / ops);
+#else
+  printf("%-22s %-13s %10.2f\n", helper, distributionNames[dist], (double) bestNanos / ops);
+#endif
+}
+
+}
+
+int main(int argc, char **argv)
+{
+  int repetitions = argc > 1 ? atoi(argv[1]) : 9;
+  wiscdb::NodeBench bench(std::max(1, repetitions));
+  bench.run();
+  return 0;
+}
@@ -0,0 +1,80 @@
+#!/bin/sh
+#
+# pgoBuild.sh
+# Profile-guided, link-time optimized build of main. Builds an instrumented
+# binary, trains it by running the benchmarks (main --bench: index builds,
+# random inserts, point and batched lookups, short range scans), rebuilds
+# with the recorded profile, and then prints the benchmarks of a plain -O2
+# build next to those of the optimized one.
+#
+# Usage: ./pgoBuild.sh [buildDir]
+#
+# Compiles every .cpp in this directory and in exceptions/, except files
+# with their own main() and files main.cpp includes. Set CXX, CXXFLAGS and
+# LDFLAGS to override the compiler and extra flags (e.g. LDFLAGS=-lrt).
+# The optimized binary is left in buildDir/main-pgo.
+#
+# @section LICENSE
+# Copyright (c) 2012 Database Group, Computer Sciences Department,
+# University of Wisconsin-Madison.
+#
+
+set -e
+
+SRCDIR=$(cd "$(dirname "$0")" && pwd)
+BUILD=${1:-_pgo}
+CXX=${CXX:-g++}
+BASEFLAGS="-std=c++11 -O2 -I$SRCDIR $CXXFLAGS"
+
+mkdir -p "$BUILD"
+BUILD=$(cd "$BUILD" && pwd)
+
+SOURCES="$SRCDIR/main.cpp"
+for f in "$SRCDIR"/*.cpp "$SRCDIR"/exceptions/*.cpp; do
+  [ -f "$f" ] || continue
+  name=$(basename "$f")
+  [ "$name" = main.cpp ] && continue
+  grep -q "^int main" "$f" && continue
+  grep -q "#include \"$name\"" "$SRCDIR/main.cpp" && continue
+  SOURCES="$SOURCES $f"
+done
+
+# every stage compiles to the same object files, which the profile's file
+# names are derived from, so the optimized build finds the training profile
+build() { # output flags...
+  out=$1; shift
+  rm -rf "$BUILD/obj"
+  mkdir -p "$BUILD/obj"
+  objects=""
+  for f in $SOURCES; do
+    obj="$BUILD/obj/$(basename "$f" .cpp).o"
+    $CXX $BASEFLAGS "$@" -c "$f" -o "$obj"
+    objects="$objects $obj"
+  done
+  $CXX $BASEFLAGS "$@" $objects -o "$BUILD/$out" $LDFLAGS
+}
+
+# main creates its relation and index files in the working directory
+bench() { # binary
+  (cd "$BUILD" && "./$1" --bench | sed -n '/^BENCHMARKS/,$p')
+}
+
+echo "building plain and instrumented binaries"
+build main-plain -DBTREE_BUILD='"plain -O2"'
+rm -rf "$BUILD/profile"
+build main-instr -DBTREE_BUILD='"instrumented"' -flto -fprofile-generate -fprofile-dir="$BUILD/profile"
+
+echo "training"
+(cd "$BUILD" && ./main-instr --bench > training.log)
+if [ -z "$(find "$BUILD/profile" -name '*.gcda')" ]; then
+  echo "training wrote no profile" >&2
+  exit 1
+fi
+
+echo "building with the profile"
+build main-pgo -DBTREE_BUILD='"PGO+LTO"' -flto -fprofile-use -fprofile-dir="$BUILD/profile" \
+  -fprofile-correction -Wno-missing-profile
+
+bench main-plain > "$BUILD/plain.txt"
+bench main-pgo > "$BUILD/pgo.txt"
+pr -m -t -w 140 "$BUILD/plain.txt" "$BUILD/pgo.txt" | expand
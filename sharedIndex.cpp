@@ -0,0 +1,221 @@
+/**
+ * sharedIndex.cpp
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department,
+ * University of Wisconsin-Madison.
+ */
+
+#include "sharedIndex.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include "exceptions/bad_index_info_exception.h"
+#include "exceptions/bad_opcodes_exception.h"
+#include "exceptions/bad_scanrange_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+#include "exceptions/scan_not_initialized_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+
+namespace wiscdb
+{
+
+// -----------------------------------------------------------------------------
+// SharedIndexReader::SharedIndexReader -- Constructor
+// -----------------------------------------------------------------------------
+
+SharedIndexReader::SharedIndexReader(const std::string & segmentName) {
+  scanExecuting = false;
+  int fd = shm_open(segmentName.c_str(), O_RDONLY, 0);
+  struct stat st;
+  if(fd < 0 || fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(SharedIndexHeader)) {
+    if(fd >= 0) { close(fd); }
+    throw BadIndexInfoException("Cannot open shared segment " + segmentName);
+  }
+  segmentSize = st.st_size;
+  void* mapped = mmap(NULL, segmentSize, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(mapped == MAP_FAILED) {
+    throw BadIndexInfoException("Cannot map shared segment " + segmentName);
+  }
+  segment = (SharedIndexHeader*) mapped;
+  if(memcmp(segment->magic, SHARED_INDEX_MAGIC, sizeof(SHARED_INDEX_MAGIC)) != 0
+     || segmentSize < sharedSegmentSize(segment->maxPages)) {
+    munmap(mapped, segmentSize);
+    throw BadIndexInfoException(segmentName + " is not a shared index segment");
+  }
+  collation = (Collation) segment->collation;
+}
+
+// -----------------------------------------------------------------------------
+// SharedIndexReader::~SharedIndexReader -- destructor
+// -----------------------------------------------------------------------------
+
+SharedIndexReader::~SharedIndexReader() {
+  munmap(segment, segmentSize);
+}
+
+// -----------------------------------------------------------------------------
+// SharedIndexReader::lookup
+// -----------------------------------------------------------------------------
+
+bool SharedIndexReader::lookup(const char* keyParm, RecordId& outRid) {
+  char sortKey[STRINGSIZE];
+  const char* key = keyParm;
+  if(collation != BINARY) {
+    makeSortKey(collation, keyParm, sortKey);
+    key = sortKey;
+  }
+  bool runsOn;
+  PageId pageNum = findLeaf(key, runsOn);
+  if(pageNum == Page::INVALID_NUMBER) { return false; }
+  LeafNode* leaf = (LeafNode*) leafCopy;
+  const uint32_t now = expiryClock();
+  int slot = BTreeIndex::findKeyInLeaf(leaf, key, now);
+  //walk right while the run of the key may go on, as BTreeIndex::findLiveEntry
+  while(slot < 0 && (runsOn || BTreeIndex::leafEndsInKey(leaf, key))
+        && leaf->rightSibPageNo != Page::INVALID_NUMBER) {
+    copyPage(leaf->rightSibPageNo, leafCopy);
+    runsOn = false;
+    slot = BTreeIndex::findKeyInLeaf(leaf, key, now);
+  }
+  if(slot >= 0) { outRid = leaf->ridArray[slot]; }
+  return slot >= 0;
+}
+
+// -----------------------------------------------------------------------------
+// SharedIndexReader::startScan
+// -----------------------------------------------------------------------------
+
+void SharedIndexReader::startScan(const char* lowValParm, const Operator lowOpParm,
+                                  const char* highValParm, const Operator highOpParm) {
+  if(scanExecuting) { endScan(); }
+  makeSortKey(collation, lowValParm, lowVal);
+  makeSortKey(collation, highValParm, highVal);
+  if(strncmp(lowVal, highVal, STRINGSIZE) > 0) {
+    throw BadScanrangeException();
+  }
+  if(lowOpParm != GT && lowOpParm != GTE) {
+    throw BadOpcodesException();
+  }
+  if(highOpParm != LT && highOpParm != LTE) {
+    throw BadOpcodesException();
+  }
+  bool runsOn;
+  currentPageNum = findLeaf(lowVal, runsOn);
+  if(currentPageNum == Page::INVALID_NUMBER) { throw NoSuchKeyFoundException(); }
+  scanExecuting = true;
+  nextEntry = 0;
+  lowOp = lowOpParm;
+  highOp = highOpParm;
+  scanTime = expiryClock();
+}
+
+// -----------------------------------------------------------------------------
+// SharedIndexReader::scanNext
+// -----------------------------------------------------------------------------
+
+void SharedIndexReader::scanNext(RecordId& outRid) {
+  if(!scanExecuting) { throw ScanNotInitializedException(); }
+  while(currentPageNum != Page::INVALID_NUMBER) {
+    LeafNode* leaf = (LeafNode*) leafCopy;
+    int numKeys = BTreeIndex::getLeafLength(leaf);
+    for(; nextEntry < numKeys; nextEntry++) {
+      if(!BTreeIndex::isLive(leaf, nextEntry, scanTime)) { continue; } //deleted lazily or expired
+      const char* key = leaf->keyArray[nextEntry];
+      int cmp = strncmp(key, lowVal, STRINGSIZE);
+      if(cmp < 0 || (cmp == 0 && lowOp == GT)) { continue; } //below the range
+      if(pastRange(key)) {
+        currentPageNum = Page::INVALID_NUMBER;
+        break;
+      }
+      outRid = leaf->ridArray[nextEntry++];
+      return;
+    }
+    if(currentPageNum == Page::INVALID_NUMBER) { break; }
+    //move on to a fresh copy of the right sibling
+    currentPageNum = leaf->rightSibPageNo;
+    nextEntry = 0;
+    if(currentPageNum != Page::INVALID_NUMBER) { copyPage(currentPageNum, leafCopy); }
+  }
+  endScan();
+  throw IndexScanCompletedException();
+}
+
+// -----------------------------------------------------------------------------
+// SharedIndexReader::endScan
+// -----------------------------------------------------------------------------
+
+void SharedIndexReader::endScan() {
+  if(!scanExecuting) { throw ScanNotInitializedException(); }
+  scanExecuting = false;
+  currentPageNum = Page::INVALID_NUMBER;
+}
+
+uint32_t SharedIndexReader::copyPage(const PageId pageNum, char* page) {
+  if(__atomic_load_n(&segment->invalid, __ATOMIC_ACQUIRE)) {
+    throw BadIndexInfoException("Shared segment is no longer kept up to date");
+  }
+  if(pageNum >= segment->maxPages) {
+    throw BadIndexInfoException("Page beyond the shared segment");
+  }
+  SharedPageSlot* slot = sharedSlot(segment, pageNum);
+  while(true) {
+    uint32_t version = __atomic_load_n(&slot->version, __ATOMIC_ACQUIRE);
+    if(version & 1) { //the writer is copying into the slot
+      sched_yield();
+      continue;
+    }
+    memcpy(page, slot->data, Page::SIZE);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&slot->version, __ATOMIC_RELAXED) == version) { return version; }
+  }
+}
+
+bool SharedIndexReader::unchanged(const PageId pageNum, const uint32_t version) {
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&sharedSlot(segment, pageNum)->version, __ATOMIC_RELAXED) == version;
+}
+
+PageId SharedIndexReader::findLeaf(const char* key, bool& runsOn) {
+  std::vector<std::pair<PageId, uint32_t> > path;
+  while(true) {
+    path.clear();
+    uint32_t version = copyPage(segment->headerPageNum, nodeCopy);
+    path.push_back(std::make_pair(segment->headerPageNum, version));
+    PageId pageNum = ((IndexMetaInfo*) nodeCopy)->rootPageNo;
+    if(pageNum == Page::INVALID_NUMBER) { return Page::INVALID_NUMBER; }
+    runsOn = false;
+    int level;
+    do { //descend to the first leaf that may hold the key, as BTreeIndex::findLeafPage
+      version = copyPage(pageNum, nodeCopy);
+      path.push_back(std::make_pair(pageNum, version));
+      NonLeafNode* node = (NonLeafNode*) nodeCopy;
+      level = node->level;
+      int i = BTreeIndex::findChildIndex(node, key);
+      while(i > 0 && strncmp(node->keyArray[i-1], key, STRINGSIZE) == 0) { i--; }
+      if(i < BTreeIndex::getNonLeafLength(node)) {
+        runsOn = strncmp(node->keyArray[i], key, STRINGSIZE) == 0;
+      }
+      pageNum = node->pageNoArray[i];
+    } while(level != 1);
+    copyPage(pageNum, leafCopy);
+    //the leaf is only the right one if no node above it changed meanwhile
+    bool valid = true;
+    for(size_t i = 0; i < path.size() && valid; i++) {
+      valid = unchanged(path[i].first, path[i].second);
+    }
+    if(valid) { return pageNum; }
+  }
+}
+
+bool SharedIndexReader::pastRange(const char* key) {
+  int cmp = strncmp(key, highVal, STRINGSIZE);
+  return cmp > 0 || (cmp == 0 && highOp == LT);
+}
+
+}
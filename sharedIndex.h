@@ -0,0 +1,213 @@
+/**
+ * sharedIndex.h
+ * Shared memory read access to a B+ tree index from many processes.
+ *
+ * A writer process calls BTreeIndex::shareIndex(), which copies every page
+ * of the index into a POSIX shared memory segment and from then on copies
+ * in the pages each insert, delete or update changed. Reader processes open
+ * the segment with SharedIndexReader and run lookups and scans directly on
+ * it, without locks and without going through the writer.
+ *
+ * The segment is a page table: a SharedIndexHeader followed by maxPages
+ * SharedPageSlots, slot i holding page i of the index file. Each slot is
+ * guarded by a seqlock version that is odd while the writer is copying into
+ * it. A writer first makes the version of every page an operation changed
+ * odd, then copies the pages, then makes the versions even again, so a
+ * reader never sees part of a split or merge. A reader copies each node out
+ * of its slot and retries when the version was odd or changed meanwhile;
+ * after reaching a leaf it checks that the versions of every node on the
+ * path are still those it copied, and descends again if not.
+ *
+ * If the index grows past the segment's maxPages, the writer cannot copy
+ * in the pages of the write that outgrew it. It then marks the segment
+ * invalid and stops publishing; readers throw BadIndexInfoException from
+ * then on, and should fall back to asking the writer.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department,
+ * University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "btree.h"
+
+namespace wiscdb
+{
+
+/**
+ * @brief Identifies a shared index segment.
+ */
+const char SHARED_INDEX_MAGIC[8] = "BTSHM02";
+
+/**
+ * @brief Start of a shared index segment.
+ */
+struct SharedIndexHeader{
+  /**
+   * SHARED_INDEX_MAGIC.
+   */
+  char magic[8];
+
+  /**
+   * Number of page slots following the header.
+   */
+  uint32_t maxPages;
+
+  /**
+   * Page number of the index meta page, from which readers find the root.
+   */
+  PageId headerPageNum;
+
+  /**
+   * Collation of the keys, to convert reader keys into sort keys.
+   */
+  int32_t collation;
+
+  /**
+   * Set once the writer has stopped keeping the segment up to date.
+   */
+  uint32_t invalid;
+};
+
+/**
+ * @brief One page of the index and its seqlock version.
+ */
+struct SharedPageSlot{
+  /**
+   * Odd while the writer is copying into data.
+   */
+  uint32_t version;
+
+  /**
+   * Keeps data 8 byte aligned.
+   */
+  uint32_t padding;
+
+  /**
+   * Contents of the page.
+   */
+  char data[Page::SIZE];
+};
+
+/**
+ * Size in bytes of a segment of maxPages pages.
+ */
+inline size_t sharedSegmentSize(const PageId maxPages) {
+  return sizeof(SharedIndexHeader) + (size_t) maxPages * sizeof(SharedPageSlot);
+}
+
+/**
+ * Slot of a page in a segment.
+ */
+inline SharedPageSlot* sharedSlot(SharedIndexHeader* segment, const PageId pageNum) {
+  return (SharedPageSlot*) (segment + 1) + pageNum;
+}
+
+/**
+ * @brief SharedIndexReader class. Read-only view of an index shared by a
+ * writer process with BTreeIndex::shareIndex().
+ */
+class SharedIndexReader {
+ public:
+  /**
+   * Map the segment read-only.
+   * @param segmentName  Name given to shareIndex(), e.g. "/relA.0"
+   * @throws  BadIndexInfoException  If the segment does not exist or is not
+   *   a shared index segment.
+   */
+  SharedIndexReader(const std::string & segmentName);
+
+  /**
+   * Unmap the segment.
+   */
+  ~SharedIndexReader();
+
+  /**
+   * Look up the first entry with a key, as BTreeIndex::lookup().
+   * @param key     Key to look up, char string
+   * @param outRid  RecordId of the matching entry, if one is found
+   * @return returns true if an entry with the key exists
+   * @throws  BadIndexInfoException  If the writer marked the segment
+   *   invalid; this and the scan calls below throw it from then on.
+   */
+  bool lookup(const char* key, RecordId& outRid);
+
+  /**
+   * Begin a range scan, as BTreeIndex::startScan(). The scan reads one
+   * consistent copy of each leaf in turn; changes the writer makes to
+   * leaves not yet reached are seen.
+   * @throws  BadOpcodesException  If lowOp or highOp are invalid.
+   * @throws  BadScanrangeException  If lowVal > highVal.
+   * @throws  NoSuchKeyFoundException  If the index is empty.
+   */
+  void startScan(const char* lowVal, const Operator lowOp,
+                 const char* highVal, const Operator highOp);
+
+  /**
+   * Fetch the RecordId of the next entry in the scan range.
+   * @throws  ScanNotInitializedException  If no scan has been initialized.
+   * @throws  IndexScanCompletedException  If no more records satisfy the
+   *   scan criteria.
+   */
+  void scanNext(RecordId& outRid);
+
+  /**
+   * End the current scan.
+   * @throws  ScanNotInitializedException  If no scan has been initialized.
+   */
+  void endScan();
+
+ private:
+  /**
+   * Copy a page out of its slot once no write is in progress on it.
+   * @return the even version the copy was taken at
+   * @throws  BadIndexInfoException  If the segment is marked invalid.
+   */
+  uint32_t copyPage(const PageId pageNum, char* page);
+
+  /**
+   * True if a page is still at a version returned by copyPage().
+   */
+  bool unchanged(const PageId pageNum, const uint32_t version);
+
+  /**
+   * Descend from the root to the first leaf that may hold the key, going
+   * left of separators equal to it as BTreeIndex::findLeafPage() does, and
+   * leave a copy of it in leafCopy.
+   * @param runsOn set to whether the leaf is left of a separator equal to
+   *   the key, so that duplicates of the key go on in its right sibling
+   * @return the leaf's page number, or Page::INVALID_NUMBER for an empty
+   *   index
+   */
+  PageId findLeaf(const char* key, bool& runsOn);
+
+  /**
+   * True if a key is above the high end of the current scan.
+   */
+  bool pastRange(const char* key);
+
+  SharedIndexHeader *segment;
+  size_t    segmentSize;
+  Collation collation;
+
+  /**
+   * Private copies of the node being examined and of the current leaf.
+   */
+  char      nodeCopy[Page::SIZE];
+  char      leafCopy[Page::SIZE];
+
+  // ********** MEMBERS SPECIFIC TO SCANNING ************ //
+
+  bool      scanExecuting;
+  PageId    currentPageNum;
+  int       nextEntry;
+  char      lowVal[STRINGSIZE];
+  char      highVal[STRINGSIZE];
+  Operator  lowOp;
+  Operator  highOp;
+  uint32_t  scanTime;
+};
+
+}
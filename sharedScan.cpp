@@ -0,0 +1,190 @@
+/**
+ * sharedScan.cpp
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department,
+ * University of Wisconsin-Madison.
+ */
+
+#include "sharedScan.h"
+
+#include "exceptions/bad_opcodes_exception.h"
+#include "exceptions/bad_scanrange_exception.h"
+
+namespace wiscdb
+{
+
+// -----------------------------------------------------------------------------
+// SharedScan::SharedScan -- Constructor
+// -----------------------------------------------------------------------------
+
+SharedScan::SharedScan(BTreeIndex& indexIn)
+  : index(indexIn), passPage(Page::INVALID_NUMBER), passLeaf(NULL), leafReads(0) {
+}
+
+// -----------------------------------------------------------------------------
+// SharedScan::~SharedScan -- destructor
+// -----------------------------------------------------------------------------
+
+SharedScan::~SharedScan() {
+  moveTo(Page::INVALID_NUMBER);
+}
+
+// -----------------------------------------------------------------------------
+// SharedScan::attach
+// -----------------------------------------------------------------------------
+
+int SharedScan::attach(const char* lowVal, const Operator lowOp,
+                       const char* highVal, const Operator highOp) {
+  char lowSortKey[STRINGSIZE], highSortKey[STRINGSIZE];
+  lowVal = index.sortKeyFor(lowVal, lowSortKey);
+  highVal = index.sortKeyFor(highVal, highSortKey);
+  if(strncmp(lowVal, highVal, STRINGSIZE) > 0) { throw BadScanrangeException(); }
+  if((lowOp != GT && lowOp != GTE) || (highOp != LT && highOp != LTE)) {
+    throw BadOpcodesException();
+  }
+  size_t id = 0;
+  while(id < cursors.size() && cursors[id].state != CURSOR_DETACHED) { id++; }
+  if(id == cursors.size()) { cursors.push_back(SharedCursor()); }
+  SharedCursor& cursor = cursors[id];
+  strncpy(cursor.lowVal, lowVal, STRINGSIZE);
+  strncpy(cursor.highVal, highVal, STRINGSIZE);
+  cursor.lowOp = lowOp;
+  cursor.highOp = highOp;
+  cursor.rids.clear();
+  cursor.sawLowLeaf = false;
+  if(index.rootPageNum == Page::INVALID_NUMBER) { //empty index
+    cursor.state = CURSOR_DONE;
+    cursor.lowLeaf = cursor.joinLeaf = Page::INVALID_NUMBER;
+    return id;
+  }
+  cursor.state = CURSOR_FORWARD;
+  cursor.lowLeaf = findLowLeaf(cursor.lowVal, lowOp);
+  if(passPage == Page::INVALID_NUMBER) { moveTo(cursor.lowLeaf); } //the pass starts with this cursor
+  cursor.joinLeaf = passPage;
+  return id;
+}
+
+// -----------------------------------------------------------------------------
+// SharedScan::next
+// -----------------------------------------------------------------------------
+
+ScanStatus SharedScan::next(const int id, RecordId& outRid) {
+  if(id < 0 || id >= (int) cursors.size() || cursors[id].state == CURSOR_DETACHED) {
+    return SCAN_NOT_INITIALIZED;
+  }
+  SharedCursor& cursor = cursors[id];
+  while(cursor.rids.empty() && cursor.state != CURSOR_DONE) { step(); }
+  if(cursor.rids.empty()) { return SCAN_COMPLETED; }
+  outRid = cursor.rids.front();
+  cursor.rids.pop_front();
+  return SCAN_OK;
+}
+
+// -----------------------------------------------------------------------------
+// SharedScan::detach
+// -----------------------------------------------------------------------------
+
+void SharedScan::detach(const int id) {
+  if(id < 0 || id >= (int) cursors.size()) { return; }
+  cursors[id].state = CURSOR_DETACHED;
+  std::deque<RecordId>().swap(cursors[id].rids);
+}
+
+void SharedScan::step() {
+  if(passPage == Page::INVALID_NUMBER) { //only pending cursors are left
+    restart();
+    return;
+  }
+  LeafNode* leaf = passLeaf;
+  int length = BTreeIndex::getLeafLength(leaf);
+  PageId nextPage = leaf->rightSibPageNo;
+  uint32_t now = expiryClock();
+  bool nextNeeded = false;
+  for(size_t i = 0; i < cursors.size(); i++) {
+    SharedCursor& cursor = cursors[i];
+    if(cursor.state == CURSOR_CATCH_UP && cursor.joinLeaf == passPage) { //back where it joined
+      cursor.state = CURSOR_DONE;
+      continue;
+    }
+    if(cursor.state != CURSOR_FORWARD && cursor.state != CURSOR_CATCH_UP) { continue; }
+    if(passPage == cursor.lowLeaf) { cursor.sawLowLeaf = true; }
+    for(int slot = 0; slot < length; slot++) {
+      if(BTreeIndex::isLive(leaf, slot, now)
+         && BTreeIndex::keyInRange(leaf->keyArray[slot], cursor.lowVal, cursor.lowOp,
+                                   cursor.highVal, cursor.highOp)) {
+        cursor.rids.push_back(leaf->ridArray[slot]);
+      }
+    }
+    if(nextPage == Page::INVALID_NUMBER
+       || (length > 0 && pastHigh(cursor, leaf->keyArray[length-1]))) {
+      //a cursor that joined after the start of its range goes back for it
+      bool missed = cursor.state == CURSOR_FORWARD && !cursor.sawLowLeaf;
+      cursor.state = missed ? CURSOR_PENDING : CURSOR_DONE;
+    }
+    else { nextNeeded = true; }
+  }
+  if(nextNeeded) { moveTo(nextPage); }
+  else {
+    moveTo(Page::INVALID_NUMBER);
+    restart();
+  }
+}
+
+void SharedScan::restart() {
+  int lowest = -1;
+  for(size_t i = 0; i < cursors.size(); i++) {
+    if(cursors[i].state != CURSOR_PENDING) { continue; }
+    if(lowest < 0) {
+      lowest = i;
+      continue;
+    }
+    int order = strncmp(cursors[i].lowVal, cursors[lowest].lowVal, STRINGSIZE);
+    if(order < 0 || (order == 0 && cursors[i].lowOp == GTE)) { lowest = i; }
+  }
+  if(lowest < 0) { return; }
+  for(size_t i = 0; i < cursors.size(); i++) {
+    if(cursors[i].state == CURSOR_PENDING) { cursors[i].state = CURSOR_CATCH_UP; }
+  }
+  //descend again rather than trusting lowLeaf, which splits may have moved
+  moveTo(findLowLeaf(cursors[lowest].lowVal, cursors[lowest].lowOp));
+}
+
+void SharedScan::moveTo(const PageId pageNum) {
+  if(passPage != Page::INVALID_NUMBER) {
+    index.bufferManager->unPinPage(index.file, passPage, false);
+  }
+  passPage = pageNum;
+  passLeaf = NULL;
+  if(passPage != Page::INVALID_NUMBER) {
+    PageId leafPageNum = passPage;
+    passLeaf = index.readLeafNode(index.file, leafPageNum);
+    leafReads++;
+  }
+}
+
+PageId SharedScan::findLowLeaf(const char* lowVal, const Operator lowOp) {
+  PageId pageNum = index.rootPageNum;
+  while(true) {
+    NonLeafNode* node = index.readNonLeafNode(index.file, pageNum);
+    int numKeys = BTreeIndex::getNonLeafLength(node);
+    int i = 0;
+    //GTE goes left of a separator equal to the bound, where duplicates of it may sit
+    while(i < numKeys && (lowOp == GT ? strncmp(node->keyArray[i], lowVal, STRINGSIZE) <= 0
+                                      : strncmp(node->keyArray[i], lowVal, STRINGSIZE) < 0)) {
+      i++;
+    }
+    PageId childPageNum = node->pageNoArray[i];
+    int level = node->level;
+    index.bufferManager->unPinPage(index.file, pageNum, false);
+    if(level == 1) { return childPageNum; }
+    pageNum = childPageNum;
+  }
+}
+
+bool SharedScan::pastHigh(const SharedCursor& cursor, const char* key) {
+  int order = strncmp(key, cursor.highVal, STRINGSIZE);
+  return cursor.highOp == LT ? order >= 0 : order > 0;
+}
+
+}
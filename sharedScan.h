@@ -0,0 +1,167 @@
+/**
+ * sharedScan.h
+ * Range scans on one index that share a single pass over its leaves.
+ *
+ * A SharedScan walks the leaf chain of an index once for every cursor
+ * attached to it. Each leaf the pass reads is offered to every attached
+ * cursor, which keeps the entries in its range until they are fetched with
+ * next(). A cursor attached while the pass is under way starts with the
+ * leaf the pass is on; once the pass has gone past the end of its range it
+ * goes back for the part before that leaf, together with every other
+ * cursor that joined late, and stops where the cursor joined. A cursor
+ * that joined late therefore receives its entries in two ascending runs
+ * rather than in key order. A cursor that fetches its entries more slowly
+ * than others keeps the entries delivered to it meanwhile.
+ *
+ * The pass keeps the leaf it is about to read pinned, as a scan does, and
+ * sees changes to leaves it has not reached yet. Entries are counted on
+ * their leaf and not copied, so a leaf changed after the pass joined a
+ * cursor (split, merge, swept) can make that cursor miss or repeat entries
+ * near the leaf it joined on.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department,
+ * University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <deque>
+#include <vector>
+#include "btree.h"
+
+namespace wiscdb
+{
+
+/**
+ * @brief Phases of a cursor of a SharedScan.
+ */
+enum SharedCursorState
+{
+  CURSOR_FORWARD,   /* Receives entries from the leaf it joined on onwards */
+  CURSOR_PENDING,   /* Past its range; waits for the pass to go back */
+  CURSOR_CATCH_UP,  /* Receives entries before the leaf it joined on */
+  CURSOR_DONE,      /* Every entry of its range has been delivered */
+  CURSOR_DETACHED   /* Slot free for another cursor */
+};
+
+/**
+ * @brief A cursor attached to a SharedScan.
+ */
+struct SharedCursor{
+  /**
+   * Scan bounds, as sort keys.
+   */
+  char lowVal[STRINGSIZE];
+  char highVal[STRINGSIZE];
+  Operator lowOp;
+  Operator highOp;
+
+  SharedCursorState state;
+
+  /**
+   * Leaf a scan of the range would start on, and whether the pass has read
+   * it since the cursor joined; if not, the cursor needs a catch-up.
+   */
+  PageId lowLeaf;
+  bool sawLowLeaf;
+
+  /**
+   * Leaf the pass was on when the cursor joined; its catch-up ends there.
+   */
+  PageId joinLeaf;
+
+  /**
+   * Entries delivered and not yet fetched.
+   */
+  std::deque<RecordId> rids;
+};
+
+/**
+ * @brief SharedScan class. Serves any number of range scan cursors on an
+ * index from one pass over its leaves.
+ */
+class SharedScan {
+ public:
+  /**
+   * Create a shared scan with no cursors. The index must outlive it.
+   */
+  SharedScan(BTreeIndex& indexIn);
+
+  /**
+   * Unpin the leaf the pass is on, if any.
+   */
+  ~SharedScan();
+
+  /**
+   * Attach a cursor for a range, as BTreeIndex::startScan() takes it.
+   * @return the cursor's id, for next() and detach()
+   * @throws  BadOpcodesException  If lowOp or highOp are invalid.
+   * @throws  BadScanrangeException  If lowVal > highVal.
+   */
+  int attach(const char* lowVal, const Operator lowOp,
+             const char* highVal, const Operator highOp);
+
+  /**
+   * Fetch the RecordId of the cursor's next entry, advancing the pass as
+   * far as needed for one.
+   * @param outRid  RecordId of the next entry, set when SCAN_OK is returned
+   * @return SCAN_OK, SCAN_COMPLETED once the cursor's range is exhausted,
+   *   or SCAN_NOT_INITIALIZED if no cursor has the id
+   */
+  ScanStatus next(const int cursor, RecordId& outRid);
+
+  /**
+   * Detach a cursor, dropping its undelivered entries.
+   */
+  void detach(const int cursor);
+
+  /**
+   * Return the number of leaves the pass has read, over all cursors.
+   */
+  int numLeafReads() const { return leafReads; }
+
+ private:
+  /**
+   * Reads the leaf the pass is on, offers it to the cursors and moves the
+   * pass to the next leaf any cursor still needs.
+   */
+  void step();
+
+  /**
+   * Starts the catch-up of every pending cursor at the lowest of their
+   * ranges; leaves the pass idle if no cursor is pending.
+   */
+  void restart();
+
+  /**
+   * Moves the pass to a leaf, pinning it and unpinning the one it was on.
+   */
+  void moveTo(const PageId pageNum);
+
+  /**
+   * Returns the leaf a scan from a low bound would start on, reading only
+   * non-leaf nodes.
+   */
+  PageId findLowLeaf(const char* lowVal, const Operator lowOp);
+
+  static bool pastHigh(const SharedCursor& cursor, const char* key);
+
+  BTreeIndex& index;
+
+  /**
+   * Leaf the pass reads next, pinned, or Page::INVALID_NUMBER while the
+   * pass is idle.
+   */
+  PageId passPage;
+  LeafNode* passLeaf;
+
+  /**
+   * Cursors by id.
+   */
+  std::vector<SharedCursor> cursors;
+
+  int leafReads;
+};
+
+}
@@ -0,0 +1,318 @@
+/**
+ * traceReplay.cpp
+ * Runs an operation trace recorded with BTreeIndex::startTrace() (see
+ * indexTrace.h) against a fresh index and reports per operation counts and
+ * latencies, so a workload seen in production can be rerun on any build.
+ *
+ * The index is built anew from the trace's base relation, which must be
+ * in the current directory (an empty relation is created if it is
+ * missing), and removed afterwards. To keep a live index safe, the replay
+ * refuses to run if a file with the index's name already exists. Calls are
+ * issued at the recorded pace unless --fast is given, in which case they
+ * are issued back to back. Each call's outcome is compared with the one
+ * recorded; mismatches mean the replayed index did not start from the
+ * traced index's contents or behaves differently.
+ *
+ * Usage: traceReplay traceFile [--fast] [bufferFrames]
+ *
+ * Compiled with -DTRACE_REPLAY_NO_MAIN (or included after defining it),
+ * this file only provides replayTrace(), so tests can replay a trace they
+ * recorded.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department,
+ * University of Wisconsin-Madison.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "btree.h"
+#include "indexTrace.h"
+#include "include/page.h"
+#include "exceptions/scan_not_initialized_exception.h"
+
+using namespace wiscdb;
+
+/**
+ * @brief Replay statistics of one TraceOp.
+ */
+struct OpStats{
+  const char* name;
+  long count;
+  long mismatches;
+  uint64_t totalNanos;
+  uint64_t maxNanos;
+};
+
+static uint64_t nowNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleepUntil(const uint64_t target) {
+  uint64_t now = nowNanos();
+  if(now >= target) { return; }
+  struct timespec ts;
+  ts.tv_sec = (target - now) / 1000000000ULL;
+  ts.tv_nsec = (target - now) % 1000000000ULL;
+  nanosleep(&ts, NULL);
+}
+
+static bool readFully(FILE* trace, void* buffer, const size_t size) {
+  return size == 0 || fread(buffer, size, 1, trace) == 1;
+}
+
+/**
+ * Run one recorded call.
+ * @param unique whether the traced index was unique
+ * @param replayStart expiryClock() time the replay started
+ * @param scanBounds 2 * (STRINGSIZE + 1) bytes for the bounds of a scan, which
+ *   the index refers to until the scan ends, so they outlive this call
+ * @return the outcome to compare with the recorded one, or -1 if the
+ *   payload could not be read
+ */
+static int replayOp(BTreeIndex& index, const bool unique, FILE* trace, const TraceRecord& record,
+                    const uint32_t replayStart, char* scanBounds, long& numRids) {
+  char keys[STRINGSIZE + 1];
+  memset(keys, 0, sizeof(keys));
+  RecordId rid;
+  switch(record.op) {
+    case TRACE_INSERT:
+    case TRACE_DELETE: {
+      TraceEntry entry;
+      if(!readFully(trace, &entry, sizeof(TraceEntry))) { return -1; }
+      memcpy(keys, entry.key, STRINGSIZE);
+      if(record.op == TRACE_DELETE) { return index.deleteEntry(keys, entry.rid); }
+      uint32_t expiry = replayExpiry(entry.expiry, replayStart);
+      if(!unique) {
+        index.insertEntry(keys, entry.rid, expiry);
+        return 1;
+      }
+      RecordId conflictRid; //insertEntry on a unique index is insertUnique
+      return index.insertUnique(keys, entry.rid, conflictRid, expiry);
+    }
+    case TRACE_INSERT_UNIQUE:
+    case TRACE_UPSERT: {
+      TraceEntry entry;
+      if(!readFully(trace, &entry, sizeof(TraceEntry))) { return -1; }
+      memcpy(keys, entry.key, STRINGSIZE);
+      uint32_t expiry = replayExpiry(entry.expiry, replayStart);
+      RecordId existingRid;
+      if(record.op == TRACE_UPSERT) { return index.upsert(keys, entry.rid, existingRid, expiry); }
+      return index.insertUnique(keys, entry.rid, existingRid, expiry);
+    }
+    case TRACE_UPDATE_KEY: {
+      TraceEntry entry;
+      char newKey[STRINGSIZE + 1];
+      memset(newKey, 0, sizeof(newKey));
+      if(!readFully(trace, &entry, sizeof(TraceEntry)) || !readFully(trace, newKey, STRINGSIZE)) {
+        return -1;
+      }
+      memcpy(keys, entry.key, STRINGSIZE);
+      return index.updateKey(keys, newKey, entry.rid);
+    }
+    case TRACE_LOOKUP:
+      if(!readFully(trace, keys, STRINGSIZE)) { return -1; }
+      return index.lookup(keys, rid);
+    case TRACE_LOOKUP_BATCH: {
+      uint32_t numKeys;
+      if(!readFully(trace, &numKeys, sizeof(uint32_t))) { return -1; }
+      std::vector<char> keyData((size_t) numKeys * (STRINGSIZE + 1), '\0');
+      std::vector<const char*> batchKeys(numKeys);
+      for(uint32_t i = 0; i < numKeys; i++) {
+        batchKeys[i] = &keyData[i * (STRINGSIZE + 1)];
+        if(!readFully(trace, &keyData[i * (STRINGSIZE + 1)], STRINGSIZE)) { return -1; }
+      }
+      std::vector<RecordId> rids(numKeys);
+      bool* found = new bool[numKeys + 1];
+      index.lookupBatch(numKeys > 0 ? &batchKeys[0] : NULL, numKeys, numKeys > 0 ? &rids[0] : NULL, found);
+      int numFound = 0;
+      for(uint32_t i = 0; i < numKeys; i++) { numFound += found[i]; }
+      delete[] found;
+      return numFound % 256;
+    }
+    case TRACE_START_SCAN:
+    case TRACE_START_PREFIX_SCAN: {
+      char* lowKey = scanBounds;
+      char* highKey = scanBounds + STRINGSIZE + 1;
+      memset(scanBounds, 0, 2 * (STRINGSIZE + 1));
+      if(!readFully(trace, lowKey, STRINGSIZE)) { return -1; }
+      if(record.op == TRACE_START_PREFIX_SCAN) { return index.tryStartPrefixScan(lowKey, record.lowOp); }
+      if(!readFully(trace, highKey, STRINGSIZE)) { return -1; }
+      return index.tryStartScan(lowKey, (Operator) record.lowOp, highKey, (Operator) record.highOp);
+    }
+    case TRACE_START_FILTER_SCAN: {
+      char* lowKey = scanBounds;
+      char* highKey = scanBounds + STRINGSIZE + 1;
+      memset(scanBounds, 0, 2 * (STRINGSIZE + 1));
+      TracePredicate traced;
+      if(!readFully(trace, lowKey, STRINGSIZE) || !readFully(trace, highKey, STRINGSIZE)
+         || !readFully(trace, &traced, sizeof(TracePredicate))) {
+        return -1;
+      }
+      KeyPredicate predicate;
+      predicate.kind = (KeyPredicateKind) traced.kind;
+      predicate.negate = traced.negate;
+      predicate.patternLen = traced.patternLen;
+      memcpy(predicate.pattern, traced.pattern, STRINGSIZE);
+      memcpy(predicate.mask, traced.mask, STRINGSIZE);
+      return index.tryStartScan(lowKey, (Operator) record.lowOp, highKey, (Operator) record.highOp,
+                                predicate);
+    }
+    case TRACE_SCAN_NEXT: {
+      ScanStatus status = index.tryScanNext(rid);
+      if(status == SCAN_OK) { numRids++; }
+      return status;
+    }
+    case TRACE_END_SCAN:
+      try {
+        index.endScan();
+      } catch(ScanNotInitializedException e) {
+        return 1;
+      }
+      return 0;
+    case TRACE_AGGREGATE_SCAN: {
+      char bounds[2 * STRINGSIZE];
+      if(!readFully(trace, bounds, 2 * STRINGSIZE)) { return -1; }
+      int lowVal, highVal;
+      memcpy(&lowVal, bounds, sizeof(int));
+      memcpy(&highVal, bounds + STRINGSIZE, sizeof(int));
+      KeyAggregate aggregate = index.aggregateScan(lowVal, (Operator) record.lowOp,
+                                                   highVal, (Operator) record.highOp);
+      return aggregate.count % 256;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Replay the calls of a trace whose header has been read against a fresh
+ * index built from the trace's base relation, which must exist while the
+ * index file must not. The index file is removed afterwards.
+ * @param stats TRACE_NUM_OPS entries, counting calls per TraceOp
+ * @param numRids set to the number of rids the replayed scans returned
+ * @param elapsedNanos set to the time the calls took, pacing included
+ * @return false if the trace is truncated or corrupt; the calls before the
+ *   damage were replayed
+ */
+static bool replayTrace(FILE* trace, const TraceHeader& header, BufferManager* bufMgr,
+                        const bool fast, OpStats* stats, long& numRids, uint64_t& elapsedNanos) {
+  const char* names[] = { "", "insert", "delete", "lookup", "lookupBatch", "startScan",
+                          "startPrefixScan", "scanNext", "endScan", "aggregateScan",
+                          "startFilterScan", "insertUnique", "upsert", "updateKey" };
+  for(int op = 0; op < TRACE_NUM_OPS; op++) {
+    OpStats empty = { names[op], 0, 0, 0, 0 };
+    stats[op] = empty;
+  }
+  std::string relationName(header.relationName, strnlen(header.relationName, 20));
+  char scanBounds[2 * (STRINGSIZE + 1)];
+  bool truncated = false;
+  std::string indexName;
+  numRids = 0;
+  {
+    IndexOptions options;
+    options.unique = header.unique;
+    options.collation = (Collation) header.collation;
+    options.lazyDeletes = header.lazyDeletes;
+    BTreeIndex index(relationName, indexName, bufMgr, header.attrByteOffset, options);
+
+    uint64_t start = nowNanos();
+    uint32_t replayStart = expiryClock();
+    uint64_t scheduled = start;
+    TraceRecord record;
+    while(readFully(trace, &record, sizeof(TraceRecord))) {
+      if(record.op < TRACE_INSERT || record.op >= TRACE_NUM_OPS) {
+        truncated = true;
+        break;
+      }
+      scheduled += (uint64_t) record.deltaMicros * 1000;
+      if(!fast) { sleepUntil(scheduled); }
+      uint64_t opStart = nowNanos();
+      int result = replayOp(index, header.unique, trace, record, replayStart, scanBounds, numRids);
+      uint64_t nanos = nowNanos() - opStart;
+      if(result < 0) {
+        truncated = true;
+        break;
+      }
+      OpStats& opStats = stats[record.op];
+      opStats.count++;
+      opStats.totalNanos += nanos;
+      if(nanos > opStats.maxNanos) { opStats.maxNanos = nanos; }
+      if(result != record.result) { opStats.mismatches++; }
+    }
+    elapsedNanos = nowNanos() - start;
+  }
+  File::remove(indexName);
+  return !truncated;
+}
+
+#ifndef TRACE_REPLAY_NO_MAIN
+int main(int argc, char **argv)
+{
+  if(argc < 2) {
+    fprintf(stderr, "usage: %s traceFile [--fast] [bufferFrames]\n", argv[0]);
+    return 1;
+  }
+  bool fast = false;
+  int bufferFrames = 5000;
+  for(int i = 2; i < argc; i++) {
+    if(strcmp(argv[i], "--fast") == 0) { fast = true; }
+    else { bufferFrames = atoi(argv[i]); }
+  }
+
+  FILE* trace = fopen(argv[1], "rb");
+  if(trace == NULL) { perror(argv[1]); return 1; }
+  TraceHeader header;
+  if(!readFully(trace, &header, sizeof(TraceHeader))
+     || memcmp(header.magic, TRACE_FILE_MAGIC, sizeof(TRACE_FILE_MAGIC)) != 0) {
+    fprintf(stderr, "%s is not an index trace\n", argv[1]);
+    return 1;
+  }
+  std::string relationName(header.relationName, strnlen(header.relationName, 20));
+  std::stringstream ss;
+  ss << relationName << '.' << header.attrByteOffset;
+  if(File::exists(ss.str())) {
+    fprintf(stderr, "index file %s exists; replay in a directory without it\n", ss.str().c_str());
+    return 1;
+  }
+  bool createdRelation = false;
+  if(!File::exists(relationName)) { //replay the trace from an empty index
+    PageFile relation(relationName, true);
+    createdRelation = true;
+  }
+
+  OpStats stats[TRACE_NUM_OPS];
+  long numRids = 0;
+  uint64_t elapsedNanos = 0;
+  BufferManager * bufMgr = new BufferManager(bufferFrames);
+  bool complete = replayTrace(trace, header, bufMgr, fast, stats, numRids, elapsedNanos);
+  delete bufMgr;
+  fclose(trace);
+  if(createdRelation) { File::remove(relationName); }
+
+  long numOps = 0;
+  for(int op = TRACE_INSERT; op < TRACE_NUM_OPS; op++) { numOps += stats[op].count; }
+  double seconds = elapsedNanos / 1e9;
+  printf("%ld operations in %.3f s (%s): %.0f operations/s, %ld rids scanned\n",
+         numOps, seconds, fast ? "as fast as possible" : "recorded pace",
+         numOps / seconds, numRids);
+  printf("%-16s %10s %12s %12s %10s\n", "operation", "count", "mean us", "max us", "mismatches");
+  for(int op = TRACE_INSERT; op < TRACE_NUM_OPS; op++) {
+    if(stats[op].count == 0) { continue; }
+    printf("%-16s %10ld %12.2f %12.2f %10ld\n", stats[op].name, stats[op].count,
+           stats[op].totalNanos / 1e3 / stats[op].count, stats[op].maxNanos / 1e3,
+           stats[op].mismatches);
+  }
+  if(!complete) {
+    fprintf(stderr, "trace is truncated or corrupt; replay stopped early\n");
+    return 1;
+  }
+  return 0;
+}
+#endif